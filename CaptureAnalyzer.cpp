@@ -0,0 +1,141 @@
+// Offline analysis of report captures written by CaptureWriter.
+//
+//   CaptureAnalyzer [-j threads] [--columns prefix] [--stats-only] capture...
+//   CaptureAnalyzer --synthesize out.jcap reports
+//
+// Prints per-session statistics and decode throughput. --columns writes the
+// decoded columns of each session as prefix<index>.<column>.<type>.
+#include "src/capture_analyzer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    // A still controller with a slightly off-center left stick, a small gyro
+    // bias and a dropped report every 1000, for benchmarking without hardware
+    void synthesize(const string& path, uint64_t reports) {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) {
+            throw runtime_error("Cannot open " + path);
+        }
+        joycon_capture::FileHeader header{};
+        header.magic = joycon_capture::MAGIC;
+        header.version = joycon_capture::VERSION;
+        header.header_size = sizeof(header);
+        header.record_size = sizeof(joycon_capture::Record);
+        header.product_id = 0x2006;
+        joycon_capture::Calibration& cal = header.calibration;
+        for (int a = 0; a < 3; ++a) {
+            cal.accel_coeff[a] = 1.0f;
+            cal.gyro_coeff[a] = 1.0f;
+        }
+        cal.accel_units_per_g = 4096.0f;
+        cal.gyro_units_per_dps = 14.247f;
+        for (auto& center : header.stick_center) {
+            center = 0x800;
+        }
+        fwrite(&header, sizeof(header), 1, f);
+
+        joycon_capture::Record record{};
+        uint8_t timer = 0;
+        int64_t time_ns = 0;
+        for (uint64_t i = 0; i < reports; ++i) {
+            uint8_t* r = record.report;
+            int ticks = (i % 1000 == 999) ? 6 : 3;
+            timer = static_cast<uint8_t>(timer + ticks);
+            time_ns += ticks * 5000000LL;
+            record.host_time_ns = time_ns;
+            r[0] = 0x30;
+            r[1] = timer;
+            r[3] = (i / 500) % 2 ? 0x01 : 0x00;
+            uint16_t h = 0x800 + 40, v = 0x800 - 25;
+            r[6] = h & 0xFF;
+            r[7] = static_cast<uint8_t>((h >> 8) | ((v & 0x0F) << 4));
+            r[8] = static_cast<uint8_t>(v >> 4);
+            r[9] = 0x00;
+            r[10] = 0x08;
+            r[11] = 0x80;
+            for (int sample = 0; sample < 3; ++sample) {
+                uint8_t* p = r + 13 + sample * 12;
+                int16_t imu[6] = {0, 0, 4096, 7, -4, 2};
+                memcpy(p, imu, sizeof(imu));
+            }
+            fwrite(&record, sizeof(record), 1, f);
+        }
+        if (fclose(f) != 0) {
+            throw runtime_error("Cannot write " + path);
+        }
+    }
+
+    void print_stats(const SessionStats& s) {
+        printf("%s\n", s.path.c_str());
+        printf("  product 0x%04X, %llu reports over %.1f s\n", s.product_id,
+               static_cast<unsigned long long>(s.reports), s.duration_s);
+        printf("  dropped %llu (%.3f%%), link gaps %llu\n", static_cast<unsigned long long>(s.dropped),
+               s.drop_rate * 100.0, static_cast<unsigned long long>(s.link_gaps));
+        printf("  stick rest offset L (%.1f, %.1f) from (0x%03X, 0x%03X) over %llu, R (%.1f, %.1f) from (0x%03X, 0x%03X) over %llu\n",
+               s.stick_rest_offset[0], s.stick_rest_offset[1], s.stick_center[0], s.stick_center[1],
+               static_cast<unsigned long long>(s.stick_rest_samples[0]),
+               s.stick_rest_offset[2], s.stick_rest_offset[3], s.stick_center[2], s.stick_center[3],
+               static_cast<unsigned long long>(s.stick_rest_samples[1]));
+        printf("  gyro bias (%.3f, %.3f, %.3f) dps, stationary %.1f%%\n",
+               s.gyro_bias_dps[0], s.gyro_bias_dps[1], s.gyro_bias_dps[2], s.stationary_fraction * 100.0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    AnalyzerOptions options;
+    string columns_prefix;
+    vector<string> paths;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            if (arg == "-j" && i + 1 < argc) {
+                options.threads = static_cast<unsigned>(stoul(argv[++i]));
+            } else if (arg == "--columns" && i + 1 < argc) {
+                columns_prefix = argv[++i];
+            } else if (arg == "--stats-only") {
+                options.keep_columns = false;
+            } else if (arg == "--synthesize" && i + 2 < argc) {
+                synthesize(argv[i + 1], stoull(argv[i + 2]));
+                return 0;
+            } else if (!arg.empty() && arg[0] == '-') {
+                throw invalid_argument("Unknown option " + arg);
+            } else {
+                paths.push_back(arg);
+            }
+        }
+        if (paths.empty()) {
+            cerr << "Usage: CaptureAnalyzer [-j threads] [--columns prefix] [--stats-only] capture...\n"
+                 << "       CaptureAnalyzer --synthesize out.jcap reports\n";
+            return 2;
+        }
+        if (!columns_prefix.empty() && !options.keep_columns) {
+            throw invalid_argument("--columns needs the decoded columns, drop --stats-only");
+        }
+
+        AnalysisResult result = analyze_captures(paths, options);
+        for (size_t s = 0; s < result.sessions.size(); ++s) {
+            print_stats(result.sessions[s].stats);
+            if (!columns_prefix.empty()) {
+                write_columns(result.sessions[s].columns, columns_prefix + to_string(s) + ".");
+            }
+        }
+        printf("%llu reports in %.3f s on %u threads: %.2fM reports/s, %.2fM per thread\n",
+               static_cast<unsigned long long>(result.reports), result.decode_seconds, result.threads,
+               result.reports_per_second / 1e6, result.reports_per_second_per_thread / 1e6);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
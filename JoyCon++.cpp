@@ -1,4 +1,5 @@
 ﻿#include "src/bluetooth.h"            // scan_classic, scan_ble, connect_and_subscribe
+#include "src/joycon2.h"              // JoyCon2Commands
 
 #include <winrt/base.h>               // init_apartment, check_hresult, put_abi
 #include <winrt/Windows.System.h>     // DispatcherQueueController
@@ -93,7 +94,14 @@ int main()
                 auto& target = bles[sel - 1];
                 cout << "Connecting to " << target.address << " …\n";
 
-                if (connect_and_subscribe(target.address)) {
+                std::shared_ptr<GattWriter> writer;
+                if (connect_and_subscribe(target.address, &writer)) {
+                    std::unique_ptr<JoyCon2Commands> commands;
+                    if (writer) {
+                        commands = std::make_unique<JoyCon2Commands>(writer);
+                        commands->enable_imu();
+                        commands->set_player_lamp(1);
+                    }
                     cout << "▶️  Streaming started. Press ENTER to disconnect.\n";
                     cin.get();  // wait for ENTER
                     cout << "Disconnected.\n";
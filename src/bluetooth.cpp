@@ -21,6 +21,9 @@
 #include <thread>
 #include <chrono>
 #include <algorithm>
+#include <stdexcept>
+
+#include "joycon2.h"
 
 using namespace winrt;
 using namespace winrt::Windows::Foundation;        // array_view, to_hstring, to_string
@@ -95,9 +98,11 @@ std::vector<Device> scan_classic() {
     struct hid_device_info* cur_dev = devs;
 
     while (cur_dev) {
-        // Joy-Con L: PID 0x2006, Joy-Con R: PID 0x2007
+        // Joy-Con L: PID 0x2006, Joy-Con R: PID 0x2007,
+        // Pro Controller: PID 0x2009, charging grip: PID 0x200E
         if (cur_dev->vendor_id == 0x057e &&
-            (cur_dev->product_id == 0x2006 || cur_dev->product_id == 0x2007)) {
+            (cur_dev->product_id == 0x2006 || cur_dev->product_id == 0x2007
+             || cur_dev->product_id == 0x2009 || cur_dev->product_id == 0x200E)) {
 
             Device d;
             d.isBLE = false;
@@ -105,8 +110,12 @@ std::vector<Device> scan_classic() {
             d.connected = true; // If it's enumerated, it's connected
             if (cur_dev->product_id == 0x2006)
                 d.name = "Joy-Con 1 (L)";
-            else
+            else if (cur_dev->product_id == 0x2007)
                 d.name = "Joy-Con 1 (R)";
+            else if (cur_dev->product_id == 0x2009)
+                d.name = "Pro Controller";
+            else
+                d.name = "Charging Grip";
 
             out.push_back(d);
 
@@ -224,6 +233,33 @@ static constexpr GUID MyServiceUuid = {
 };
 
 
+// Joy-Con 2 command channel over the writable characteristic. Keeps the
+// device object alive as long as commands may be sent.
+class WinRtGattWriter : public GattWriter {
+public:
+    WinRtGattWriter(BluetoothLEDevice device, GattCharacteristic characteristic, bool without_response)
+        : device_(std::move(device)), characteristic_(std::move(characteristic)), without_response_(without_response) {}
+
+    bool write_without_response(const uint8_t* data, size_t size) override {
+        DataWriter writer;
+        writer.WriteBytes(array_view<uint8_t const>(data, data + size));
+        auto option = without_response_ ? GattWriteOption::WriteWithoutResponse : GattWriteOption::WriteWithResponse;
+        auto status = characteristic_.WriteValueAsync(writer.DetachBuffer(), option).get();
+        if (status == GattCommunicationStatus::Success) return true;
+        // ProtocolError is an ATT error from the device, not a full buffer:
+        // retrying the same command would be refused again
+        if (status == GattCommunicationStatus::ProtocolError) {
+            throw std::runtime_error("GATT write rejected by the device");
+        }
+        throw std::runtime_error("GATT write failed");
+    }
+
+private:
+    BluetoothLEDevice device_;
+    GattCharacteristic characteristic_;
+    bool without_response_;
+};
+
 static void OnCharChanged(
     GattCharacteristic const& ch,
     GattValueChangedEventArgs const& args)
@@ -290,7 +326,7 @@ void dumpServices(BluetoothLEDevice const& ble) {
 }
 
 
-bool connect_and_subscribe(std::string const& addrStr) {
+bool connect_and_subscribe(std::string const& addrStr, std::shared_ptr<GattWriter>* writer) {
     uint64_t addr = parseBleAddress(addrStr);
 
     auto bleOp = BluetoothLEDevice::FromBluetoothAddressAsync(addr).get();
@@ -332,6 +368,8 @@ bool connect_and_subscribe(std::string const& addrStr) {
 
 
     bool any = false;
+    GattCharacteristic writable{ nullptr };
+    bool writableWithoutResponse = false;
     for (auto const& ch : cres.Characteristics()) {
         auto props = ch.CharacteristicProperties();
 
@@ -341,7 +379,12 @@ bool connect_and_subscribe(std::string const& addrStr) {
             std::cout << "📝 Found writable characteristic: "
                 << to_string(to_hstring(ch.Uuid())) << "\n";
 
-            // Save the characteristic to write to it after
+            // Prefer write-without-response, it does not wait for the controller
+            bool withoutResponse = (props & GattCharacteristicProperties::WriteWithoutResponse) != GattCharacteristicProperties::None;
+            if (!writable || (withoutResponse && !writableWithoutResponse)) {
+                writable = ch;
+                writableWithoutResponse = withoutResponse;
+            }
         }
 
         bool canNotify = ((props & GattCharacteristicProperties::Notify) != GattCharacteristicProperties::None)
@@ -372,6 +415,9 @@ bool connect_and_subscribe(std::string const& addrStr) {
         std::cerr << "❌ No Notify-capable characteristics\n";
         return false;
     }
+    if (writer && writable) {
+        *writer = std::make_shared<WinRtGattWriter>(ble, writable, writableWithoutResponse);
+    }
     std::cout << "✔️ Waiting for notifications...\n";
     return true;
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
 ﻿#pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
+class GattWriter;
+
 struct Device {
 	bool        isBLE;
 	std::string address;   // printable “AA:BB:…”
@@ -17,4 +20,6 @@ std::vector<Device> scan_ble();
 // NEW: connect to a BLE device by address string ("AA:BB:CC:DD:EE:FF"),
 // discover the 128-bit service, subscribe to all Notify chars, and
 // print incoming packets. Returns true on success.
-bool connect_and_subscribe(std::string const& addrStr);
\ No newline at end of file
+// If writer is given it receives the writable characteristic, to send
+// Joy-Con 2 commands through JoyCon2Commands.
+bool connect_and_subscribe(std::string const& addrStr, std::shared_ptr<GattWriter>* writer = nullptr);
\ No newline at end of file
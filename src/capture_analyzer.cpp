@@ -0,0 +1,368 @@
+#include "capture_analyzer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    using joycon_capture::Record;
+
+    constexpr double TIMER_TICK_SECONDS = 0.005;
+    // Standard full mode reports every 15 ms, three timer ticks
+    constexpr int TICKS_PER_REPORT = 3;
+    // Longer host gaps may have wrapped the 8-bit timer
+    constexpr double MAX_TIMER_GAP_SECONDS = 256 * TIMER_TICK_SECONDS * 0.9;
+    constexpr int STICK_CENTER = 0x800;
+    constexpr int STICK_REST_WINDOW = 256;
+    constexpr float STATIONARY_GYRO_DPS = 10.0f;
+    constexpr float STATIONARY_ACCEL_G = 0.1f;
+
+    // Read-only mapping of a whole file
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+            file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file_ == INVALID_HANDLE_VALUE) {
+                throw std::runtime_error("Cannot open " + path);
+            }
+            LARGE_INTEGER size;
+            GetFileSizeEx(file_, &size);
+            size_ = static_cast<size_t>(size.QuadPart);
+            if (size_ > 0) {
+                mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                data_ = mapping_ ? static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+                if (!data_) {
+                    close();
+                    throw std::runtime_error("Cannot map " + path);
+                }
+            }
+#else
+            fd_ = ::open(path.c_str(), O_RDONLY);
+            if (fd_ < 0) {
+                throw std::runtime_error("Cannot open " + path);
+            }
+            struct stat st;
+            if (fstat(fd_, &st) != 0) {
+                close();
+                throw std::runtime_error("Cannot stat " + path);
+            }
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ > 0) {
+                void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+                if (data == MAP_FAILED) {
+                    close();
+                    throw std::runtime_error("Cannot map " + path);
+                }
+                data_ = static_cast<const uint8_t*>(data);
+                // Workers read their chunks front to back
+                madvise(data, size_, MADV_SEQUENTIAL);
+            }
+#endif
+        }
+        ~MappedFile() { close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint8_t* data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        const uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+#ifdef _WIN32
+        HANDLE file_ = INVALID_HANDLE_VALUE;
+        HANDLE mapping_ = nullptr;
+
+        void close() {
+            if (data_) UnmapViewOfFile(data_);
+            if (mapping_) CloseHandle(mapping_);
+            if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+            data_ = nullptr;
+            mapping_ = nullptr;
+            file_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        int fd_ = -1;
+
+        void close() {
+            if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+            if (fd_ >= 0) ::close(fd_);
+            data_ = nullptr;
+            fd_ = -1;
+        }
+#endif
+    };
+
+    struct Session {
+        std::unique_ptr<MappedFile> file;
+        joycon_capture::FileHeader header;
+        const Record* records = nullptr;
+        size_t count = 0;
+    };
+
+    struct Chunk {
+        size_t session;
+        size_t begin;
+        size_t end;
+    };
+
+    // Sums of one chunk, merged in chunk order so results do not depend on
+    // which worker took what
+    struct Partial {
+        uint64_t dropped = 0;
+        uint64_t link_gaps = 0;
+        std::array<double, 4> stick_sum{};
+        std::array<uint64_t, 2> stick_rest{};
+        std::array<double, 3> gyro_sum{};
+        uint64_t imu_samples = 0;
+        uint64_t stationary = 0;
+    };
+
+    int16_t read_int16(const uint8_t* p) {
+        return static_cast<int16_t>(p[0] | (p[1] << 8));
+    }
+
+    void decode_chunk(const Session& session, const Chunk& chunk, CaptureColumns* columns, Partial& partial) {
+        const joycon_capture::Calibration& cal = session.header.calibration;
+        float accel_scale[3], gyro_scale[3];
+        for (int a = 0; a < 3; ++a) {
+            accel_scale[a] = cal.accel_coeff[a] / cal.accel_units_per_g;
+            gyro_scale[a] = cal.gyro_coeff[a] / cal.gyro_units_per_dps;
+        }
+
+        for (size_t i = chunk.begin; i < chunk.end; ++i) {
+            const Record& record = session.records[i];
+            const uint8_t* r = record.report;
+
+            if (i > 0) {
+                const Record& previous = session.records[i - 1];
+                double gap = (record.host_time_ns - previous.host_time_ns) * 1e-9;
+                if (gap > MAX_TIMER_GAP_SECONDS) {
+                    partial.link_gaps++;
+                } else {
+                    int ticks = static_cast<uint8_t>(r[1] - previous.report[1]);
+                    int reports = (ticks + TICKS_PER_REPORT / 2) / TICKS_PER_REPORT;
+                    if (reports > 1) partial.dropped += reports - 1;
+                }
+            }
+
+            uint32_t buttons = r[3] | (r[4] << 8) | (r[5] << 16);
+            std::array<int16_t, 4> sticks = {
+                static_cast<int16_t>(r[6] | ((r[7] & 0x0F) << 8)),
+                static_cast<int16_t>((r[7] >> 4) | (r[8] << 4)),
+                static_cast<int16_t>(r[9] | ((r[10] & 0x0F) << 8)),
+                static_cast<int16_t>((r[10] >> 4) | (r[11] << 4)),
+            };
+            for (int s = 0; s < 2; ++s) {
+                int h = sticks[s * 2] - session.header.stick_center[s * 2];
+                int v = sticks[s * 2 + 1] - session.header.stick_center[s * 2 + 1];
+                if (std::abs(h) < STICK_REST_WINDOW && std::abs(v) < STICK_REST_WINDOW) {
+                    partial.stick_sum[s * 2] += h;
+                    partial.stick_sum[s * 2 + 1] += v;
+                    partial.stick_rest[s]++;
+                }
+            }
+            if (columns) {
+                columns->time_ns[i] = record.host_time_ns;
+                columns->timer[i] = r[1];
+                columns->buttons[i] = buttons;
+                for (int s = 0; s < 4; ++s) columns->sticks[s][i] = sticks[s];
+            }
+
+            // Simple (0x3F) reports carry no IMU data
+            bool imu = r[0] == 0x30 || r[0] == 0x31;
+            for (int sample = 0; sample < 3; ++sample) {
+                float accel[3] = {}, gyro[3] = {};
+                if (imu) {
+                    const uint8_t* p = r + 13 + sample * 12;
+                    for (int a = 0; a < 3; ++a) {
+                        accel[a] = (read_int16(p + a * 2) - cal.accel_offset[a]) * accel_scale[a];
+                        gyro[a] = (read_int16(p + 6 + a * 2) - cal.gyro_offset[a]) * gyro_scale[a];
+                    }
+                    float g = std::sqrt(gyro[0] * gyro[0] + gyro[1] * gyro[1] + gyro[2] * gyro[2]);
+                    float a = std::sqrt(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+                    partial.imu_samples++;
+                    if (g < STATIONARY_GYRO_DPS && std::abs(a - 1.0f) < STATIONARY_ACCEL_G) {
+                        partial.stationary++;
+                        for (int k = 0; k < 3; ++k) partial.gyro_sum[k] += gyro[k];
+                    }
+                }
+                if (columns) {
+                    for (int k = 0; k < 3; ++k) {
+                        columns->accel[k][i * 3 + sample] = accel[k];
+                        columns->gyro[k][i * 3 + sample] = gyro[k];
+                    }
+                }
+            }
+        }
+    }
+
+    void resize_columns(CaptureColumns& columns, size_t count) {
+        columns.time_ns.resize(count);
+        columns.timer.resize(count);
+        columns.buttons.resize(count);
+        for (auto& c : columns.sticks) c.resize(count);
+        for (auto& c : columns.accel) c.resize(count * 3);
+        for (auto& c : columns.gyro) c.resize(count * 3);
+    }
+
+    template <class T>
+    void write_column(const std::vector<T>& column, const std::string& path) {
+        std::FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        size_t written = column.empty() ? 0 : std::fwrite(column.data(), sizeof(T), column.size(), f);
+        std::fclose(f);
+        if (written != column.size()) {
+            throw std::runtime_error("Cannot write " + path);
+        }
+    }
+}
+
+AnalysisResult analyze_captures(const std::vector<std::string>& paths, const AnalyzerOptions& options) {
+    if (options.chunk_records == 0) {
+        throw std::invalid_argument("chunk_records must be at least 1");
+    }
+    std::vector<Session> sessions(paths.size());
+    std::vector<Chunk> chunks;
+    for (size_t s = 0; s < paths.size(); ++s) {
+        Session& session = sessions[s];
+        session.file = std::make_unique<MappedFile>(paths[s]);
+        if (session.file->size() < joycon_capture::HEADER_SIZE_V1) {
+            throw std::runtime_error(paths[s] + " is not a capture");
+        }
+        // Version 1 headers are shorter, the fields added since get the
+        // values version 1 captures implied
+        auto& h = session.header;
+        h = {};
+        std::memcpy(&h, session.file->data(), joycon_capture::HEADER_SIZE_V1);
+        size_t header_size = h.version >= 2 ? sizeof(h) : joycon_capture::HEADER_SIZE_V1;
+        if (h.magic != joycon_capture::MAGIC || h.version < 1 || h.version > joycon_capture::VERSION
+            || h.record_size != sizeof(Record) || h.header_size < header_size || h.header_size % 8 != 0
+            || h.header_size > session.file->size()) {
+            throw std::runtime_error(paths[s] + " is not a supported capture");
+        }
+        if (h.version >= 2) {
+            std::memcpy(&h, session.file->data(), sizeof(h));
+        } else {
+            std::fill(std::begin(h.stick_center), std::end(h.stick_center), static_cast<uint16_t>(STICK_CENTER));
+        }
+        // A truncated last record (capture cut short) is ignored
+        session.count = (session.file->size() - h.header_size) / sizeof(Record);
+        session.records = reinterpret_cast<const Record*>(session.file->data() + h.header_size);
+        for (size_t begin = 0; begin < session.count; begin += options.chunk_records) {
+            chunks.push_back({s, begin, std::min(session.count, begin + options.chunk_records)});
+        }
+    }
+
+    AnalysisResult result;
+    result.sessions.resize(sessions.size());
+    for (size_t s = 0; s < sessions.size(); ++s) {
+        result.sessions[s].stats.path = paths[s];
+        result.sessions[s].stats.product_id = sessions[s].header.product_id;
+        std::copy(std::begin(sessions[s].header.stick_center), std::end(sessions[s].header.stick_center),
+                  result.sessions[s].stats.stick_center.begin());
+        if (options.keep_columns) {
+            resize_columns(result.sessions[s].columns, sessions[s].count);
+        }
+    }
+
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(chunks.size(), 1)));
+    result.threads = threads;
+
+    // Workers claim chunks from a shared counter, so uneven files balance
+    // out; each chunk writes its own column rows and partial sums
+    std::vector<Partial> partials(chunks.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t c = next.fetch_add(1); c < chunks.size(); c = next.fetch_add(1)) {
+            const Chunk& chunk = chunks[c];
+            CaptureColumns* columns = options.keep_columns ? &result.sessions[chunk.session].columns : nullptr;
+            decode_chunk(sessions[chunk.session], chunk, columns, partials[c]);
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    result.decode_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<Partial> totals(sessions.size());
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        Partial& total = totals[chunks[c].session];
+        const Partial& p = partials[c];
+        total.dropped += p.dropped;
+        total.link_gaps += p.link_gaps;
+        for (int k = 0; k < 4; ++k) total.stick_sum[k] += p.stick_sum[k];
+        for (int k = 0; k < 2; ++k) total.stick_rest[k] += p.stick_rest[k];
+        for (int k = 0; k < 3; ++k) total.gyro_sum[k] += p.gyro_sum[k];
+        total.imu_samples += p.imu_samples;
+        total.stationary += p.stationary;
+    }
+    for (size_t s = 0; s < sessions.size(); ++s) {
+        SessionStats& stats = result.sessions[s].stats;
+        const Partial& total = totals[s];
+        const Session& session = sessions[s];
+        stats.reports = session.count;
+        stats.dropped = total.dropped;
+        stats.link_gaps = total.link_gaps;
+        stats.drop_rate = session.count ? static_cast<double>(total.dropped) / (session.count + total.dropped) : 0.0;
+        if (session.count > 1) {
+            stats.duration_s = (session.records[session.count - 1].host_time_ns - session.records[0].host_time_ns) * 1e-9;
+        }
+        for (int k = 0; k < 4; ++k) {
+            uint64_t n = total.stick_rest[k / 2];
+            stats.stick_rest_offset[k] = n ? total.stick_sum[k] / n : 0.0;
+        }
+        stats.stick_rest_samples = total.stick_rest;
+        for (int k = 0; k < 3; ++k) {
+            stats.gyro_bias_dps[k] = total.stationary ? total.gyro_sum[k] / total.stationary : 0.0;
+        }
+        stats.stationary_fraction = total.imu_samples ? static_cast<double>(total.stationary) / total.imu_samples : 0.0;
+        result.reports += session.count;
+    }
+    if (result.decode_seconds > 0) {
+        result.reports_per_second = result.reports / result.decode_seconds;
+        result.reports_per_second_per_thread = result.reports_per_second / threads;
+    }
+    return result;
+}
+
+void write_columns(const CaptureColumns& columns, const std::string& prefix) {
+    static const char* STICKS[] = {"stick_left_h", "stick_left_v", "stick_right_h", "stick_right_v"};
+    static const char* AXES[] = {"x", "y", "z"};
+    write_column(columns.time_ns, prefix + "time_ns.i64");
+    write_column(columns.timer, prefix + "timer.u8");
+    write_column(columns.buttons, prefix + "buttons.u32");
+    for (int s = 0; s < 4; ++s) {
+        write_column(columns.sticks[s], prefix + STICKS[s] + ".i16");
+    }
+    for (int a = 0; a < 3; ++a) {
+        write_column(columns.accel[a], prefix + "accel_" + AXES[a] + ".f32");
+        write_column(columns.gyro[a], prefix + "gyro_" + AXES[a] + ".f32");
+    }
+}
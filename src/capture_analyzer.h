@@ -0,0 +1,67 @@
+#pragma once
+
+#include "capture_format.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AnalyzerOptions {
+    // Worker threads, 0 uses every hardware thread
+    unsigned threads = 0;
+    // Records per work item; workers claim items until none are left
+    size_t chunk_records = 1 << 16;
+    // Off: only statistics, no per-report columns
+    bool keep_columns = true;
+};
+
+// Decoded reports in columns. Report columns have one row per record, IMU
+// columns three (the samples of each report, oldest first).
+struct CaptureColumns {
+    std::vector<int64_t> time_ns;
+    std::vector<uint8_t> timer;
+    std::vector<uint32_t> buttons;              // report bytes 3..5, byte 3 in bits 0-7
+    std::array<std::vector<int16_t>, 4> sticks; // left h/v, right h/v, raw counts
+    std::array<std::vector<float>, 3> accel;    // G
+    std::array<std::vector<float>, 3> gyro;     // dps
+};
+
+struct SessionStats {
+    std::string path;
+    uint16_t product_id = 0;
+    uint64_t reports = 0;
+    uint64_t dropped = 0;           // reports missing from device timer steps
+    uint64_t link_gaps = 0;         // host gaps longer than the 8-bit timer can count
+    double drop_rate = 0.0;
+    double duration_s = 0.0;
+    // Stick centers from the header (0x800 for version 1 captures) and the
+    // mean offset from them while the stick is at rest
+    std::array<uint16_t, 4> stick_center{};
+    std::array<double, 4> stick_rest_offset{};
+    std::array<uint64_t, 2> stick_rest_samples{};
+    // Mean gyro over samples where the controller was still
+    std::array<double, 3> gyro_bias_dps{};
+    double stationary_fraction = 0.0;
+};
+
+struct CaptureSession {
+    SessionStats stats;
+    CaptureColumns columns;
+};
+
+struct AnalysisResult {
+    std::vector<CaptureSession> sessions;
+    unsigned threads = 0;
+    uint64_t reports = 0;
+    double decode_seconds = 0.0;
+    double reports_per_second = 0.0;
+    double reports_per_second_per_thread = 0.0;
+};
+
+// Memory-maps every capture and decodes all of them in parallel, one file
+// per session. Throws std::runtime_error on an unreadable or malformed file.
+AnalysisResult analyze_captures(const std::vector<std::string>& paths, const AnalyzerOptions& options = {});
+
+// One raw little-endian file per column, named prefix + column + type
+// suffix (e.g. "run1.gyro_x.f32"), ready for numpy.fromfile()
+void write_columns(const CaptureColumns& columns, const std::string& prefix);
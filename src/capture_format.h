@@ -0,0 +1,63 @@
+// capture_format.h
+// File layout of raw report captures written by CaptureWriter and read by
+// the offline analyzer. Kept free of JoyCon/hidapi includes so analysis
+// tools only need this file. One file is one session: a header followed
+// by fixed-size records, so any record range can be decoded on its own.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace joycon_capture {
+
+constexpr uint32_t MAGIC = 0x50434A43;  // "CJCP"
+constexpr uint32_t VERSION = 2;
+// Version 1 headers end after the IMU calibration
+constexpr size_t HEADER_SIZE_V1 = 88;
+constexpr size_t REPORT_SIZE = 49;
+
+// Effective IMU calibration when the capture started, the getters compute
+// (raw - offset) * coeff and divide by the units to get G and dps
+struct Calibration {
+    float accel_offset[3];
+    float accel_coeff[3];
+    float gyro_offset[3];
+    float gyro_coeff[3];
+    float accel_units_per_g;
+    float gyro_units_per_dps;
+};
+
+// JoyCon::status_offset_ when the capture started, the getters subtract
+// it: sticks in raw counts, gyro in calibrated units before dividing by
+// gyro_units_per_dps
+struct StatusOffset {
+    int32_t sticks[4];          // left h/v, right h/v
+    float gyro[3];
+    uint32_t reserved;
+};
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint16_t product_id;
+    uint16_t reserved;
+    uint32_t reserved2;
+    int64_t start_time_ns;      // system_clock, for matching sessions to rig logs
+    Calibration calibration;
+    // Since version 2
+    uint16_t stick_center[4];   // left h/v, right h/v, from the stick calibration
+    StatusOffset status_offset;
+};
+
+struct Record {
+    int64_t host_time_ns;       // steady_clock time the report was received
+    uint8_t report[REPORT_SIZE];
+    uint8_t reserved[7];
+};
+
+static_assert(sizeof(Record) == 64, "records are fixed at 64 bytes");
+static_assert(sizeof(FileHeader) % 8 == 0, "records stay 8-byte aligned");
+static_assert(offsetof(FileHeader, stick_center) == HEADER_SIZE_V1, "version 2 only appends");
+
+}
@@ -0,0 +1,81 @@
+#include "capture_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    constexpr size_t FILE_BUFFER_SIZE = 1 << 16;
+}
+
+CaptureWriter::CaptureWriter(JoyCon& joycon, const std::string& path)
+    : joycon_(joycon),
+      file_(std::fopen(path.c_str(), "wb")),
+      records_(0),
+      failed_(false)
+{
+    if (!file_) {
+        throw std::runtime_error("Cannot open capture file " + path);
+    }
+    std::setvbuf(file_, nullptr, _IOFBF, FILE_BUFFER_SIZE);
+
+    joycon_capture::FileHeader header{};
+    header.magic = joycon_capture::MAGIC;
+    header.version = joycon_capture::VERSION;
+    header.header_size = sizeof(header);
+    header.record_size = sizeof(joycon_capture::Record);
+    header.product_id = joycon.get_product_id();
+    header.start_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    auto calibration = joycon.get_calibration();
+    joycon_capture::Calibration& cal = header.calibration;
+    std::copy(calibration.accel_offset.begin(), calibration.accel_offset.end(), cal.accel_offset);
+    std::copy(calibration.accel_coeff.begin(), calibration.accel_coeff.end(), cal.accel_coeff);
+    std::copy(calibration.gyro_offset.begin(), calibration.gyro_offset.end(), cal.gyro_offset);
+    std::copy(calibration.gyro_coeff.begin(), calibration.gyro_coeff.end(), cal.gyro_coeff);
+    cal.accel_units_per_g = JoyCon::ACCEL_UNITS_PER_G;
+    cal.gyro_units_per_dps = JoyCon::GYRO_UNITS_PER_DPS;
+
+    const JoyCon::Offset& offset = calibration.status_offset;
+    header.status_offset.sticks[0] = offset.stick_left_horizontal;
+    header.status_offset.sticks[1] = offset.stick_left_vertical;
+    header.status_offset.sticks[2] = offset.stick_right_horizontal;
+    header.status_offset.sticks[3] = offset.stick_right_vertical;
+    header.status_offset.gyro[0] = offset.gyro_x;
+    header.status_offset.gyro[1] = offset.gyro_y;
+    header.status_offset.gyro[2] = offset.gyro_z;
+    for (size_t side = 0; side < 2; ++side) {
+        header.stick_center[side * 2] = calibration.sticks[side].center[0];
+        header.stick_center[side * 2 + 1] = calibration.sticks[side].center[1];
+    }
+    if (std::fwrite(&header, sizeof(header), 1, file_) != 1) {
+        std::fclose(file_);
+        throw std::runtime_error("Cannot write capture header to " + path);
+    }
+    hook_id_ = joycon_.register_update_hook([this](JoyCon& jc) { on_report(jc); });
+}
+
+CaptureWriter::~CaptureWriter() {
+    joycon_.unregister_update_hook(hook_id_);
+    std::fclose(file_);
+}
+
+void CaptureWriter::on_report(JoyCon& joycon) {
+    if (failed_.load(std::memory_order_relaxed)) return;
+    joycon_capture::Record record{};
+    record.host_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(joycon.get_report_time().time_since_epoch()).count();
+    auto report = joycon.get_input_report();
+    std::memcpy(record.report, report.data(), joycon_capture::REPORT_SIZE);
+    if (std::fwrite(&record, sizeof(record), 1, file_) != 1) {
+        failed_.store(true, std::memory_order_relaxed);
+        return;
+    }
+    records_.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t CaptureWriter::get_records() const {
+    return records_.load(std::memory_order_relaxed);
+}
+
+bool CaptureWriter::failed() const {
+    return failed_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "joycon.h"
+#include "capture_format.h"
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+// Appends every report of a JoyCon to a capture file (see
+// capture_format.h) for offline analysis. Writes happen on the input
+// thread through a stdio buffer; the file is complete once the writer is
+// destroyed.
+class CaptureWriter {
+public:
+    CaptureWriter(JoyCon& joycon, const std::string& path);
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    uint64_t get_records() const;
+    // Set once a write failed, later reports are not written
+    bool failed() const;
+
+private:
+    JoyCon& joycon_;
+    std::FILE* file_;
+    size_t hook_id_;
+    std::atomic<uint64_t> records_;
+    std::atomic<bool> failed_;
+
+    void on_report(JoyCon& joycon);
+};
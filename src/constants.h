@@ -6,9 +6,13 @@
 constexpr uint16_t JOYCON_VENDOR_ID    = 0x057E;
 constexpr uint16_t JOYCON_L_PRODUCT_ID = 0x2006;
 constexpr uint16_t JOYCON_R_PRODUCT_ID = 0x2007;
+constexpr uint16_t PRO_CONTROLLER_PRODUCT_ID = 0x2009;
+constexpr uint16_t CHARGING_GRIP_PRODUCT_ID = 0x200E;
 
 
 const std::set<uint16_t> JOYCON_PRODUCT_IDS = {
     JOYCON_L_PRODUCT_ID,
-    JOYCON_R_PRODUCT_ID
+    JOYCON_R_PRODUCT_ID,
+    PRO_CONTROLLER_PRODUCT_ID,
+    CHARGING_GRIP_PRODUCT_ID
 };
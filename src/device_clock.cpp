@@ -0,0 +1,91 @@
+#include "device_clock.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // How fast the envelope may rise per second of device time, covers
+    // drift not yet estimated and lets the offset recover from outliers
+    constexpr double ENVELOPE_LEAK = 50e-6;
+
+    // Drift is the slope between envelope minima of windows this long
+    constexpr double DRIFT_WINDOW = 2.0;
+    constexpr double DRIFT_GAIN = 0.25;
+    constexpr double MAX_DRIFT = 500e-6;
+
+    // Past half a timer period a wrap can't be told from the timer alone
+    constexpr double WRAP_TICKS = 128.0;
+
+    double seconds(DeviceClock::clock::duration d) {
+        return std::chrono::duration<double>(d).count();
+    }
+}
+
+void DeviceClock::reset() {
+    *this = DeviceClock();
+}
+
+DeviceClock::clock::time_point DeviceClock::update(uint8_t timer, clock::time_point received) {
+    if (!seen_) {
+        double drift = drift_;
+        reset();
+        drift_ = drift;
+        origin_ = received;
+        last_received_ = received;
+        last_timer_ = timer;
+        seen_ = true;
+        return received;
+    }
+
+    // Unwrap, long gaps are resolved with the host clock
+    int64_t delta = static_cast<uint8_t>(timer - last_timer_);
+    double expected = seconds(received - last_received_) / TICK_PERIOD;
+    if (expected > WRAP_TICKS) {
+        delta += 256 * std::max<int64_t>(0, std::llround((expected - delta) / 256.0));
+    }
+    ticks_ += delta;
+    last_timer_ = timer;
+    last_received_ = received;
+
+    double device = ticks_ * TICK_PERIOD;
+    double candidate = seconds(received - origin_) - device;
+    double elapsed = device - base_device_;
+    base_ = std::min(candidate, base_ + (drift_ + ENVELOPE_LEAK) * elapsed);
+    base_device_ = device;
+
+    if (!has_window_min_ || candidate < window_min_) {
+        window_min_ = candidate;
+        window_min_device_ = device;
+        has_window_min_ = true;
+    }
+    if (device - window_start_ >= DRIFT_WINDOW) {
+        if (has_prev_min_ && window_min_device_ > prev_min_device_) {
+            double slope = (window_min_ - prev_min_) / (window_min_device_ - prev_min_device_);
+            drift_ += DRIFT_GAIN * (std::clamp(slope, -MAX_DRIFT, MAX_DRIFT) - drift_);
+        }
+        prev_min_ = window_min_;
+        prev_min_device_ = window_min_device_;
+        has_prev_min_ = true;
+        window_start_ = device;
+        has_window_min_ = false;
+    }
+    return to_host(ticks_);
+}
+
+DeviceClock::clock::time_point DeviceClock::to_host(int64_t ticks) const {
+    double device = ticks * TICK_PERIOD;
+    double host = device + base_ + drift_ * (device - base_device_);
+    return origin_ + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(host));
+}
+
+std::array<DeviceClock::clock::time_point, DeviceClock::SAMPLES_PER_REPORT> DeviceClock::sample_times() const {
+    // The newest sample belongs to the report tick, the others 5 ms apart before it
+    std::array<clock::time_point, SAMPLES_PER_REPORT> times;
+    for (int i = 0; i < SAMPLES_PER_REPORT; ++i) {
+        times[i] = to_host(ticks_ - (SAMPLES_PER_REPORT - 1 - i));
+    }
+    return times;
+}
+
+DeviceClock::clock::duration DeviceClock::offset() const {
+    return to_host(ticks_) - std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(ticks_ * TICK_PERIOD)) - clock::time_point();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// Maps the 8-bit Joy-Con report timer onto the host steady_clock
+// (CLOCK_MONOTONIC on Linux). The timer is unwrapped into a 64-bit tick
+// count, and host time = device time + offset + drift * elapsed, where
+// offset follows the lower envelope of (receive time - device time) and
+// drift is the slope between envelope minima of successive windows. The
+// lower envelope is the least delayed delivery, so Bluetooth jitter and
+// batching mostly drop out. Not thread-safe, JoyCon updates it under its
+// report lock.
+class DeviceClock {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr double TICK_PERIOD = 0.005;
+    static constexpr int SAMPLES_PER_REPORT = 3;
+
+    // Feed the timer of a report and its host receive time. Returns the
+    // host time of the report tick.
+    clock::time_point update(uint8_t timer, clock::time_point received);
+    void reset();
+
+    bool synchronized() const { return seen_; }
+    int64_t ticks() const { return ticks_; }
+    // Host time of an unwrapped device tick
+    clock::time_point to_host(int64_t ticks) const;
+    // Host times of the IMU samples of the last report, oldest first
+    std::array<clock::time_point, SAMPLES_PER_REPORT> sample_times() const;
+
+    // Host time of device tick 0 under the current model (since the clock
+    // epoch), and device clock drift against the host
+    clock::duration offset() const;
+    double drift_ppm() const { return drift_ * 1e6; }
+
+private:
+    clock::time_point origin_{};      // host time of tick 0
+    clock::time_point last_received_{};
+    bool seen_ = false;
+    uint8_t last_timer_ = 0;
+    int64_t ticks_ = 0;
+
+    // Envelope, in seconds relative to origin_
+    double base_ = 0.0;               // offset at base_device_
+    double base_device_ = 0.0;
+    double drift_ = 0.0;
+
+    // Drift window: envelope minimum of the current and of the last window
+    double window_start_ = 0.0;
+    double window_min_ = 0.0;
+    double window_min_device_ = 0.0;
+    bool has_window_min_ = false;
+    double prev_min_ = 0.0;
+    double prev_min_device_ = 0.0;
+    bool has_prev_min_ = false;
+};
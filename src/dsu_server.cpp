@@ -0,0 +1,374 @@
+#ifdef __linux__
+
+#include "dsu_server.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    constexpr uint32_t MSG_PROTOCOL_VERSION = 0x100000;
+    constexpr uint32_t MSG_CONTROLLER_INFO = 0x100001;
+    constexpr uint32_t MSG_PAD_DATA = 0x100002;
+
+    constexpr size_t INFO_SIZE = 32;
+    constexpr size_t VERSION_SIZE = 22;
+
+    constexpr std::array<uint32_t, 256> make_crc32_table() {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }
+    constexpr auto CRC32_TABLE = make_crc32_table();
+
+    uint32_t crc32(const uint8_t* data, size_t size) {
+        uint32_t c = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; ++i) {
+            c = CRC32_TABLE[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+        }
+        return c ^ 0xFFFFFFFFu;
+    }
+
+    // DSU is little endian on the wire
+    void put_u16(uint8_t* p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+    void put_u32(uint8_t* p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = (v >> (8 * i)) & 0xFF; }
+    void put_u64(uint8_t* p, uint64_t v) { for (int i = 0; i < 8; ++i) p[i] = (v >> (8 * i)) & 0xFF; }
+    void put_f32(uint8_t* p, float v) { put_u32(p, std::bit_cast<uint32_t>(v)); }
+    uint16_t get_u16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+    uint32_t get_u32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24); }
+
+    void finalize(uint8_t* packet, size_t size) {
+        put_u32(packet + 8, 0);
+        put_u32(packet + 8, crc32(packet, size));
+    }
+
+    uint8_t battery_state(const JoyCon::Status::Battery& battery) {
+        if (battery.charging) return 0xEE;
+        switch (battery.level) {
+            case 4: return 0x05;
+            case 3: return 0x04;
+            case 2: return 0x02;
+            default: return 0x01;
+        }
+    }
+
+    uint8_t stick_byte(int value, int center) {
+        return static_cast<uint8_t>(std::clamp((value - center) / 16 + 128, 0, 255));
+    }
+}
+
+DsuServer::DsuServer(const DsuServerOptions& options)
+    : options_(options),
+      socket_fd_(-1),
+      port_(0),
+      running_(true),
+      requests_(0),
+      packets_sent_(0),
+      batches_(0),
+      send_errors_(0)
+{
+    socket_fd_ = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (socket_fd_ < 0) {
+        throw std::runtime_error(std::string("DSU socket failed: ") + std::strerror(errno));
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options_.port);
+    if (inet_pton(AF_INET, options_.address.c_str(), &addr.sin_addr) != 1) {
+        ::close(socket_fd_);
+        throw std::invalid_argument("DSU address is invalid");
+    }
+    if (::bind(socket_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        int err = errno;
+        ::close(socket_fd_);
+        throw std::runtime_error(std::string("DSU bind failed: ") + std::strerror(err));
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(socket_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+
+    for (size_t i = 0; i < MAX_SLOTS; ++i) {
+        slots_[i].mac = {0x4A, 0x43, 0x00, 0x00, 0x00, static_cast<uint8_t>(i + 1)};
+    }
+
+    receive_thread_ = std::thread(&DsuServer::receive_loop, this);
+}
+
+DsuServer::~DsuServer() {
+    for (size_t i = 0; i < MAX_SLOTS; ++i) {
+        remove_controller(static_cast<int>(i));
+    }
+    running_ = false;
+    if (receive_thread_.joinable()) {
+        receive_thread_.join();
+    }
+    ::close(socket_fd_);
+}
+
+int DsuServer::add_controller(JoyCon& joycon) {
+    int slot = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < MAX_SLOTS; ++i) {
+            if (!slots_[i].joycon) {
+                slot = static_cast<int>(i);
+                slots_[i].joycon = &joycon;
+                slots_[i].packet_number = 0;
+                break;
+            }
+        }
+    }
+    if (slot < 0) {
+        throw std::runtime_error("No free DSU slot");
+    }
+    slots_[slot].hook_id = joycon.register_update_hook([this, slot](JoyCon& jc) { on_report(slot, jc); });
+    return slot;
+}
+
+void DsuServer::remove_controller(int slot) {
+    if (slot < 0 || slot >= static_cast<int>(MAX_SLOTS)) throw std::out_of_range("slot");
+    JoyCon* joycon;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        joycon = slots_[slot].joycon;
+    }
+    if (!joycon) return;
+    joycon->unregister_update_hook(slots_[slot].hook_id);
+    std::lock_guard<std::mutex> lock(mutex_);
+    slots_[slot].joycon = nullptr;
+}
+
+uint16_t DsuServer::port() const {
+    return port_;
+}
+
+DsuServer::Stats DsuServer::get_stats() const {
+    Stats stats;
+    stats.requests = requests_.load(std::memory_order_relaxed);
+    stats.packets_sent = packets_sent_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.send_errors = send_errors_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void DsuServer::receive_loop() {
+    std::array<uint8_t, 1024> buffer;
+    pollfd pfd{socket_fd_, POLLIN, 0};
+    while (running_) {
+        // Short poll timeout so the destructor can stop the thread
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        sockaddr_in from{};
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(socket_fd_, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr*>(&from), &from_len);
+        if (n <= 0) continue;
+        handle_request(buffer.data(), static_cast<size_t>(n), from);
+    }
+}
+
+void DsuServer::handle_request(const uint8_t* data, size_t size, const sockaddr_in& from) {
+    if (size < HEADER_SIZE + 4 || std::memcmp(data, "DSUC", 4) != 0) return;
+    if (get_u16(data + 4) > PROTOCOL_VERSION) return;
+    // The length covers the message type at least
+    size_t length = get_u16(data + 6);
+    if (length < 4 || HEADER_SIZE + length > size) return;
+
+    std::array<uint8_t, 1024> copy;
+    std::memcpy(copy.data(), data, HEADER_SIZE + length);
+    uint32_t expected_crc = get_u32(copy.data() + 8);
+    put_u32(copy.data() + 8, 0);
+    if (crc32(copy.data(), HEADER_SIZE + length) != expected_crc) return;
+
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    const uint8_t* payload = data + HEADER_SIZE + 4;
+    size_t payload_size = length - 4;
+    uint8_t reply[INFO_SIZE];
+
+    switch (get_u32(data + HEADER_SIZE)) {
+        case MSG_PROTOCOL_VERSION: {
+            write_header(reply, VERSION_SIZE, MSG_PROTOCOL_VERSION);
+            put_u16(reply + 20, PROTOCOL_VERSION);
+            finalize(reply, VERSION_SIZE);
+            send_to(reply, VERSION_SIZE, from);
+            break;
+        }
+        case MSG_CONTROLLER_INFO: {
+            if (payload_size < 4) return;
+            int32_t count = static_cast<int32_t>(get_u32(payload));
+            size_t slots = std::min(static_cast<size_t>(std::max(count, 0)), payload_size - 4);
+            for (size_t i = 0; i < slots; ++i) {
+                uint8_t slot = payload[4 + i];
+                if (slot >= MAX_SLOTS) continue;
+                JoyCon::Status status;
+                bool connected;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    connected = slots_[slot].joycon != nullptr;
+                    if (connected) status = slots_[slot].joycon->get_status();
+                }
+                write_header(reply, INFO_SIZE, MSG_CONTROLLER_INFO);
+                write_controller_info(reply + 20, slot, connected ? &status : nullptr);
+                reply[31] = 0;
+                finalize(reply, INFO_SIZE);
+                send_to(reply, INFO_SIZE, from);
+            }
+            break;
+        }
+        case MSG_PAD_DATA: {
+            if (payload_size < 8) return;
+            Subscriber sub;
+            sub.address = from;
+            sub.flags = payload[0];
+            sub.slot = payload[1];
+            std::copy(payload + 2, payload + 8, sub.mac.begin());
+            sub.last_request = std::chrono::steady_clock::now();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = std::find_if(subscribers_.begin(), subscribers_.end(), [&](const Subscriber& s) {
+                return s.address.sin_addr.s_addr == from.sin_addr.s_addr && s.address.sin_port == from.sin_port
+                    && s.flags == sub.flags && s.slot == sub.slot && s.mac == sub.mac;
+            });
+            if (it != subscribers_.end()) {
+                it->last_request = sub.last_request;
+            } else if (subscribers_.size() < MAX_SUBSCRIBERS) {
+                subscribers_.push_back(sub);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void DsuServer::send_to(const uint8_t* data, size_t size, const sockaddr_in& to) {
+    if (sendto(socket_fd_, data, size, 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) < 0) {
+        send_errors_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        packets_sent_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+size_t DsuServer::write_header(uint8_t* out, size_t packet_size, uint32_t message_type) const {
+    std::memcpy(out, "DSUS", 4);
+    put_u16(out + 4, PROTOCOL_VERSION);
+    put_u16(out + 6, static_cast<uint16_t>(packet_size - HEADER_SIZE));
+    put_u32(out + 8, 0);
+    put_u32(out + 12, options_.server_id);
+    put_u32(out + 16, message_type);
+    return HEADER_SIZE + 4;
+}
+
+size_t DsuServer::write_controller_info(uint8_t* out, int slot, const JoyCon::Status* status) const {
+    out[0] = static_cast<uint8_t>(slot);
+    out[1] = status ? 2 : 0;        // connected / not connected
+    out[2] = status ? 2 : 0;        // full gyro
+    out[3] = status ? 2 : 0;        // bluetooth
+    std::copy(slots_[slot].mac.begin(), slots_[slot].mac.end(), out + 4);
+    out[10] = status ? battery_state(status->battery) : 0;
+    return 11;
+}
+
+void DsuServer::write_pad_data(uint8_t* out, int slot, uint32_t packet_number, const JoyCon::Status& status,
+                               const JoyCon& joycon, const std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE>& report,
+                               int sample_idx, uint64_t timestamp_us) const {
+    const auto& l = status.buttons.left;
+    const auto& r = status.buttons.right;
+    const auto& sticks = status.analog_sticks;
+    int center = options_.stick_center;
+
+    size_t p = write_header(out, PAD_DATA_SIZE, MSG_PAD_DATA);
+    p += write_controller_info(out + p, slot, &status);
+    out[p++] = 1;
+    put_u32(out + p, packet_number);
+    p += 4;
+    out[p++] = (l.minus ? 0x01 : 0) | (sticks.left.pressed ? 0x02 : 0) | (sticks.right.pressed ? 0x04 : 0)
+             | (r.plus ? 0x08 : 0) | (l.up ? 0x10 : 0) | (l.right ? 0x20 : 0) | (l.down ? 0x40 : 0) | (l.left ? 0x80 : 0);
+    out[p++] = (l.zl ? 0x01 : 0) | (r.zr ? 0x02 : 0) | (l.l ? 0x04 : 0) | (r.r ? 0x08 : 0)
+             | (r.x ? 0x10 : 0) | (r.a ? 0x20 : 0) | (r.b ? 0x40 : 0) | (r.y ? 0x80 : 0);
+    out[p++] = r.home ? 1 : 0;
+    out[p++] = l.capture ? 1 : 0;
+    out[p++] = stick_byte(sticks.left.horizontal, center);
+    out[p++] = stick_byte(sticks.left.vertical, center);
+    out[p++] = stick_byte(sticks.right.horizontal, center);
+    out[p++] = stick_byte(sticks.right.vertical, center);
+    // Analog D-pad left/down/right/up, Y/B/A/X, R/L/ZR/ZL
+    for (int pressed : {l.left, l.down, l.right, l.up, r.y, r.b, r.a, r.x, r.r, l.l, r.zr, l.zl}) {
+        out[p++] = pressed ? 0xFF : 0x00;
+    }
+    std::memset(out + p, 0, 12);    // no touch pad
+    p += 12;
+    put_u64(out + p, timestamp_us);
+    p += 8;
+    // Joy-Con IMU axes are forwarded as-is, in g and deg/s
+    put_f32(out + p, joycon.get_accel_x(report, sample_idx) / JoyCon::ACCEL_UNITS_PER_G);
+    put_f32(out + p + 4, joycon.get_accel_y(report, sample_idx) / JoyCon::ACCEL_UNITS_PER_G);
+    put_f32(out + p + 8, joycon.get_accel_z(report, sample_idx) / JoyCon::ACCEL_UNITS_PER_G);
+    put_f32(out + p + 12, (joycon.get_gyro_x(report, sample_idx) - joycon.status_offset_.gyro_x) / JoyCon::GYRO_UNITS_PER_DPS);
+    put_f32(out + p + 16, (joycon.get_gyro_y(report, sample_idx) - joycon.status_offset_.gyro_y) / JoyCon::GYRO_UNITS_PER_DPS);
+    put_f32(out + p + 20, (joycon.get_gyro_z(report, sample_idx) - joycon.status_offset_.gyro_z) / JoyCon::GYRO_UNITS_PER_DPS);
+    finalize(out, PAD_DATA_SIZE);
+}
+
+void DsuServer::on_report(int slot_idx, JoyCon& joycon) {
+    Slot& slot = slots_[slot_idx];
+    size_t target_count = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(), [&](const Subscriber& s) {
+            return now - s.last_request > SUBSCRIPTION_TIMEOUT;
+        }), subscribers_.end());
+        for (const Subscriber& s : subscribers_) {
+            bool match = s.flags == 0
+                || ((s.flags & 1) && s.slot == slot_idx)
+                || ((s.flags & 2) && s.mac == slot.mac);
+            if (match) slot.targets[target_count++] = s.address;
+        }
+    }
+    if (target_count == 0) return;
+
+    auto sample_times = joycon.get_sample_times();
+    auto report = joycon.get_input_report();
+    JoyCon::Status status = joycon.get_status();
+
+    // One packet per IMU sample, stamped with its synchronized host time
+    for (int i = 0; i < 3; ++i) {
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(sample_times[i].time_since_epoch()).count();
+        write_pad_data(slot.packets[i].data(), slot_idx, slot.packet_number++, status, joycon, report, i, us);
+        slot.iovecs[i] = {slot.packets[i].data(), PAD_DATA_SIZE};
+    }
+
+    size_t count = 0;
+    for (int i = 0; i < 3; ++i) {
+        for (size_t t = 0; t < target_count; ++t) {
+            mmsghdr& msg = slot.messages[count++];
+            msg = {};
+            msg.msg_hdr.msg_name = &slot.targets[t];
+            msg.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msg.msg_hdr.msg_iov = &slot.iovecs[i];
+            msg.msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    size_t sent = 0;
+    while (sent < count) {
+        int res = sendmmsg(socket_fd_, slot.messages.data() + sent, static_cast<unsigned>(count - sent), 0);
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        if (res <= 0) {
+            send_errors_.fetch_add(count - sent, std::memory_order_relaxed);
+            break;
+        }
+        sent += static_cast<size_t>(res);
+    }
+    packets_sent_.fetch_add(sent, std::memory_order_relaxed);
+}
+
+#endif
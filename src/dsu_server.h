@@ -0,0 +1,106 @@
+#pragma once
+
+#ifdef __linux__
+
+#include "joycon.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct DsuServerOptions {
+    std::string address = "127.0.0.1";
+    uint16_t port = 26760;          // 0 picks a free port, see DsuServer::port()
+    uint32_t server_id = 0x4A432B2B;
+    // Subtracted from every stick value, set to 0 after JoyCon::status_offset()
+    int stick_center = 2048;
+};
+
+// DSU (cemuhook) motion server. Each registered JoyCon occupies a slot and
+// every report is serialized into three pad data packets (one per IMU
+// sample) in preallocated buffers, then sent to all subscribers of the slot
+// with a single sendmmsg() from the input thread.
+class DsuServer {
+public:
+    static constexpr uint16_t PROTOCOL_VERSION = 1001;
+    static constexpr size_t MAX_SLOTS = 4;
+    static constexpr size_t MAX_SUBSCRIBERS = 16;
+    static constexpr size_t HEADER_SIZE = 16;
+    static constexpr size_t PAD_DATA_SIZE = 100;
+    static constexpr std::chrono::seconds SUBSCRIPTION_TIMEOUT{5};
+
+    explicit DsuServer(const DsuServerOptions& options = {});
+    ~DsuServer();
+
+    DsuServer(const DsuServer&) = delete;
+    DsuServer& operator=(const DsuServer&) = delete;
+
+    // Returns the slot the JoyCon was assigned to
+    int add_controller(JoyCon& joycon);
+    void remove_controller(int slot);
+
+    uint16_t port() const;
+
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t packets_sent = 0;
+        uint64_t batches = 0;
+        uint64_t send_errors = 0;
+    };
+    Stats get_stats() const;
+
+private:
+    struct Subscriber {
+        sockaddr_in address{};
+        uint8_t flags = 0;     // 0 all slots, 1 by slot, 2 by MAC
+        uint8_t slot = 0;
+        std::array<uint8_t, 6> mac{};
+        std::chrono::steady_clock::time_point last_request;
+    };
+
+    struct Slot {
+        JoyCon* joycon = nullptr;
+        size_t hook_id = 0;
+        uint32_t packet_number = 0;
+        std::array<uint8_t, 6> mac{};
+        // Only touched by the input thread of the slot's JoyCon
+        std::array<std::array<uint8_t, PAD_DATA_SIZE>, 3> packets{};
+        std::array<iovec, 3> iovecs{};
+        std::array<sockaddr_in, MAX_SUBSCRIBERS> targets{};
+        std::array<mmsghdr, 3 * MAX_SUBSCRIBERS> messages{};
+    };
+
+    DsuServerOptions options_;
+    int socket_fd_;
+    uint16_t port_;
+    std::atomic<bool> running_;
+    std::thread receive_thread_;
+
+    mutable std::mutex mutex_;
+    std::array<Slot, MAX_SLOTS> slots_;
+    std::vector<Subscriber> subscribers_;
+
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> packets_sent_;
+    std::atomic<uint64_t> batches_;
+    std::atomic<uint64_t> send_errors_;
+
+    void receive_loop();
+    void handle_request(const uint8_t* data, size_t size, const sockaddr_in& from);
+    void send_to(const uint8_t* data, size_t size, const sockaddr_in& to);
+
+    void on_report(int slot, JoyCon& joycon);
+    size_t write_header(uint8_t* out, size_t packet_size, uint32_t message_type) const;
+    size_t write_controller_info(uint8_t* out, int slot, const JoyCon::Status* status) const;
+    void write_pad_data(uint8_t* out, int slot, uint32_t packet_number, const JoyCon::Status& status,
+                        const JoyCon& joycon, const std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE>& report,
+                        int sample_idx, uint64_t timestamp_us) const;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "gyro_bias.h"
+#include <algorithm>
+#include <cmath>
+
+GyroBiasEstimator::GyroBiasEstimator(const GyroBiasOptions& options)
+    : options_(options)
+{
+    reset({0.0f, 0.0f, 0.0f});
+}
+
+void GyroBiasEstimator::reset(const std::array<float, 3>& bias_dps) {
+    gyro_mean_ = {0.0f, 0.0f, 0.0f};
+    gyro_var_ = {0.0f, 0.0f, 0.0f};
+    accel_mean_ = {0.0f, 0.0f, 0.0f};
+    accel_var_ = {0.0f, 0.0f, 0.0f};
+    bias_ = bias_dps;
+    quality_ = {0.0f, 0.0f, 0.0f};
+    still_count_ = 0;
+    primed_ = false;
+}
+
+bool GyroBiasEstimator::add_sample(const std::array<float, 3>& gyro_dps, const std::array<float, 3>& accel_g) {
+    if (!primed_) {
+        gyro_mean_ = gyro_dps;
+        accel_mean_ = accel_g;
+        primed_ = true;
+        return false;
+    }
+
+    // Exponentially weighted mean and variance, O(1) per axis
+    float a = options_.stats_alpha;
+    for (int i = 0; i < 3; ++i) {
+        float dg = gyro_dps[i] - gyro_mean_[i];
+        gyro_mean_[i] += a * dg;
+        gyro_var_[i] = (1.0f - a) * (gyro_var_[i] + a * dg * dg);
+        float da = accel_g[i] - accel_mean_[i];
+        accel_mean_[i] += a * da;
+        accel_var_[i] = (1.0f - a) * (accel_var_[i] + a * da * da);
+    }
+
+    float gyro_threshold_var = options_.gyro_noise_threshold * options_.gyro_noise_threshold;
+    float accel_threshold_var = options_.accel_noise_threshold * options_.accel_noise_threshold;
+    float gravity = std::sqrt(accel_mean_[0] * accel_mean_[0] + accel_mean_[1] * accel_mean_[1] + accel_mean_[2] * accel_mean_[2]);
+    bool still = std::fabs(gravity - 1.0f) < options_.gravity_tolerance;
+    for (int i = 0; i < 3 && still; ++i) {
+        still = gyro_var_[i] < gyro_threshold_var
+             && accel_var_[i] < accel_threshold_var
+             && std::fabs(gyro_mean_[i]) < options_.max_rate;
+    }
+    if (!still) {
+        still_count_ = 0;
+        return false;
+    }
+    if (++still_count_ < options_.stationary_samples) {
+        return false;
+    }
+
+    float b = options_.bias_alpha;
+    for (int i = 0; i < 3; ++i) {
+        bias_[i] += b * (gyro_dps[i] - bias_[i]);
+        float q = 1.0f - std::sqrt(gyro_var_[i]) / options_.gyro_noise_threshold;
+        quality_[i] += b * (std::clamp(q, 0.0f, 1.0f) - quality_[i]);
+    }
+    return true;
+}
+
+std::array<float, 3> GyroBiasEstimator::confidence() const {
+    std::array<float, 3> c;
+    for (int i = 0; i < 3; ++i) {
+        c[i] = std::clamp(quality_[i], 0.0f, 1.0f);
+    }
+    return c;
+}
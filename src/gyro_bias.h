@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+struct GyroBiasOptions {
+    // Per-axis gyro standard deviation (deg/s) below which the device counts as still
+    float gyro_noise_threshold = 0.6f;
+    // Still also means slower than this (deg/s), rejects slow steady rotations
+    float max_rate = 4.0f;
+    // Accel standard deviation (g) and distance of |accel| from 1 g allowed while still
+    float accel_noise_threshold = 0.015f;
+    float gravity_tolerance = 0.08f;
+    // Consecutive still samples (5 ms each) before the bias is updated
+    uint32_t stationary_samples = 200;
+    // EWMA weights of the noise statistics and of the bias update
+    float stats_alpha = 1.0f / 40.0f;
+    float bias_alpha = 1.0f / 400.0f;
+};
+
+// Online gyro bias tracker. Keeps O(1) exponentially weighted mean and
+// variance per axis, detects when the controller is at rest and only then
+// pulls the bias estimate towards the measured rate.
+class GyroBiasEstimator {
+public:
+    explicit GyroBiasEstimator(const GyroBiasOptions& options = {});
+
+    // One IMU sample in deg/s and g. Returns true if the bias was updated.
+    bool add_sample(const std::array<float, 3>& gyro_dps, const std::array<float, 3>& accel_g);
+
+    // Restart from a known bias (deg/s), e.g. a manual snapshot
+    void reset(const std::array<float, 3>& bias_dps);
+
+    const std::array<float, 3>& bias() const { return bias_; }
+    // 0 (unknown) to 1 (converged on quiet stationary data), per axis
+    std::array<float, 3> confidence() const;
+    bool stationary() const { return still_count_ >= options_.stationary_samples; }
+
+private:
+    GyroBiasOptions options_;
+    std::array<float, 3> gyro_mean_;
+    std::array<float, 3> gyro_var_;
+    std::array<float, 3> accel_mean_;
+    std::array<float, 3> accel_var_;
+    std::array<float, 3> bias_;
+    std::array<float, 3> quality_;
+    uint32_t still_count_;
+    bool primed_;
+};
@@ -6,14 +6,63 @@
 #include <thread>
 #include <algorithm>
 #include <mutex>
+#include <cmath>
+#include <optional>
 
-JoyCon::JoyCon(uint16_t vendor_id, uint16_t product_id, const std::wstring& serial, bool simple_mode)
+namespace {
+    // Full-scale selection to LSB size, relative to the 2000 dps / 8 G defaults
+    constexpr float GYRO_RANGE_SCALE[] = {8.75f / 70.0f, 17.5f / 70.0f, 35.0f / 70.0f, 1.0f};
+    constexpr float ACCEL_RANGE_SCALE[] = {1.0f, 0.5f, 0.25f, 2.0f};
+
+    // Stick calibration: three horizontal/vertical pairs of 12-bit values
+    // in 9 bytes. Factory left is above, center, below; right is center,
+    // below, above. User calibration has the same layout after B2 A1.
+    constexpr uint32_t FACTORY_STICK_CAL_ADDRESS = 0x603D;
+    constexpr uint32_t USER_STICK_CAL_ADDRESS = 0x8010;
+    constexpr size_t STICK_CAL_SIZE = 9;
+
+    std::array<std::array<uint16_t, 2>, 3> decode_stick_calibration(const uint8_t* p) {
+        std::array<std::array<uint16_t, 2>, 3> values;
+        for (size_t i = 0; i < 3; ++i, p += 3) {
+            values[i][0] = static_cast<uint16_t>(p[0] | ((p[1] & 0x0F) << 8));
+            values[i][1] = static_cast<uint16_t>((p[1] >> 4) | (p[2] << 4));
+        }
+        return values;
+    }
+}
+
+JoyCon::JoyCon(uint16_t vendor_id, uint16_t product_id, const std::wstring& serial, bool simple_mode,
+               const TransportOptions& transport)
     : vendor_id_(vendor_id),
       product_id_(product_id),
       serial_(serial),
       simple_mode_(simple_mode),
+      hooks_need_imu_(false),
+      hook_calls_(0),
+      hook_skips_(0),
+      next_hook_id_(0),
+      reports_(0),
+      reads_(0),
+      bytes_read_(0),
+      polls_(0),
       packet_number_(0),
       rumble_data_(DEFAULT_RUMBLE_DATA),
+      lamp_pattern_(-1),
+      vibration_(-1),
+      link_state_(LinkState::CONNECTED),
+      link_generation_(0),
+      transport_options_(transport),
+      usb_handshakes_(0),
+      usb_keepalives_(0),
+      gyro_bias_tracking_(false),
+      imu_config_pending_(false),
+      next_reply_id_(0),
+      reader_running_(false),
+      reader_options_(get_default_reader_options()),
+      reader_options_pending_(true),
+      reader_options_applied_(false),
+      reader_exited_(false),
+      spin_budget_(0),
       joycon_device_(nullptr),
       running_(true)
 {
@@ -23,15 +72,42 @@ JoyCon::JoyCon(uint16_t vendor_id, uint16_t product_id, const std::wstring& seri
     if (JOYCON_PRODUCT_IDS.find(product_id) == JOYCON_PRODUCT_IDS.end()) {
         throw std::invalid_argument("product_id is invalid");
     }
+    if (transport.transport == Transport::USB && product_id != PRO_CONTROLLER_PRODUCT_ID && product_id != CHARGING_GRIP_PRODUCT_ID) {
+        throw std::invalid_argument("USB needs the charging grip or a Pro Controller");
+    }
+    if (transport.keepalive_interval.count() < 0) {
+        throw std::invalid_argument("keepalive_interval is negative");
+    }
 
     set_accel_calibration({0, 0, 0}, {1, 1, 1});
     set_gyro_calibration({0, 0, 0}, {1, 1, 1});
 
     joycon_device_ = open(vendor_id, product_id, serial);
-    read_joycon_data();
-    setup_sensors();
+    try {
+        if (transport.transport == Transport::USB) {
+            usb_handshake();
+        }
+        read_device_type();
+        read_joycon_data();
+        setup_sensors();
+    } catch (...) {
+        close();
+        throw;
+    }
 
+    {
+        std::lock_guard<std::mutex> lock(reply_mutex_);
+        reader_running_ = true;
+    }
     update_input_report_thread_ = std::thread(&JoyCon::update_input_report, this);
+    try {
+        wait_reader_options();
+    } catch (...) {
+        running_ = false;
+        update_input_report_thread_.join();
+        close();
+        throw;
+    }
 }
 
 JoyCon::~JoyCon() {
@@ -56,6 +132,13 @@ hid_device* JoyCon::open(uint16_t vendor_id, uint16_t product_id, const std::wst
 }
 
 void JoyCon::close() {
+    if (joycon_device_ && transport_options_.transport == Transport::USB) {
+        // Hand the controller back to Bluetooth once unplugged
+        try {
+            write_usb_command(output_report::UsbCommand::ENABLE_TIMEOUT);
+        } catch (const std::runtime_error&) {
+        }
+    }
     if (joycon_device_) {
         hid_close(joycon_device_);
         joycon_device_ = nullptr;
@@ -64,68 +147,641 @@ void JoyCon::close() {
 
 std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE> JoyCon::read_input_report() const {
     std::array<uint8_t, INPUT_REPORT_SIZE> buf{};
-    int res = hid_read(joycon_device_, buf.data(), INPUT_REPORT_SIZE);
+    while (read_input_report(buf, -1) == 0) {
+    }
+    return buf;
+}
+
+size_t JoyCon::read_input_report(std::array<uint8_t, INPUT_REPORT_SIZE>& buf, int timeout_ms) const {
+    return read_input_report(buf.data(), buf.size(), timeout_ms);
+}
+
+size_t JoyCon::read_input_report(uint8_t* buf, size_t size, int timeout_ms) const {
+    int res = hid_read_timeout(joycon_device_, buf, size, timeout_ms);
     if (res < 0) {
         throw std::runtime_error("Failed to read input report");
     }
-    return buf;
+    if (res > 0) {
+        reads_.fetch_add(1, std::memory_order_relaxed);
+        bytes_read_.fetch_add(res, std::memory_order_relaxed);
+    }
+    return static_cast<size_t>(res);
 }
 
-void JoyCon::write_output_report(const std::vector<uint8_t>& command) {
-    int res = hid_write(joycon_device_, command.data(), command.size());
+void JoyCon::write_output_report(output_report::Report report) {
+    // Packet number and rumble are stamped here so callers on any thread
+    // share one sequence
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    report.data[1] = packet_number_;
+    std::copy(rumble_data_.begin(), rumble_data_.end(), report.data.begin() + 2);
+    if (!joycon_device_) {
+        throw std::runtime_error("Joy-Con is not connected");
+    }
+    packet_number_ = (packet_number_ + 1) & 0xF;
+    int res;
+    if (transport_options_.transport == Transport::USB) {
+        std::array<uint8_t, USB_REPORT_SIZE> frame{};
+        std::copy_n(report.data.begin(), report.size, frame.begin());
+        res = hid_write(joycon_device_, frame.data(), frame.size());
+    } else {
+        res = hid_write(joycon_device_, report.data.data(), report.size);
+    }
     if (res < 0) {
         throw std::runtime_error("Failed to write output report");
     }
 }
 
-std::pair<bool, std::vector<uint8_t>> JoyCon::send_subcmd_get_response(uint8_t subcommand, const std::vector<uint8_t>& argument) {
-    std::vector<uint8_t> cmd = {0x01, packet_number_};
-    cmd.insert(cmd.end(), rumble_data_.begin(), rumble_data_.end());
-    cmd.push_back(subcommand);
-    cmd.insert(cmd.end(), argument.begin(), argument.end());
-    write_output_report(cmd);
-    packet_number_ = (packet_number_ + 1) & 0xF;
+void JoyCon::write_usb_command(output_report::UsbCommand command) {
+    auto report = output_report::build_usb_command(command);
+    std::array<uint8_t, USB_REPORT_SIZE> frame{};
+    std::copy_n(report.data.begin(), report.size, frame.begin());
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    if (!joycon_device_) {
+        throw std::runtime_error("Joy-Con is not connected");
+    }
+    if (hid_write(joycon_device_, frame.data(), frame.size()) < 0) {
+        throw std::runtime_error("Failed to write USB command");
+    }
+}
 
-    std::array<uint8_t, INPUT_REPORT_SIZE> report = read_input_report();
-    while (report[0] != 0x21) {
-        report = read_input_report();
+void JoyCon::wait_usb_reply(output_report::UsbCommand command) {
+    // Only called before the input thread reads or from it, input reports
+    // arriving in between are dropped
+    std::array<uint8_t, USB_REPORT_SIZE> reply{};
+    auto deadline = std::chrono::steady_clock::now() + SUBCOMMAND_TIMEOUT;
+    while (std::chrono::steady_clock::now() < deadline) {
+        size_t size = read_input_report(reply.data(), reply.size(), READ_TIMEOUT_MS);
+        if (size >= 2 && reply[0] == output_report::USB_REPLY && reply[1] == static_cast<uint8_t>(command)) {
+            return;
+        }
     }
-    if (report[1] == subcommand) {
-        throw std::runtime_error("THREAD carefully");
+    throw std::runtime_error("USB handshake timed out");
+}
+
+void JoyCon::usb_handshake() {
+    // Handshake, UART to 3 Mbit, handshake again at the new rate, then
+    // HID only without the USB timeout; input reports start after that
+    using output_report::UsbCommand;
+    for (UsbCommand command : {UsbCommand::HANDSHAKE, UsbCommand::BAUDRATE_3M, UsbCommand::HANDSHAKE}) {
+        write_usb_command(command);
+        wait_usb_reply(command);
     }
+    write_usb_command(UsbCommand::NO_TIMEOUT);
+    usb_handshakes_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::pair<bool, std::vector<uint8_t>> JoyCon::send_subcmd_get_response(const output_report::Report& request) {
+    auto report = send_subcmd_get_reply(request);
     bool ack = (report[13] & 0x80) != 0;
     std::vector<uint8_t> data(report.begin() + 13, report.end());
     return {ack, data};
 }
 
+std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE> JoyCon::send_subcmd_get_reply(const output_report::Report& request) {
+    uint8_t subcommand = request.subcommand();
+    std::array<uint8_t, INPUT_REPORT_SIZE> report;
+
+    if (is_input_thread()) {
+        // The reply would be handed over by this very thread
+        throw std::logic_error("Blocking subcommand on the input thread, use send_subcmd_async");
+    }
+    std::lock_guard<std::mutex> transaction(subcmd_mutex_);
+    if (update_input_report_thread_.joinable()) {
+        // The input thread owns hid_read, it hands the 0x21 reply over
+        struct {
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool done = false;
+            bool replied = false;
+        } waiter;
+        auto deadline = std::chrono::steady_clock::now() + SUBCOMMAND_TIMEOUT;
+        uint64_t id = send_subcmd_async(request, [&](const std::array<uint8_t, INPUT_REPORT_SIZE>* reply) {
+            std::lock_guard<std::mutex> lock(waiter.mutex);
+            if (reply) {
+                report = *reply;
+                waiter.replied = true;
+            }
+            waiter.done = true;
+            waiter.cv.notify_all();
+        });
+        std::unique_lock<std::mutex> lock(waiter.mutex);
+        // The input thread expires the request at the deadline; if it is
+        // held up, the request is withdrawn here so the callback, which
+        // points into this frame, can no longer run
+        if (!waiter.cv.wait_until(lock, deadline, [&] { return waiter.done; })) {
+            lock.unlock();
+            if (cancel_pending_reply(id)) {
+                throw std::runtime_error("Subcommand reply timed out");
+            }
+            // Taken by the input thread just now, its callback is running
+            lock.lock();
+            waiter.cv.wait(lock, [&] { return waiter.done; });
+        }
+        if (!waiter.replied) {
+            throw std::runtime_error("Subcommand reply timed out");
+        }
+    } else {
+        write_output_report(request);
+        report = read_input_report();
+        while (report[0] != 0x21 || report[14] != subcommand) {
+            report = read_input_report();
+        }
+    }
+    return report;
+}
+
+void JoyCon::send_output_report(const output_report::Report& report) {
+    write_output_report(report);
+}
+
+void JoyCon::set_mcu_handler(std::function<void(const uint8_t*, size_t)> handler) {
+    std::lock_guard<std::mutex> lock(hooks_mutex_);
+    if (handler && mcu_handler_) {
+        throw std::logic_error("JoyCon already has an MCU handler");
+    }
+    mcu_handler_ = std::move(handler);
+}
+
 std::vector<uint8_t> JoyCon::spi_flash_read(uint32_t address, uint8_t size) {
+    using output_report::SpiFlashRead;
     if (size > 0x1d) throw std::invalid_argument("size too large for SPI read");
-    std::vector<uint8_t> argument;
-    for (int i = 0; i < 4; ++i) argument.push_back((address >> (8 * i)) & 0xFF);
-    argument.push_back(size);
-    auto [ack, report] = send_subcmd_get_response(0x10, argument);
-    if (!ack) throw std::runtime_error("After SPI read: got NACK");
-    if (!(report[0] == 0x90 && report[1] == 0x10)) throw std::runtime_error("Unexpected ACK in SPI read");
-    if (!std::equal(argument.begin(), argument.end(), report.begin() + 2)) throw std::runtime_error("SPI argument mismatch");
-    return std::vector<uint8_t>(report.begin() + 7, report.begin() + 7 + size);
+    auto request = build_subcommand(SpiFlashRead{address, size});
+    auto reply = send_subcmd_get_reply(request);
+    if (!(reply[SpiFlashRead::REPLY_ACK] & 0x80)) throw std::runtime_error("After SPI read: got NACK");
+    if (!SpiFlashRead::verify_reply(request, reply)) throw std::runtime_error("SPI read reply did not verify");
+    return std::vector<uint8_t>(reply.begin() + SpiFlashRead::REPLY_DATA, reply.begin() + SpiFlashRead::REPLY_DATA + size);
 }
 
 void JoyCon::update_input_report() {
+    // Reads land in a buffer sized for MCU reports, the standard part is
+    // copied out, MCU data is handed on in place
+    std::array<uint8_t, MCU_REPORT_SIZE> buffer{};
+    std::array<uint8_t, INPUT_REPORT_SIZE> report{};
+    auto last_read = std::chrono::steady_clock::time_point();
+    auto last_expiry = std::chrono::steady_clock::now();
+    // Set by a reconnect until its first report arrives
+    auto loss_time = std::chrono::steady_clock::time_point();
+    auto reopen_time = std::chrono::steady_clock::time_point();
+    bool keepalive = transport_options_.transport == Transport::USB && transport_options_.keepalive_interval.count() > 0;
+    auto last_keepalive = std::chrono::steady_clock::now();
     while (running_) {
-        std::array<uint8_t, INPUT_REPORT_SIZE> report = read_input_report();
-        while (report[0] != 0x30) {
-            report = read_input_report();
+        if (reader_options_pending_) {
+            apply_pending_reader_options();
+        }
+        if (auto now = std::chrono::steady_clock::now(); now - last_expiry >= REPLY_EXPIRY_INTERVAL) {
+            expire_pending_replies(now);
+            last_expiry = now;
+        }
+        if (keepalive && std::chrono::steady_clock::now() - last_keepalive >= transport_options_.keepalive_interval) {
+            // A failed write shows up as a failed read right after
+            try {
+                write_usb_command(output_report::UsbCommand::NO_TIMEOUT);
+                usb_keepalives_.fetch_add(1, std::memory_order_relaxed);
+            } catch (const std::runtime_error&) {
+            }
+            last_keepalive = std::chrono::steady_clock::now();
+        }
+        // Busy-poll for spin_budget_ after each report, then a bounded wait
+        // so running_ is noticed even when the controller only reports on
+        // change (simple mode)
+        bool spin = spin_budget_.count() > 0 && std::chrono::steady_clock::now() - last_read < spin_budget_;
+        size_t size = 0;
+        try {
+            size = read_input_report(buffer.data(), buffer.size(), spin ? 0 : READ_TIMEOUT_MS);
+        } catch (const std::runtime_error&) {
+            loss_time = std::chrono::steady_clock::now();
+            if (!reconnect(reopen_time)) {
+                break;
+            }
+            last_read = std::chrono::steady_clock::time_point();
+            continue;
+        }
+        if (size == 0) {
+            if (spin) polls_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        std::copy_n(buffer.begin(), INPUT_REPORT_SIZE, report.begin());
+        auto now = std::chrono::steady_clock::now();
+        last_read = now;
+        bool simple = simple_mode_ && report[0] == 0x3F;
+        if (simple) {
+            report = simple_report_to_standard(report, is_left());
+            // No device timer in 0x3F reports, derive one from the host clock
+            auto ticks = std::chrono::duration<double>(now.time_since_epoch()).count() / TIMER_TICK_PERIOD;
+            report[1] = static_cast<uint8_t>(static_cast<uint64_t>(ticks) & 0xFF);
+        } else if (report[0] == 0x21) {
+            handle_subcommand_reply(report);
+            continue;
+        } else if (report[0] != 0x30 && report[0] != 0x31) {
+            continue;
         }
         {
             std::lock_guard<std::mutex> lock(report_mutex_);
+            if (simple) {
+                // Battery is not part of 0x3F reports, keep the last known one
+                report[2] = input_report_[2];
+            }
             input_report_ = report;
+            input_report_time_ = now;
+            device_time_ = device_clock_.update(report[1], now);
+            if (!simple) {
+                record_timing(now);
+            }
+            if (gyro_bias_tracking_ && !simple) {
+                track_gyro_bias(report);
+            }
+        }
+        reports_.fetch_add(1, std::memory_order_relaxed);
+        if (reopen_time != std::chrono::steady_clock::time_point()) {
+            std::lock_guard<std::mutex> lock(link_mutex_);
+            reconnect_stats_.last_downtime = std::chrono::duration_cast<std::chrono::microseconds>(now - loss_time);
+            reconnect_stats_.last_reconnect_to_report = std::chrono::duration_cast<std::chrono::microseconds>(now - reopen_time);
+            reopen_time = std::chrono::steady_clock::time_point();
         }
-        for (auto& cb : input_hooks_) {
-            cb(*this);
+        std::lock_guard<std::mutex> lock(hooks_mutex_);
+        if (report[0] == 0x31 && mcu_handler_ && size > INPUT_REPORT_SIZE) {
+            mcu_handler_(buffer.data() + INPUT_REPORT_SIZE, size - INPUT_REPORT_SIZE);
         }
+        run_update_hooks(report);
         // Optionally sleep for a polling interval
         // std::this_thread::sleep_for(std::chrono::duration<double>(INPUT_REPORT_PERIOD));
     }
+    // Nobody will hand replies over anymore: refuse new requests, then
+    // fail whatever is still waiting
+    {
+        std::lock_guard<std::mutex> lock(reply_mutex_);
+        reader_running_ = false;
+    }
+    expire_pending_replies(std::chrono::steady_clock::time_point::max());
+    std::lock_guard<std::mutex> lock(reader_options_mutex_);
+    reader_exited_ = true;
+    reader_options_cv_.notify_all();
+}
+
+bool JoyCon::reconnect(std::chrono::steady_clock::time_point& reopened) {
+    {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        if (joycon_device_) {
+            hid_close(joycon_device_);
+            joycon_device_ = nullptr;
+        }
+    }
+    // Replies to requests sent on the lost link will never come
+    expire_pending_replies(std::chrono::steady_clock::time_point::max());
+
+    ReconnectOptions options = get_reconnect_options();
+    {
+        std::lock_guard<std::mutex> lock(link_mutex_);
+        reconnect_stats_.link_losses++;
+    }
+    if (!options.enabled) {
+        notify_link_hooks(LinkState::FAILED);
+        return false;
+    }
+    notify_link_hooks(LinkState::RECONNECTING);
+
+    auto backoff = options.initial_backoff;
+    for (int attempt = 1; running_; ++attempt) {
+        // Sleep in short slices so the destructor is not held up
+        auto until = std::chrono::steady_clock::now() + backoff;
+        while (running_ && std::chrono::steady_clock::now() < until) {
+            if (reader_options_pending_) {
+                apply_pending_reader_options();
+            }
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(until - std::chrono::steady_clock::now(), std::chrono::milliseconds(READ_TIMEOUT_MS)));
+        }
+        if (!running_) {
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(link_mutex_);
+            reconnect_stats_.attempts++;
+        }
+        try {
+            hid_device* device = open(vendor_id_, product_id_, serial_);
+            reopened = std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> lock(output_mutex_);
+                joycon_device_ = device;
+            }
+            if (transport_options_.transport == Transport::USB) {
+                usb_handshake();
+            }
+            replay_device_state();
+            {
+                std::lock_guard<std::mutex> lock(report_mutex_);
+                device_clock_.reset();
+                // The gap across the reconnect is not a report interval
+                last_timed_report_ = std::chrono::steady_clock::time_point();
+            }
+            {
+                std::lock_guard<std::mutex> lock(link_mutex_);
+                reconnect_stats_.reconnects++;
+            }
+            link_generation_.fetch_add(1);
+            notify_link_hooks(LinkState::CONNECTED);
+            return true;
+        } catch (const std::runtime_error&) {
+            std::lock_guard<std::mutex> lock(output_mutex_);
+            if (joycon_device_) {
+                hid_close(joycon_device_);
+                joycon_device_ = nullptr;
+            }
+        }
+        if (options.max_attempts > 0 && attempt >= options.max_attempts) {
+            notify_link_hooks(LinkState::FAILED);
+            return false;
+        }
+        backoff = std::min(backoff * 2, options.max_backoff);
+    }
+    return false;
+}
+
+void JoyCon::replay_device_state() {
+    // Calibration lives on the host and survives the reconnect, only what
+    // the controller forgot is sent again. Replies are not waited for, the
+    // input thread that would receive them is the caller.
+    setup_sensors();
+    int lamp_pattern, vibration;
+    {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        lamp_pattern = lamp_pattern_;
+        vibration = vibration_;
+    }
+    ImuConfig config = get_imu_config();
+    if (!simple_mode_ && !(config == ImuConfig{})) {
+        output_report::ImuConfig command;
+        command.gyro_sensitivity = static_cast<uint8_t>(config.gyro_sensitivity);
+        command.accel_sensitivity = static_cast<uint8_t>(config.accel_sensitivity);
+        command.gyro_performance = static_cast<uint8_t>(config.gyro_performance);
+        command.accel_filter = static_cast<uint8_t>(config.accel_filter);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        write_output_report(build_subcommand(command));
+    }
+    if (vibration >= 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        write_output_report(build_subcommand(output_report::EnableVibration{vibration != 0}));
+    }
+    if (lamp_pattern >= 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        write_output_report(build_subcommand(output_report::SetPlayerLights{static_cast<uint8_t>(lamp_pattern)}));
+    }
+}
+
+void JoyCon::notify_link_hooks(LinkState state) {
+    link_state_ = state;
+    LinkEvent event{state, link_generation_.load(), std::chrono::steady_clock::now()};
+    std::lock_guard<std::mutex> lock(hooks_mutex_);
+    for (auto& [id, cb] : link_hooks_) {
+        cb(*this, event);
+    }
+}
+
+size_t JoyCon::register_link_hook(std::function<void(JoyCon&, const LinkEvent&)> callback) {
+    std::lock_guard<std::mutex> lock(hooks_mutex_);
+    size_t id = next_hook_id_++;
+    link_hooks_.emplace_back(id, std::move(callback));
+    return id;
+}
+
+void JoyCon::unregister_link_hook(size_t hook_id) {
+    std::lock_guard<std::mutex> lock(hooks_mutex_);
+    link_hooks_.erase(std::remove_if(link_hooks_.begin(), link_hooks_.end(),
+        [hook_id](const auto& hook) { return hook.first == hook_id; }), link_hooks_.end());
+}
+
+JoyCon::LinkState JoyCon::get_link_state() const {
+    return link_state_.load();
+}
+
+uint64_t JoyCon::get_link_generation() const {
+    return link_generation_.load();
+}
+
+void JoyCon::set_reconnect_options(const ReconnectOptions& options) {
+    if (options.initial_backoff.count() <= 0 || options.max_backoff < options.initial_backoff) {
+        throw std::invalid_argument("invalid reconnect backoff");
+    }
+    std::lock_guard<std::mutex> lock(link_mutex_);
+    reconnect_options_ = options;
+}
+
+ReconnectOptions JoyCon::get_reconnect_options() const {
+    std::lock_guard<std::mutex> lock(link_mutex_);
+    return reconnect_options_;
+}
+
+JoyCon::ReconnectStats JoyCon::get_reconnect_stats() const {
+    std::lock_guard<std::mutex> lock(link_mutex_);
+    return reconnect_stats_;
+}
+
+Transport JoyCon::get_transport() const {
+    return transport_options_.transport;
+}
+
+void JoyCon::record_timing(std::chrono::steady_clock::time_point received) {
+    // Called under report_mutex_ after device_time_ was updated
+    if (last_timed_report_ != std::chrono::steady_clock::time_point()) {
+        double interval = std::chrono::duration<double>(received - last_timed_report_).count();
+        double delay = std::chrono::duration<double>(received - device_time_).count();
+        TimingSums& t = timing_;
+        t.count++;
+        double d = interval - t.interval_mean;
+        t.interval_mean += d / t.count;
+        t.interval_m2 += d * (interval - t.interval_mean);
+        t.interval_max = std::max(t.interval_max, interval);
+        d = delay - t.delay_mean;
+        t.delay_mean += d / t.count;
+        t.delay_m2 += d * (delay - t.delay_mean);
+    }
+    last_timed_report_ = received;
+}
+
+JoyCon::TransportStats JoyCon::get_transport_stats() const {
+    auto us = [](double seconds) {
+        return std::chrono::microseconds(static_cast<int64_t>(std::llround(seconds * 1e6)));
+    };
+    TransportStats stats;
+    stats.transport = transport_options_.transport;
+    stats.handshakes = usb_handshakes_.load(std::memory_order_relaxed);
+    stats.keepalives = usb_keepalives_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    const TimingSums& t = timing_;
+    stats.samples = t.count;
+    if (t.count > 0) {
+        stats.mean_interval = us(t.interval_mean);
+        stats.interval_jitter = us(std::sqrt(t.interval_m2 / t.count));
+        stats.max_interval = us(t.interval_max);
+        stats.mean_delay = us(t.delay_mean);
+        stats.delay_jitter = us(std::sqrt(t.delay_m2 / t.count));
+    }
+    return stats;
+}
+
+void JoyCon::reset_transport_stats() {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    timing_ = TimingSums{};
+    last_timed_report_ = std::chrono::steady_clock::time_point();
+}
+
+void JoyCon::handle_subcommand_reply(const std::array<uint8_t, INPUT_REPORT_SIZE>& report) {
+    bool ack = (report[13] & 0x80) != 0;
+    if (report[14] == output_report::ImuConfig::ID && ack) {
+        // Switch the coefficients on the input thread, before the next
+        // report decoded with the new ranges reaches the hooks
+        std::lock_guard<std::mutex> lock(report_mutex_);
+        if (imu_config_pending_) {
+            imu_config_ = pending_imu_config_;
+            imu_config_pending_ = false;
+            update_imu_coefficients();
+        }
+    }
+    ReplyCallback done;
+    {
+        std::lock_guard<std::mutex> lock(reply_mutex_);
+        uint32_t address = report[15] | (report[16] << 8) | (report[17] << 16) | (static_cast<uint32_t>(report[18]) << 24);
+        auto it = std::find_if(pending_replies_.begin(), pending_replies_.end(), [&](const PendingReply& pending) {
+            return pending.subcommand == report[14] && (!pending.match_address || pending.address == address);
+        });
+        if (it == pending_replies_.end()) {
+            return;
+        }
+        done = std::move(it->done);
+        pending_replies_.erase(it);
+    }
+    done(&report);
+}
+
+uint64_t JoyCon::send_subcmd_async(const output_report::Report& request, ReplyCallback done, std::chrono::milliseconds timeout) {
+    PendingReply pending;
+    pending.subcommand = request.subcommand();
+    // SPI replies echo the address, which tells apart requests in flight
+    pending.match_address = pending.subcommand == output_report::SpiFlashRead::ID;
+    pending.address = request.data[11] | (request.data[12] << 8) | (request.data[13] << 16) | (static_cast<uint32_t>(request.data[14]) << 24);
+    pending.deadline = std::chrono::steady_clock::now() + timeout;
+    pending.done = std::move(done);
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(reply_mutex_);
+        if (!reader_running_) {
+            throw std::runtime_error("Joy-Con input thread has stopped");
+        }
+        id = pending.id = next_reply_id_++;
+        pending_replies_.push_back(std::move(pending));
+    }
+    try {
+        write_output_report(request);
+    } catch (...) {
+        // Other threads may have queued requests meanwhile. If the input
+        // thread already expired this one, its callback reported it.
+        if (cancel_pending_reply(id)) {
+            throw;
+        }
+    }
+    return id;
+}
+
+bool JoyCon::cancel_pending_reply(uint64_t id) {
+    std::lock_guard<std::mutex> lock(reply_mutex_);
+    auto it = std::find_if(pending_replies_.begin(), pending_replies_.end(),
+                           [id](const PendingReply& pending) { return pending.id == id; });
+    if (it == pending_replies_.end()) {
+        return false;
+    }
+    pending_replies_.erase(it);
+    return true;
+}
+
+void JoyCon::expire_pending_replies(std::chrono::steady_clock::time_point now) {
+    std::vector<ReplyCallback> expired;
+    {
+        std::lock_guard<std::mutex> lock(reply_mutex_);
+        auto it = std::stable_partition(pending_replies_.begin(), pending_replies_.end(),
+            [now](const PendingReply& pending) { return pending.deadline > now; });
+        for (auto e = it; e != pending_replies_.end(); ++e) {
+            expired.push_back(std::move(e->done));
+        }
+        pending_replies_.erase(it, pending_replies_.end());
+    }
+    for (auto& done : expired) {
+        done(nullptr);
+    }
+}
+
+void JoyCon::set_imu_config(const ImuConfig& config) {
+    if (simple_mode_) throw std::logic_error("IMU is off in simple mode");
+    output_report::ImuConfig command;
+    command.gyro_sensitivity = static_cast<uint8_t>(config.gyro_sensitivity);
+    command.accel_sensitivity = static_cast<uint8_t>(config.accel_sensitivity);
+    command.gyro_performance = static_cast<uint8_t>(config.gyro_performance);
+    command.accel_filter = static_cast<uint8_t>(config.accel_filter);
+    {
+        std::lock_guard<std::mutex> lock(report_mutex_);
+        pending_imu_config_ = config;
+        imu_config_pending_ = true;
+    }
+    std::pair<bool, std::vector<uint8_t>> result;
+    try {
+        result = send_subcmd_get_response(build_subcommand(command));
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(report_mutex_);
+        imu_config_pending_ = false;
+        throw;
+    }
+    bool ack = result.first;
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    if (!ack) {
+        imu_config_pending_ = false;
+        throw std::runtime_error("IMU config: got NACK");
+    }
+    if (imu_config_pending_) {
+        // Reply read before the input thread started
+        imu_config_ = pending_imu_config_;
+        imu_config_pending_ = false;
+        update_imu_coefficients();
+    }
+}
+
+JoyCon::ImuConfig JoyCon::get_imu_config() const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    return imu_config_;
+}
+
+void JoyCon::update_imu_coefficients() {
+    // Raw counts at the selected range are brought back to default-range
+    // units, so the getters keep the same scale whatever the sensitivity
+    float gyro_scale = GYRO_RANGE_SCALE[static_cast<int>(imu_config_.gyro_sensitivity) & 3];
+    float accel_scale = ACCEL_RANGE_SCALE[static_cast<int>(imu_config_.accel_sensitivity) & 3];
+    GYRO_OFFSET_X_ = gyro_cal_offset_[0] / gyro_scale;
+    GYRO_OFFSET_Y_ = gyro_cal_offset_[1] / gyro_scale;
+    GYRO_OFFSET_Z_ = gyro_cal_offset_[2] / gyro_scale;
+    GYRO_COEFF_X_ = gyro_cal_coeff_[0] * gyro_scale;
+    GYRO_COEFF_Y_ = gyro_cal_coeff_[1] * gyro_scale;
+    GYRO_COEFF_Z_ = gyro_cal_coeff_[2] * gyro_scale;
+    ACCEL_OFFSET_X_ = accel_cal_offset_[0] / accel_scale;
+    ACCEL_OFFSET_Y_ = accel_cal_offset_[1] / accel_scale;
+    ACCEL_OFFSET_Z_ = accel_cal_offset_[2] / accel_scale;
+    ACCEL_COEFF_X_ = accel_cal_coeff_[0] * accel_scale;
+    ACCEL_COEFF_Y_ = accel_cal_coeff_[1] * accel_scale;
+    ACCEL_COEFF_Z_ = accel_cal_coeff_[2] * accel_scale;
+}
+
+void JoyCon::read_device_type() {
+    if (product_id_ == JOYCON_L_PRODUCT_ID) {
+        type = LEFT;
+    } else if (product_id_ == JOYCON_R_PRODUCT_ID) {
+        type = RIGHT;
+    } else if (product_id_ == CHARGING_GRIP_PRODUCT_ID) {
+        // Either Joy-Con may sit in the grip, the device info tells which
+        // (reply[4]: 1 L, 2 R)
+        auto [ack, reply] = send_subcmd_get_response(build_subcommand(output_report::RequestDeviceInfo{}));
+        if (!ack || reply.size() < 5) throw std::runtime_error("Device info request failed");
+        type = reply[4] == 1 ? LEFT : reply[4] == 2 ? RIGHT : UNKNOWN;
+    } else {
+        // Pro Controller: both halves, neither side
+        type = UNKNOWN;
+    }
 }
 
 void JoyCon::read_joycon_data() {
@@ -138,6 +794,28 @@ void JoyCon::read_joycon_data() {
         imu_cal = spi_flash_read(0x6020, 24);
     }
 
+    // Left then right, each user calibration behind its own magic
+    auto factory_sticks = spi_flash_read(FACTORY_STICK_CAL_ADDRESS, 2 * STICK_CAL_SIZE);
+    auto user_sticks = spi_flash_read(USER_STICK_CAL_ADDRESS, 2 * (2 + STICK_CAL_SIZE));
+    std::array<StickCalibration, 2> sticks;
+    for (size_t side = 0; side < 2; ++side) {
+        if ((side == 0 && type == RIGHT) || (side == 1 && type == LEFT)) {
+            continue;
+        }
+        const uint8_t* user = user_sticks.data() + side * (2 + STICK_CAL_SIZE);
+        bool has_user = user[0] == 0xB2 && user[1] == 0xA1;
+        auto values = decode_stick_calibration(has_user ? user + 2 : factory_sticks.data() + side * STICK_CAL_SIZE);
+        if (side == 0) {
+            sticks[side].above = values[0];
+            sticks[side].center = values[1];
+            sticks[side].below = values[2];
+        } else {
+            sticks[side].center = values[0];
+            sticks[side].below = values[1];
+            sticks[side].above = values[2];
+        }
+    }
+
     color_body_ = {color_data[0], color_data[1], color_data[2]};
     color_btn_  = {color_data[3], color_data[4], color_data[5]};
 
@@ -149,6 +827,10 @@ void JoyCon::read_joycon_data() {
          to_int16le_from_2bytes(imu_cal[8], imu_cal[9]),
          to_int16le_from_2bytes(imu_cal[10], imu_cal[11])}
     );
+    {
+        std::lock_guard<std::mutex> lock(report_mutex_);
+        stick_calibration_ = sticks;
+    }
     set_gyro_calibration(
         {to_int16le_from_2bytes(imu_cal[12], imu_cal[13]),
          to_int16le_from_2bytes(imu_cal[14], imu_cal[15]),
@@ -160,11 +842,120 @@ void JoyCon::read_joycon_data() {
 }
 
 void JoyCon::setup_sensors() {
-    write_output_report({0x01, packet_number_, rumble_data_[0], rumble_data_[1], rumble_data_[2], rumble_data_[3], rumble_data_[4], rumble_data_[5], rumble_data_[6], rumble_data_[7], 0x40, 0x01});
-    packet_number_ = (packet_number_ + 1) & 0xF;
+    if (simple_mode_) {
+        // Buttons and stick direction only, sent on change, IMU powered down
+        write_output_report(build_subcommand(output_report::EnableImu{false}));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        write_output_report(build_subcommand(output_report::SetReportMode{output_report::ReportMode::SIMPLE_HID}));
+        return;
+    }
+    write_output_report(build_subcommand(output_report::EnableImu{true}));
     std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    write_output_report({0x01, packet_number_, rumble_data_[0], rumble_data_[1], rumble_data_[2], rumble_data_[3], rumble_data_[4], rumble_data_[5], rumble_data_[6], rumble_data_[7], 0x03, 0x30});
-    packet_number_ = (packet_number_ + 1) & 0xF;
+    write_output_report(build_subcommand(output_report::SetReportMode{output_report::ReportMode::STANDARD_FULL}));
+}
+
+std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE> JoyCon::simple_report_to_standard(const std::array<uint8_t, INPUT_REPORT_SIZE>& simple, bool left) {
+    // 0x3F layout: [1] direction buttons (Down/A, Right/X, Left/B, Up/Y, SL, SR),
+    // [2] Minus, Plus, L stick, R stick, Home, Capture, L/R, ZL/ZR, [3] stick hat
+    std::array<uint8_t, INPUT_REPORT_SIZE> report{};
+    report[0] = 0x3F;
+    uint8_t b1 = simple[1];
+    uint8_t b2 = simple[2];
+    uint8_t side = ((b1 & 0x20) ? 0x10 : 0) | ((b1 & 0x10) ? 0x20 : 0) | ((b2 & 0x40) ? 0x40 : 0) | ((b2 & 0x80) ? 0x80 : 0);
+    if (left) {
+        report[5] = side | ((b1 & 0x01) ? 0x01 : 0) | ((b1 & 0x08) ? 0x02 : 0) | ((b1 & 0x02) ? 0x04 : 0) | ((b1 & 0x04) ? 0x08 : 0);
+    } else {
+        report[3] = side | ((b1 & 0x08) ? 0x01 : 0) | ((b1 & 0x02) ? 0x02 : 0) | ((b1 & 0x04) ? 0x04 : 0) | ((b1 & 0x01) ? 0x08 : 0);
+    }
+    report[4] = ((b2 & 0x01) ? 0x01 : 0) | ((b2 & 0x02) ? 0x02 : 0) | ((b2 & 0x08) ? 0x04 : 0)
+              | ((b2 & 0x04) ? 0x08 : 0) | ((b2 & 0x10) ? 0x10 : 0) | ((b2 & 0x20) ? 0x20 : 0);
+
+    // Hat 0-7 clockwise from up, 8 neutral, turned into a full-deflection stick
+    static constexpr int HAT_X[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+    static constexpr int HAT_Y[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+    static constexpr int STICK_CENTER = 0x800;
+    static constexpr int STICK_DEFLECTION = 0x600;
+    uint8_t hat = simple[3];
+    int h = STICK_CENTER + (hat < 8 ? HAT_X[hat] * STICK_DEFLECTION : 0);
+    int v = STICK_CENTER + (hat < 8 ? HAT_Y[hat] * STICK_DEFLECTION : 0);
+    size_t offset = left ? 6 : 9;
+    report[offset] = h & 0xFF;
+    report[offset + 1] = ((h >> 8) & 0x0F) | ((v & 0x0F) << 4);
+    report[offset + 2] = (v >> 4) & 0xFF;
+    return report;
+}
+
+JoyCon::ReportStats JoyCon::get_report_stats() const {
+    ReportStats stats;
+    stats.reports = reports_.load(std::memory_order_relaxed);
+    stats.reads = reads_.load(std::memory_order_relaxed);
+    stats.bytes = bytes_read_.load(std::memory_order_relaxed);
+    stats.polls = polls_.load(std::memory_order_relaxed);
+    stats.hook_calls = hook_calls_.load(std::memory_order_relaxed);
+    stats.hook_skips = hook_skips_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+namespace {
+    std::mutex default_reader_options_mutex;
+    ReaderThreadOptions default_reader_options;
+}
+
+void JoyCon::set_default_reader_options(const ReaderThreadOptions& options) {
+    std::lock_guard<std::mutex> lock(default_reader_options_mutex);
+    default_reader_options = options;
+}
+
+ReaderThreadOptions JoyCon::get_default_reader_options() {
+    std::lock_guard<std::mutex> lock(default_reader_options_mutex);
+    return default_reader_options;
+}
+
+void JoyCon::set_reader_options(const ReaderThreadOptions& options) {
+    {
+        std::lock_guard<std::mutex> lock(reader_options_mutex_);
+        if (reader_exited_ || link_state_ == LinkState::FAILED) {
+            throw std::runtime_error("Reader thread options: the Joy-Con link failed, no input thread to apply them");
+        }
+        reader_options_ = options;
+        reader_options_applied_ = false;
+        reader_options_pending_ = true;
+    }
+    if (is_input_thread()) {
+        // Called from a hook, we already are the input thread
+        apply_pending_reader_options();
+    }
+    wait_reader_options();
+}
+
+ReaderThreadOptions JoyCon::get_reader_options() const {
+    std::lock_guard<std::mutex> lock(reader_options_mutex_);
+    return reader_options_;
+}
+
+void JoyCon::wait_reader_options() {
+    std::unique_lock<std::mutex> lock(reader_options_mutex_);
+    reader_options_cv_.wait(lock, [this] { return reader_options_applied_ || reader_exited_; });
+    if (!reader_options_applied_) {
+        throw std::runtime_error("Reader thread options: the input thread stopped before applying them");
+    }
+    if (!reader_options_error_.empty()) {
+        throw std::runtime_error("Reader thread options: " + reader_options_error_);
+    }
+}
+
+void JoyCon::apply_pending_reader_options() {
+    std::lock_guard<std::mutex> lock(reader_options_mutex_);
+    reader_options_pending_ = false;
+    reader_options_error_.clear();
+    try {
+        apply_thread_options(reader_options_);
+        spin_budget_ = reader_options_.spin_budget;
+    } catch (const std::exception& e) {
+        reader_options_error_ = e.what();
+    }
+    reader_options_applied_ = true;
+    reader_options_cv_.notify_all();
 }
 
 int16_t JoyCon::to_int16le_from_2bytes(uint8_t hbytebe, uint8_t lbytebe) {
@@ -178,40 +969,187 @@ int JoyCon::get_nbit_from_input_report(const std::array<uint8_t, INPUT_REPORT_SI
 }
 
 // Calibration
+std::array<JoyCon::StickCalibration, 2> JoyCon::get_stick_calibration() const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    return stick_calibration_;
+}
+
 void JoyCon::set_gyro_calibration(const std::array<int16_t, 3>& offset_xyz, const std::array<int16_t, 3>& coeff_xyz) {
-    GYRO_OFFSET_X_ = offset_xyz[0];
-    GYRO_OFFSET_Y_ = offset_xyz[1];
-    GYRO_OFFSET_Z_ = offset_xyz[2];
-    GYRO_COEFF_X_ = (coeff_xyz[0] != 0x343b) ? 0x343b / static_cast<float>(coeff_xyz[0]) : 1.0f;
-    GYRO_COEFF_Y_ = (coeff_xyz[1] != 0x343b) ? 0x343b / static_cast<float>(coeff_xyz[1]) : 1.0f;
-    GYRO_COEFF_Z_ = (coeff_xyz[2] != 0x343b) ? 0x343b / static_cast<float>(coeff_xyz[2]) : 1.0f;
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    for (int i = 0; i < 3; ++i) {
+        gyro_cal_offset_[i] = offset_xyz[i];
+        gyro_cal_coeff_[i] = (coeff_xyz[i] != 0x343b) ? 0x343b / static_cast<float>(coeff_xyz[i]) : 1.0f;
+    }
+    update_imu_coefficients();
 }
 
 void JoyCon::set_accel_calibration(const std::array<int16_t, 3>& offset_xyz, const std::array<int16_t, 3>& coeff_xyz) {
-    ACCEL_OFFSET_X_ = offset_xyz[0];
-    ACCEL_OFFSET_Y_ = offset_xyz[1];
-    ACCEL_OFFSET_Z_ = offset_xyz[2];
-    ACCEL_COEFF_X_ = (coeff_xyz[0] != 0x4000) ? 0x4000 / static_cast<float>(coeff_xyz[0]) : 1.0f;
-    ACCEL_COEFF_Y_ = (coeff_xyz[1] != 0x4000) ? 0x4000 / static_cast<float>(coeff_xyz[1]) : 1.0f;
-    ACCEL_COEFF_Z_ = (coeff_xyz[2] != 0x4000) ? 0x4000 / static_cast<float>(coeff_xyz[2]) : 1.0f;
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    for (int i = 0; i < 3; ++i) {
+        accel_cal_offset_[i] = offset_xyz[i];
+        accel_cal_coeff_[i] = (coeff_xyz[i] != 0x4000) ? 0x4000 / static_cast<float>(coeff_xyz[i]) : 1.0f;
+    }
+    update_imu_coefficients();
+}
+
+size_t JoyCon::register_update_hook(std::function<void(JoyCon&)> callback) {
+    std::lock_guard<std::mutex> lock(hooks_mutex_);
+    size_t id = next_hook_id_++;
+    UpdateHook hook;
+    hook.id = id;
+    hook.callback = std::move(callback);
+    input_hooks_.push_back(std::move(hook));
+    return id;
+}
+
+size_t JoyCon::register_update_hook(std::function<void(JoyCon&)> callback, const UpdateFilter& filter) {
+    if (filter.stick_delta < 0 || filter.gyro_dps < 0.0f || filter.accel_delta_g < 0.0f) {
+        throw std::invalid_argument("filter thresholds must not be negative");
+    }
+    std::lock_guard<std::mutex> lock(hooks_mutex_);
+    size_t id = next_hook_id_++;
+    UpdateHook hook;
+    hook.id = id;
+    hook.callback = std::move(callback);
+    hook.filtered = true;
+    hook.filter = filter;
+    input_hooks_.push_back(std::move(hook));
+    hooks_need_imu_ = hooks_need_imu_ || filter.gyro_dps > 0.0f || filter.accel_delta_g > 0.0f;
+    return id;
 }
 
-void JoyCon::register_update_hook(std::function<void(JoyCon&)> callback) {
-    input_hooks_.push_back(callback);
+void JoyCon::unregister_update_hook(size_t hook_id) {
+    std::lock_guard<std::mutex> lock(hooks_mutex_);
+    input_hooks_.erase(std::remove_if(input_hooks_.begin(), input_hooks_.end(),
+        [hook_id](const UpdateHook& hook) { return hook.id == hook_id; }), input_hooks_.end());
+    hooks_need_imu_ = std::any_of(input_hooks_.begin(), input_hooks_.end(), [](const UpdateHook& hook) {
+        return hook.filtered && (hook.filter.gyro_dps > 0.0f || hook.filter.accel_delta_g > 0.0f);
+    });
+}
+
+JoyCon::ReportSummary JoyCon::summarize_report(const std::array<uint8_t, INPUT_REPORT_SIZE>& report) const {
+    ReportSummary summary{};
+    summary.buttons = report[3] | (report[4] << 8) | (report[5] << 16);
+    summary.sticks = {get_stick_left_horizontal(report), get_stick_left_vertical(report),
+                      get_stick_right_horizontal(report), get_stick_right_vertical(report)};
+    // Simple reports carry no IMU data
+    summary.imu = hooks_need_imu_ && report[0] != 0x3F;
+    if (summary.imu) {
+        for (int i = 0; i < 3; ++i) {
+            float x = (get_gyro_x(report, i) - status_offset_.gyro_x) / GYRO_UNITS_PER_DPS;
+            float y = (get_gyro_y(report, i) - status_offset_.gyro_y) / GYRO_UNITS_PER_DPS;
+            float z = (get_gyro_z(report, i) - status_offset_.gyro_z) / GYRO_UNITS_PER_DPS;
+            summary.gyro_dps = std::max(summary.gyro_dps, std::sqrt(x * x + y * y + z * z));
+        }
+        summary.accel = {get_accel_x(report) / ACCEL_UNITS_PER_G, get_accel_y(report) / ACCEL_UNITS_PER_G, get_accel_z(report) / ACCEL_UNITS_PER_G};
+    }
+    return summary;
+}
+
+bool JoyCon::passes_filter(UpdateHook& hook, const ReportSummary& summary) {
+    const UpdateFilter& f = hook.filter;
+    bool pass = !hook.primed;
+    pass = pass || ((summary.buttons ^ hook.buttons) & f.button_mask) != 0;
+    if (!pass && f.stick_delta > 0) {
+        for (size_t i = 0; i < summary.sticks.size(); ++i) {
+            pass = pass || std::abs(summary.sticks[i] - hook.sticks[i]) >= f.stick_delta;
+        }
+    }
+    if (!pass && summary.imu) {
+        pass = f.gyro_dps > 0.0f && summary.gyro_dps >= f.gyro_dps;
+        if (!pass && f.accel_delta_g > 0.0f) {
+            float dx = summary.accel[0] - hook.accel[0];
+            float dy = summary.accel[1] - hook.accel[1];
+            float dz = summary.accel[2] - hook.accel[2];
+            pass = dx * dx + dy * dy + dz * dz >= f.accel_delta_g * f.accel_delta_g;
+        }
+    }
+    if (pass) {
+        // Deltas are measured from what the hook last saw, so slow drift
+        // still triggers once it adds up
+        hook.primed = true;
+        hook.buttons = summary.buttons;
+        hook.sticks = summary.sticks;
+        if (summary.imu) hook.accel = summary.accel;
+    }
+    return pass;
+}
+
+void JoyCon::run_update_hooks(const std::array<uint8_t, INPUT_REPORT_SIZE>& report) {
+    // Caller holds hooks_mutex_
+    std::optional<ReportSummary> summary;
+    uint64_t calls = 0;
+    uint64_t skips = 0;
+    for (auto& hook : input_hooks_) {
+        if (hook.filtered) {
+            if (!summary) summary = summarize_report(report);
+            if (!passes_filter(hook, *summary)) {
+                skips++;
+                continue;
+            }
+        }
+        hook.callback(*this);
+        calls++;
+    }
+    hook_calls_.fetch_add(calls, std::memory_order_relaxed);
+    if (skips) hook_skips_.fetch_add(skips, std::memory_order_relaxed);
+}
+
+int JoyCon::get_timer() const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    return get_timer(input_report_);
+}
+
+std::chrono::steady_clock::time_point JoyCon::get_report_time() const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    return input_report_time_;
+}
+
+std::chrono::steady_clock::time_point JoyCon::get_device_time() const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    return device_time_;
+}
+
+std::array<std::chrono::steady_clock::time_point, DeviceClock::SAMPLES_PER_REPORT> JoyCon::get_sample_times() const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    return device_clock_.sample_times();
+}
+
+DeviceClock JoyCon::get_device_clock() const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    return device_clock_;
+}
+
+std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE> JoyCon::get_input_report() const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    return input_report_;
 }
 
 bool JoyCon::is_left() const {
-    return product_id_ == JOYCON_L_PRODUCT_ID;
+    return type == LEFT;
 }
 
 bool JoyCon::is_right() const {
-    return product_id_ == JOYCON_R_PRODUCT_ID;
+    return type == RIGHT;
+}
+
+uint16_t JoyCon::get_product_id() const {
+    return product_id_;
+}
+
+bool JoyCon::is_simple_mode() const {
+    return simple_mode_;
+}
+
+bool JoyCon::is_input_thread() const {
+    return std::this_thread::get_id() == update_input_report_thread_.get_id();
 }
 
 // Button getters (now take a report parameter)
 #define BUTTON_GETTER(NAME, BYTE, BIT, NBIT) \
     int JoyCon::get_##NAME(const std::array<uint8_t, INPUT_REPORT_SIZE>& report) const { return get_nbit_from_input_report(report, BYTE, BIT, NBIT); }
 
+BUTTON_GETTER(timer, 1, 0, 8)
 BUTTON_GETTER(battery_charging, 2, 4, 1)
 BUTTON_GETTER(battery_level, 2, 5, 3)
 BUTTON_GETTER(button_y, 3, 0, 1)
@@ -289,11 +1227,9 @@ float JoyCon::get_gyro_z(const std::array<uint8_t, INPUT_REPORT_SIZE>& report, i
 // Status (uses a local copy of the report for all fields)
 JoyCon::Status JoyCon::get_status() const {
     Status s;
-    std::array<uint8_t, INPUT_REPORT_SIZE> report;
-    {
-        std::lock_guard<std::mutex> lock(report_mutex_);
-        report = input_report_;
-    }
+    // Decoded under the lock so calibration can't change mid-report
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    const std::array<uint8_t, INPUT_REPORT_SIZE>& report = input_report_;
     s.battery.charging = get_battery_charging(report);
     s.battery.level = get_battery_level(report);
     s.buttons.right.y = get_button_y(report);
@@ -332,11 +1268,8 @@ JoyCon::Status JoyCon::get_status() const {
 }
 
 void JoyCon::status_offset() {
-    std::array<uint8_t, INPUT_REPORT_SIZE> report;
-    {
-        std::lock_guard<std::mutex> lock(report_mutex_);
-        report = input_report_;
-    }
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    const std::array<uint8_t, INPUT_REPORT_SIZE>& report = input_report_;
     status_offset_.stick_left_horizontal = get_stick_left_horizontal(report);
     status_offset_.stick_left_vertical = get_stick_left_vertical(report);
     status_offset_.stick_right_horizontal = get_stick_right_horizontal(report);
@@ -344,76 +1277,101 @@ void JoyCon::status_offset() {
     status_offset_.gyro_x = get_gyro_x(report);
     status_offset_.gyro_y = get_gyro_y(report);
     status_offset_.gyro_z = get_gyro_z(report);
+    gyro_bias_.reset({status_offset_.gyro_x / GYRO_UNITS_PER_DPS,
+                      status_offset_.gyro_y / GYRO_UNITS_PER_DPS,
+                      status_offset_.gyro_z / GYRO_UNITS_PER_DPS});
+}
+
+JoyCon::Calibration JoyCon::get_calibration() const {
+    std::array<uint8_t, INPUT_REPORT_SIZE> report;
+    return get_calibration(report);
+}
+
+JoyCon::Calibration JoyCon::get_calibration(std::array<uint8_t, INPUT_REPORT_SIZE>& report) const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    report = input_report_;
+    Calibration c;
+    c.accel_offset = {ACCEL_OFFSET_X_, ACCEL_OFFSET_Y_, ACCEL_OFFSET_Z_};
+    c.accel_coeff = {ACCEL_COEFF_X_, ACCEL_COEFF_Y_, ACCEL_COEFF_Z_};
+    c.gyro_offset = {GYRO_OFFSET_X_, GYRO_OFFSET_Y_, GYRO_OFFSET_Z_};
+    c.gyro_coeff = {GYRO_COEFF_X_, GYRO_COEFF_Y_, GYRO_COEFF_Z_};
+    c.sticks = stick_calibration_;
+    c.status_offset = status_offset_;
+    return c;
+}
+
+void JoyCon::enable_gyro_bias_tracking(bool enable, const GyroBiasOptions& options) {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    gyro_bias_tracking_ = enable;
+    gyro_bias_ = GyroBiasEstimator(options);
+    gyro_bias_.reset({status_offset_.gyro_x / GYRO_UNITS_PER_DPS,
+                      status_offset_.gyro_y / GYRO_UNITS_PER_DPS,
+                      status_offset_.gyro_z / GYRO_UNITS_PER_DPS});
+}
+
+std::array<float, 3> JoyCon::get_gyro_bias_confidence() const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    return gyro_bias_.confidence();
+}
+
+bool JoyCon::is_stationary() const {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    return gyro_bias_.stationary();
+}
+
+void JoyCon::track_gyro_bias(const std::array<uint8_t, INPUT_REPORT_SIZE>& report) {
+    // Called with report_mutex_ held, feeds all three samples of the report
+    bool updated = false;
+    for (int i = 0; i < 3; ++i) {
+        updated |= gyro_bias_.add_sample(
+            {get_gyro_x(report, i) / GYRO_UNITS_PER_DPS, get_gyro_y(report, i) / GYRO_UNITS_PER_DPS, get_gyro_z(report, i) / GYRO_UNITS_PER_DPS},
+            {get_accel_x(report, i) / ACCEL_UNITS_PER_G, get_accel_y(report, i) / ACCEL_UNITS_PER_G, get_accel_z(report, i) / ACCEL_UNITS_PER_G});
+    }
+    if (updated) {
+        const auto& bias = gyro_bias_.bias();
+        status_offset_.gyro_x = bias[0] * GYRO_UNITS_PER_DPS;
+        status_offset_.gyro_y = bias[1] * GYRO_UNITS_PER_DPS;
+        status_offset_.gyro_z = bias[2] * GYRO_UNITS_PER_DPS;
+    }
 }
 
 
 // Lamp and rumble
 void JoyCon::set_player_lamp_on(int on_pattern) {
-    std::vector<uint8_t> cmd = {0x01, packet_number_};
-    cmd.insert(cmd.end(), rumble_data_.begin(), rumble_data_.end());
-    cmd.push_back(0x30);
-    cmd.push_back(on_pattern & 0xF);
-    write_output_report(cmd);
-    packet_number_ = (packet_number_ + 1) & 0xF;
+    send_player_lights(static_cast<uint8_t>(on_pattern & 0xF));
 }
 
 void JoyCon::set_player_lamp_flashing(int player_number) {
-    int binaryPattern = 1;
-    switch (player_number) {
-        case 1: binaryPattern = 1; break;
-        case 2: binaryPattern = 3; break;
-        case 3: binaryPattern = 7; break;
-        case 4: binaryPattern = 15; break;
-        case 5: binaryPattern = 9; break;
-        case 6: binaryPattern = 10; break;
-        case 7: binaryPattern = 11; break;
-        case 8: binaryPattern = 6; break;
-        default: throw std::invalid_argument("Invalid player number");
-    }
-    std::vector<uint8_t> cmd = {0x01, packet_number_};
-    cmd.insert(cmd.end(), rumble_data_.begin(), rumble_data_.end());
-    cmd.push_back(0x30);
-    cmd.push_back((binaryPattern & 0xF) << 4);
-    write_output_report(cmd);
-    packet_number_ = (packet_number_ + 1) & 0xF;
+    uint8_t pattern = output_report::player_lamp_pattern(player_number);
+    send_player_lights(static_cast<uint8_t>(pattern << 4));
 }
 
 void JoyCon::set_player_lamp(int player_number) {
-    int binaryPattern = 1;
-    switch (player_number) {
-        case 1: binaryPattern = 1; break;
-        case 2: binaryPattern = 3; break;
-        case 3: binaryPattern = 7; break;
-        case 4: binaryPattern = 15; break;
-        case 5: binaryPattern = 9; break;
-        case 6: binaryPattern = 10; break;
-        case 7: binaryPattern = 11; break;
-        case 8: binaryPattern = 6; break;
-        default: throw std::invalid_argument("Invalid player number");
-    }
-    std::vector<uint8_t> cmd = {0x01, packet_number_};
-    cmd.insert(cmd.end(), rumble_data_.begin(), rumble_data_.end());
-    cmd.push_back(0x30);
-    cmd.push_back(binaryPattern & 0xF);
-    write_output_report(cmd);
-    packet_number_ = (packet_number_ + 1) & 0xF;
+    send_player_lights(output_report::player_lamp_pattern(player_number));
+}
+
+void JoyCon::send_player_lights(uint8_t pattern) {
+    {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        lamp_pattern_ = pattern;
+    }
+    write_output_report(build_subcommand(output_report::SetPlayerLights{pattern}));
 }
 
 void JoyCon::send_rumble(const std::array<uint8_t, 8>& data) {
-    rumble_data_ = data;
-    std::vector<uint8_t> cmd = {0x10, packet_number_};
-    cmd.insert(cmd.end(), rumble_data_.begin(), rumble_data_.end());
-    write_output_report(cmd);
-    packet_number_ = (packet_number_ + 1) & 0xF;
+    {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        rumble_data_ = data;
+    }
+    write_output_report(output_report::build_rumble(0, data));
 }
 
 void JoyCon::enable_vibration(bool enable) {
-    std::vector<uint8_t> cmd = {0x01, packet_number_};
-    cmd.insert(cmd.end(), rumble_data_.begin(), rumble_data_.end());
-    cmd.push_back(0x48);
-    cmd.push_back(enable ? 0x01 : 0x00);
-    write_output_report(cmd);
-    packet_number_ = (packet_number_ + 1) & 0xF;
+    {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        vibration_ = enable ? 1 : 0;
+    }
+    write_output_report(build_subcommand(output_report::EnableVibration{enable}));
 }
 
 void JoyCon::rumble_simple() {
@@ -429,10 +1387,5 @@ void JoyCon::rumble_stop() {
 }
 
 void JoyCon::disconnect_device() {
-    std::vector<uint8_t> cmd = {0x01, packet_number_};
-    cmd.insert(cmd.end(), rumble_data_.begin(), rumble_data_.end());
-    cmd.push_back(0x06);
-    cmd.push_back(0x00);
-    write_output_report(cmd);
-    packet_number_ = (packet_number_ + 1) & 0xF;
-}
+    write_output_report(build_subcommand(output_report::SetHciState{0x00}));
+}
\ No newline at end of file
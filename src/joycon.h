@@ -1,5 +1,9 @@
 #pragma once
 
+#include "output_report.h"
+#include "gyro_bias.h"
+#include "device_clock.h"
+#include "thread_options.h"
 #include <hidapi.h>
 #include <cstdint>
 #include <vector>
@@ -9,34 +13,233 @@
 #include <mutex>
 #include <functional>
 #include <atomic>
+#include <condition_variable>
 #include <memory>
 #include <stdexcept>
+#include <chrono>
+#include <utility>
 
 enum JoyConType { LEFT, RIGHT, UNKNOWN };
 
+struct ReconnectOptions {
+    // Off: a lost link ends the input thread, the JoyCon stays FAILED
+    bool enabled = true;
+    // Delay between reopen attempts, doubled after each failure
+    std::chrono::milliseconds initial_backoff{50};
+    std::chrono::milliseconds max_backoff{2000};
+    // Attempts before giving up, 0 retries forever
+    int max_attempts = 0;
+};
+
+// How the controller is attached. USB covers the charging grip and the Pro
+// Controller cable: a handshake switches the controller to wired HID
+// streaming, with lower and steadier latency than Bluetooth.
+enum class Transport { BLUETOOTH, USB };
+
+struct TransportOptions {
+    Transport transport = Transport::BLUETOOTH;
+    // USB only: how often the no-timeout command is repeated so the
+    // controller never falls back to its inactivity timeout, 0 sends it
+    // only during the handshake
+    std::chrono::milliseconds keepalive_interval{1000};
+};
+
+// Change filter of an update hook. A filtered hook only runs for reports
+// that differ enough from the last one it was given; criteria left at 0
+// are off.
+struct UpdateFilter {
+    uint32_t button_mask = 0;       // report bytes 3..5, byte 3 in bits 0-7
+    int stick_delta = 0;            // raw counts on any stick axis
+    float gyro_dps = 0.0f;          // gyro magnitude of any sample, status offset applied
+    float accel_delta_g = 0.0f;     // change of the accel vector
+};
+
 class JoyCon {
 public:
     JoyConType type = UNKNOWN;
     static constexpr size_t INPUT_REPORT_SIZE = 49;
+    // 0x31 reports: the standard 49 bytes followed by MCU (IR/NFC) data
+    static constexpr size_t MCU_REPORT_SIZE = 362;
     static constexpr double INPUT_REPORT_PERIOD = 0.015;
     static constexpr std::array<uint8_t, 8> DEFAULT_RUMBLE_DATA = {0x00, 0x01, 0x40, 0x40, 0x00, 0x01, 0x40, 0x40};
+    // Scale of the calibrated accel/gyro getters (factory 4G and 936 dps references)
+    static constexpr float ACCEL_UNITS_PER_G = 4096.0f;
+    static constexpr float GYRO_UNITS_PER_DPS = 13371.0f / 936.0f;
+
+    // Reports over USB are framed in 64 bytes, the standard 49 come first
+    static constexpr size_t USB_REPORT_SIZE = 64;
 
-    JoyCon(uint16_t vendor_id, uint16_t product_id, const std::wstring& serial = L"", bool simple_mode = false);
+    JoyCon(uint16_t vendor_id, uint16_t product_id, const std::wstring& serial = L"", bool simple_mode = false,
+           const TransportOptions& transport = {});
     virtual ~JoyCon();
 
     // Calibration
     void set_gyro_calibration(const std::array<int16_t, 3>& offset_xyz, const std::array<int16_t, 3>& coeff_xyz);
     void set_accel_calibration(const std::array<int16_t, 3>& offset_xyz, const std::array<int16_t, 3>& coeff_xyz);
 
-    // Register input hook
-    void register_update_hook(std::function<void(JoyCon&)> callback);
+    // Stick calibration read on connect: the user calibration where the
+    // controller has one, the factory one otherwise. Raw 12-bit counts,
+    // horizontal then vertical. A stick the controller does not have
+    // keeps the defaults.
+    struct StickCalibration {
+        std::array<uint16_t, 2> center{0x800, 0x800};
+        std::array<uint16_t, 2> above{0x600, 0x600};    // center to maximum
+        std::array<uint16_t, 2> below{0x600, 0x600};    // center to minimum
+    };
+    // Left, right
+    std::array<StickCalibration, 2> get_stick_calibration() const;
+
+    // IMU full-scale range, performance mode and filter (subcommand 0x41).
+    // Applied at runtime, the calibration coefficients follow so the
+    // accel/gyro getters keep the same units for every range.
+    enum class GyroSensitivity : uint8_t { DPS_250 = 0, DPS_500 = 1, DPS_1000 = 2, DPS_2000 = 3 };
+    enum class AccelSensitivity : uint8_t { G_8 = 0, G_4 = 1, G_2 = 2, G_16 = 3 };
+    enum class GyroPerformance : uint8_t { HZ_833 = 0, HZ_208 = 1 };
+    enum class AccelFilter : uint8_t { HZ_200 = 0, HZ_100 = 1 };
+    struct ImuConfig {
+        GyroSensitivity gyro_sensitivity = GyroSensitivity::DPS_2000;
+        AccelSensitivity accel_sensitivity = AccelSensitivity::G_8;
+        GyroPerformance gyro_performance = GyroPerformance::HZ_208;
+        AccelFilter accel_filter = AccelFilter::HZ_100;
+        bool operator==(const ImuConfig&) const = default;
+    };
+    void set_imu_config(const ImuConfig& config);
+    ImuConfig get_imu_config() const;
+
+    // Register input hook, returns an id usable to unregister it.
+    // Must not be unregistered from inside a hook. Hooks run on the input
+    // thread: calls that wait for a subcommand reply (set_imu_config,
+    // SpiFlash, JoyConMcu) throw std::logic_error there.
+    size_t register_update_hook(std::function<void(JoyCon&)> callback);
+    // Runs only when a report passes the filter, evaluated once per report
+    // on the input thread before any hook is called
+    size_t register_update_hook(std::function<void(JoyCon&)> callback, const UpdateFilter& filter);
+    void unregister_update_hook(size_t hook_id);
+
+    // Link loss and reconnect. A failed read no longer ends the process:
+    // the input thread reopens the device with backoff and replays report
+    // mode, IMU config, vibration and lamp; calibration and hooks are kept.
+    // Link hooks run on the input thread when the state changes, the first
+    // report of a new generation follows a gap.
+    enum class LinkState { CONNECTED, RECONNECTING, FAILED };
+    struct LinkEvent {
+        LinkState state;
+        uint64_t generation;    // bumped on every successful reconnect
+        std::chrono::steady_clock::time_point time;
+    };
+    size_t register_link_hook(std::function<void(JoyCon&, const LinkEvent&)> callback);
+    void unregister_link_hook(size_t hook_id);
+    LinkState get_link_state() const;
+    uint64_t get_link_generation() const;
+    void set_reconnect_options(const ReconnectOptions& options);
+    ReconnectOptions get_reconnect_options() const;
+
+    struct ReconnectStats {
+        uint64_t link_losses = 0;
+        uint64_t reconnects = 0;
+        uint64_t attempts = 0;                  // reopen attempts, failed ones included
+        std::chrono::microseconds last_downtime{0};             // link loss to first report
+        std::chrono::microseconds last_reconnect_to_report{0};  // reopen to first report
+    };
+    ReconnectStats get_reconnect_stats() const;
+
+    // Report timing of the link, to compare Bluetooth and USB. Intervals are
+    // between consecutive full reports; delay is the receive time past the
+    // device clock's least delayed delivery, so its spread is the link jitter.
+    Transport get_transport() const;
+    struct TransportStats {
+        Transport transport = Transport::BLUETOOTH;
+        uint64_t handshakes = 0;    // USB handshakes, one per (re)connect
+        uint64_t keepalives = 0;
+        uint64_t samples = 0;
+        std::chrono::microseconds mean_interval{0};
+        std::chrono::microseconds interval_jitter{0};   // standard deviation
+        std::chrono::microseconds max_interval{0};
+        std::chrono::microseconds mean_delay{0};
+        std::chrono::microseconds delay_jitter{0};      // standard deviation
+    };
+    TransportStats get_transport_stats() const;
+    void reset_transport_stats();
 
-    // Status
+    // Status. The side comes from the product id, for the charging grip
+    // from the device info on connect; a Pro Controller is neither.
     bool is_left() const;
     bool is_right() const;
+    uint16_t get_product_id() const;
+    bool is_simple_mode() const;
+    // True on the thread that reads reports and runs the hooks
+    bool is_input_thread() const;
 
     std::wstring serial;
 
+    // Device timer (report[1]) and host receive time of the last report
+    static constexpr double TIMER_TICK_PERIOD = DeviceClock::TICK_PERIOD;
+    int get_timer() const;
+    int get_timer(const std::array<uint8_t, INPUT_REPORT_SIZE>& report) const;
+    std::chrono::steady_clock::time_point get_report_time() const;
+
+    // Host time of the last report tick and of each of its IMU samples
+    // (oldest first), from the device timer synchronized to steady_clock.
+    // Unlike get_report_time() these are free of Bluetooth delivery jitter.
+    std::chrono::steady_clock::time_point get_device_time() const;
+    std::array<std::chrono::steady_clock::time_point, DeviceClock::SAMPLES_PER_REPORT> get_sample_times() const;
+    DeviceClock get_device_clock() const;
+
+    // Link traffic counters, e.g. to compare simple and full mode
+    struct ReportStats {
+        uint64_t reports = 0;   // reports published to hooks
+        uint64_t reads = 0;     // input thread wakeups with data
+        uint64_t bytes = 0;     // bytes received from the device
+        uint64_t polls = 0;     // empty non-blocking reads while busy-polling
+        uint64_t hook_calls = 0;
+        uint64_t hook_skips = 0;    // filtered hooks not called for a report
+    };
+    ReportStats get_report_stats() const;
+
+    // Input thread priority, affinity and busy-polling. Applied by the input
+    // thread itself, also while reconnecting; throws std::runtime_error if
+    // the system refused, e.g. SCHED_FIFO without permission, or once the
+    // link FAILED and the input thread has stopped.
+    void set_reader_options(const ReaderThreadOptions& options);
+    ReaderThreadOptions get_reader_options() const;
+    // Applied to every JoyCon constructed afterwards
+    static void set_default_reader_options(const ReaderThreadOptions& options);
+    static ReaderThreadOptions get_default_reader_options();
+
+    // Subcommands, for what is built on the protocol (SpiFlash, AsyncJoyCon,
+    // JoyConMcu). Packet number and rumble are filled in on sending.
+    template <class Command>
+    static output_report::Report build_subcommand(const Command& command) {
+        return output_report::build_subcommand(0, DEFAULT_RUMBLE_DATA, command);
+    }
+    static constexpr std::chrono::milliseconds SUBCOMMAND_TIMEOUT{1000};
+    // Blocks until the reply or SUBCOMMAND_TIMEOUT; throws std::logic_error
+    // on the input thread, which is the one handing the reply over
+    std::pair<bool, std::vector<uint8_t>> send_subcmd_get_response(const output_report::Report& report);
+    // Several requests may be in flight, replies are matched on the
+    // subcommand id (and the echoed address for SPI) in request order.
+    // done runs on the input thread and gets nullptr on timeout. Returns
+    // the id of the pending reply. Throws std::runtime_error once the input
+    // thread has stopped or if the write fails, done is then never called.
+    using ReplyCallback = std::function<void(const std::array<uint8_t, INPUT_REPORT_SIZE>* reply)>;
+    uint64_t send_subcmd_async(const output_report::Report& request, ReplyCallback done, std::chrono::milliseconds timeout = SUBCOMMAND_TIMEOUT);
+    // One SPI flash read of up to 0x1D bytes, blocking
+    std::vector<uint8_t> spi_flash_read(uint32_t address, uint8_t size);
+    // Any output report without waiting for a reply, e.g. MCU requests;
+    // throws std::runtime_error if the write fails
+    void send_output_report(const output_report::Report& report);
+    // Receives the MCU part of 0x31 reports on the input thread, under the
+    // hook lock. Only one handler at a time, std::logic_error if one is
+    // set already; nullptr removes it, it does not run after that returns.
+    void set_mcu_handler(std::function<void(const uint8_t*, size_t)> handler);
+
+    // Decodes a 0x3F simple HID report into the standard 0x30 layout used by
+    // the getters. The stick hat becomes a full-deflection stick, no IMU.
+    static std::array<uint8_t, INPUT_REPORT_SIZE> simple_report_to_standard(const std::array<uint8_t, INPUT_REPORT_SIZE>& simple, bool left);
+
+    // Copy of the last raw report, for use with the report-taking getters
+    std::array<uint8_t, INPUT_REPORT_SIZE> get_input_report() const;
+
     // Button getters (overloaded)
     int get_battery_charging() const;
     int get_battery_charging(const std::array<uint8_t, INPUT_REPORT_SIZE>& report) const;
@@ -161,9 +364,31 @@ public:
 
     void status_offset();
 
+    // Calibration in effect, all parts taken under one lock, e.g. for a
+    // capture header. IMU values as the getters use them at the current
+    // ranges.
+    struct Calibration {
+        std::array<float, 3> accel_offset, accel_coeff;
+        std::array<float, 3> gyro_offset, gyro_coeff;
+        std::array<StickCalibration, 2> sticks;
+        Offset status_offset;
+    };
+    Calibration get_calibration() const;
+    // The same together with a copy of the last report, so the report is
+    // decoded with the calibration it was received under
+    Calibration get_calibration(std::array<uint8_t, INPUT_REPORT_SIZE>& report) const;
+
+    // Continuous gyro bias tracking: while the controller is at rest the
+    // gyro part of status_offset_ follows the measured bias, so long
+    // sessions stay drift-free without calling status_offset() again.
+    void enable_gyro_bias_tracking(bool enable = true, const GyroBiasOptions& options = {});
+    std::array<float, 3> get_gyro_bias_confidence() const;
+    bool is_stationary() const;
+
     Offset status_offset_;
 
 private:
+
     // Internal state
     uint16_t vendor_id_;
     uint16_t product_id_;
@@ -172,16 +397,114 @@ private:
     std::array<uint8_t, 3> color_body_;
     std::array<uint8_t, 3> color_btn_;
 
-    std::vector<std::function<void(JoyCon&)>> input_hooks_;
+    struct UpdateHook {
+        size_t id;
+        std::function<void(JoyCon&)> callback;
+        bool filtered = false;
+        UpdateFilter filter;
+        // What the hook was last called with, filtered hooks only
+        bool primed = false;
+        uint32_t buttons = 0;
+        std::array<int, 4> sticks{};
+        std::array<float, 3> accel{};
+    };
+    // Decoded once per report for the filters
+    struct ReportSummary {
+        uint32_t buttons;
+        std::array<int, 4> sticks;
+        bool imu;
+        float gyro_dps;
+        std::array<float, 3> accel;
+    };
+    std::vector<UpdateHook> input_hooks_;
+    bool hooks_need_imu_;   // guarded by hooks_mutex_
+    std::atomic<uint64_t> hook_calls_;
+    std::atomic<uint64_t> hook_skips_;
+    std::vector<std::pair<size_t, std::function<void(JoyCon&, const LinkEvent&)>>> link_hooks_;
+    size_t next_hook_id_;
+    std::mutex hooks_mutex_;
+    // MCU part of 0x31 reports, guarded by hooks_mutex_
+    std::function<void(const uint8_t*, size_t)> mcu_handler_;
     mutable std::array<uint8_t, INPUT_REPORT_SIZE> input_report_;
+    std::chrono::steady_clock::time_point input_report_time_;
+    std::chrono::steady_clock::time_point device_time_;
+    DeviceClock device_clock_;
+    std::atomic<uint64_t> reports_;
+    mutable std::atomic<uint64_t> reads_;
+    mutable std::atomic<uint64_t> bytes_read_;
+    std::atomic<uint64_t> polls_;
+    static constexpr int READ_TIMEOUT_MS = 100;
     uint8_t packet_number_;
-    std::array<uint8_t, 8> rumble_data_;
+    output_report::Rumble rumble_data_;
+    // Last state sent to the device, replayed after a reconnect. Guarded
+    // by output_mutex_; -1 while never set.
+    int lamp_pattern_;
+    int vibration_;
+
+    // Reconnect
+    mutable std::mutex link_mutex_;
+    ReconnectOptions reconnect_options_;
+    ReconnectStats reconnect_stats_;
+    std::atomic<LinkState> link_state_;
+    std::atomic<uint64_t> link_generation_;
+
+    // Transport, fixed at construction
+    const TransportOptions transport_options_;
+    std::atomic<uint64_t> usb_handshakes_;
+    std::atomic<uint64_t> usb_keepalives_;
+    // Running sums (Welford) of report intervals and delays in seconds,
+    // guarded by report_mutex_
+    struct TimingSums {
+        uint64_t count = 0;
+        double interval_mean = 0.0, interval_m2 = 0.0, interval_max = 0.0;
+        double delay_mean = 0.0, delay_m2 = 0.0;
+    };
+    TimingSums timing_;
+    std::chrono::steady_clock::time_point last_timed_report_;
 
     // Calibration
-    int16_t GYRO_OFFSET_X_, GYRO_OFFSET_Y_, GYRO_OFFSET_Z_;
+    float GYRO_OFFSET_X_, GYRO_OFFSET_Y_, GYRO_OFFSET_Z_;
     float GYRO_COEFF_X_, GYRO_COEFF_Y_, GYRO_COEFF_Z_;
-    int16_t ACCEL_OFFSET_X_, ACCEL_OFFSET_Y_, ACCEL_OFFSET_Z_;
+    float ACCEL_OFFSET_X_, ACCEL_OFFSET_Y_, ACCEL_OFFSET_Z_;
     float ACCEL_COEFF_X_, ACCEL_COEFF_Y_, ACCEL_COEFF_Z_;
+    // Calibration at the default ranges, the values above are derived from it
+    std::array<float, 3> gyro_cal_offset_, gyro_cal_coeff_;
+    std::array<float, 3> accel_cal_offset_, accel_cal_coeff_;
+    std::array<StickCalibration, 2> stick_calibration_;
+    ImuConfig imu_config_;
+    bool gyro_bias_tracking_;
+    GyroBiasEstimator gyro_bias_;
+    ImuConfig pending_imu_config_;
+    bool imu_config_pending_;
+
+    // Subcommand replies, handed from the input thread to the caller
+    struct PendingReply {
+        uint64_t id;
+        uint8_t subcommand;
+        bool match_address;
+        uint32_t address;
+        std::chrono::steady_clock::time_point deadline;
+        ReplyCallback done;
+    };
+    static constexpr std::chrono::milliseconds REPLY_EXPIRY_INTERVAL{10};
+    std::mutex subcmd_mutex_;
+    std::mutex reply_mutex_;
+    std::vector<PendingReply> pending_replies_;
+    uint64_t next_reply_id_;    // guarded by reply_mutex_
+    // Cleared once the input thread stops handing replies over, new
+    // requests are refused from then on. Guarded by reply_mutex_.
+    bool reader_running_;
+    std::mutex output_mutex_;
+
+    // Input thread scheduling, handed to the input thread which applies it
+    mutable std::mutex reader_options_mutex_;
+    std::condition_variable reader_options_cv_;
+    ReaderThreadOptions reader_options_;
+    std::atomic<bool> reader_options_pending_;
+    bool reader_options_applied_;
+    bool reader_exited_;    // nobody left to apply options
+    std::string reader_options_error_;
+    std::chrono::microseconds spin_budget_;   // input thread only
 
     // HID device
     hid_device* joycon_device_;
@@ -193,10 +516,35 @@ private:
     hid_device* open(uint16_t vendor_id, uint16_t product_id, const std::wstring& serial);
     void close();
     std::array<uint8_t, INPUT_REPORT_SIZE> read_input_report() const;
-    void write_output_report(const std::vector<uint8_t>& command);
-    std::pair<bool, std::vector<uint8_t>> send_subcmd_get_response(uint8_t subcommand, const std::vector<uint8_t>& argument);
-    std::vector<uint8_t> spi_flash_read(uint32_t address, uint8_t size);
+    size_t read_input_report(std::array<uint8_t, INPUT_REPORT_SIZE>& buf, int timeout_ms) const;
+    size_t read_input_report(uint8_t* buf, size_t size, int timeout_ms) const;
+    void write_output_report(output_report::Report report);
+    // USB commands (report 0x80) bypass the packet number and rumble
+    void write_usb_command(output_report::UsbCommand command);
+    void wait_usb_reply(output_report::UsbCommand command);
+    void usb_handshake();
+    void record_timing(std::chrono::steady_clock::time_point received);
+    // The same, returning the whole 0x21 reply
+    std::array<uint8_t, INPUT_REPORT_SIZE> send_subcmd_get_reply(const output_report::Report& request);
+    // False if the reply was already taken by the input thread
+    bool cancel_pending_reply(uint64_t id);
+    void expire_pending_replies(std::chrono::steady_clock::time_point now);
+    void handle_subcommand_reply(const std::array<uint8_t, INPUT_REPORT_SIZE>& report);
+    void update_imu_coefficients();
+    void track_gyro_bias(const std::array<uint8_t, INPUT_REPORT_SIZE>& report);
+    void apply_pending_reader_options();
+    // Reopens the device after a failed read, false once it gives up or
+    // the JoyCon is being destroyed
+    bool reconnect(std::chrono::steady_clock::time_point& reopened);
+    void replay_device_state();
+    void notify_link_hooks(LinkState state);
+    void send_player_lights(uint8_t pattern);
+    ReportSummary summarize_report(const std::array<uint8_t, INPUT_REPORT_SIZE>& report) const;
+    static bool passes_filter(UpdateHook& hook, const ReportSummary& summary);
+    void run_update_hooks(const std::array<uint8_t, INPUT_REPORT_SIZE>& report);
+    void wait_reader_options();
     void update_input_report();
+    void read_device_type();
     void read_joycon_data();
     void setup_sensors();
     static int16_t to_int16le_from_2bytes(uint8_t hbytebe, uint8_t lbytebe);
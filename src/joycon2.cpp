@@ -0,0 +1,204 @@
+#include "joycon2.h"
+#include "output_report.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace joycon2 {
+
+namespace {
+    constexpr uint8_t CMD_LIGHTS = 0x09;
+    constexpr uint8_t CMD_VIBRATION = 0x0A;
+    constexpr uint8_t CMD_FEATURES = 0x0C;
+
+    constexpr uint8_t LIGHTS_SET_PLAYER = 0x07;
+    constexpr uint8_t VIBRATION_PLAY_PRESET = 0x02;
+    constexpr uint8_t FEATURES_CONFIGURE = 0x02;
+    constexpr uint8_t FEATURES_ENABLE = 0x04;
+    constexpr uint8_t FEATURES_DISABLE = 0x05;
+
+    // Commands with the same key set the same state, the later one wins
+    uint32_t state_key(const Command& command) {
+        uint32_t key = (command.command << 8) | command.subcommand;
+        if (command.command == CMD_FEATURES) {
+            // Enable and disable of one feature mask, configure per mask
+            uint8_t subcommand = command.subcommand == FEATURES_DISABLE ? FEATURES_ENABLE : command.subcommand;
+            uint8_t features = command.data.empty() ? 0 : command.data[0];
+            key = (command.command << 16) | (subcommand << 8) | features;
+        }
+        return key;
+    }
+
+    bool is_event(const Command& command) {
+        return command.command == CMD_VIBRATION;
+    }
+}
+
+std::vector<uint8_t> Command::encode() const {
+    if (data.size() > 0xFF) {
+        throw std::invalid_argument("Joy-Con 2 command data too long");
+    }
+    std::vector<uint8_t> bytes = {command, REQUEST, INTERFACE_BLE, subcommand, 0x00, static_cast<uint8_t>(data.size()), 0x00, 0x00};
+    bytes.insert(bytes.end(), data.begin(), data.end());
+    return bytes;
+}
+
+Command configure_features(uint8_t features) {
+    return {CMD_FEATURES, FEATURES_CONFIGURE, {features, 0x00, 0x00, 0x00}};
+}
+
+Command enable_features(uint8_t features) {
+    return {CMD_FEATURES, FEATURES_ENABLE, {features, 0x00, 0x00, 0x00}};
+}
+
+Command disable_features(uint8_t features) {
+    return {CMD_FEATURES, FEATURES_DISABLE, {features, 0x00, 0x00, 0x00}};
+}
+
+Command set_player_lights(uint8_t pattern) {
+    return {CMD_LIGHTS, LIGHTS_SET_PLAYER, {pattern, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}};
+}
+
+Command play_vibration_preset(uint8_t preset) {
+    return {CMD_VIBRATION, VIBRATION_PLAY_PRESET, {preset, 0x00, 0x00, 0x00}};
+}
+
+}
+
+JoyCon2Commands::JoyCon2Commands(std::shared_ptr<GattWriter> writer, const JoyCon2Options& options)
+    : writer_(std::move(writer)),
+      options_(options),
+      writing_(false),
+      running_(true)
+{
+    if (!writer_) {
+        throw std::invalid_argument("writer is null");
+    }
+    if (options_.max_queue == 0) {
+        throw std::invalid_argument("max_queue must be at least 1");
+    }
+    if (options_.max_busy_retries < 0 || options_.busy_backoff.count() < 0) {
+        throw std::invalid_argument("busy retries and backoff must not be negative");
+    }
+    sender_ = std::thread(&JoyCon2Commands::run, this);
+}
+
+JoyCon2Commands::~JoyCon2Commands() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    sender_.join();
+}
+
+void JoyCon2Commands::send(const joycon2::Command& command, bool coalesce) {
+    Pending pending;
+    pending.key = joycon2::state_key(command);
+    pending.coalesce = coalesce && !joycon2::is_event(command);
+    pending.bytes = command.encode();
+    pending.queued = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.commands++;
+    if (pending.coalesce) {
+        auto it = std::find_if(queue_.begin(), queue_.end(), [&](const Pending& p) { return p.coalesce && p.key == pending.key; });
+        if (it != queue_.end()) {
+            // Moves to the tail, keeping its original queue time for the
+            // latency stat
+            pending.queued = it->queued;
+            queue_.erase(it);
+            queue_.push_back(std::move(pending));
+            stats_.coalesced++;
+            return;
+        }
+    }
+    if (queue_.size() >= options_.max_queue) {
+        throw std::runtime_error("Joy-Con 2 command queue full");
+    }
+    queue_.push_back(std::move(pending));
+    cv_.notify_one();
+}
+
+void JoyCon2Commands::enable_imu(bool enable) {
+    if (enable) {
+        send(joycon2::configure_features(joycon2::FEATURE_IMU));
+        send(joycon2::enable_features(joycon2::FEATURE_IMU));
+    } else {
+        send(joycon2::disable_features(joycon2::FEATURE_IMU));
+    }
+}
+
+void JoyCon2Commands::set_player_lamp(int player_number) {
+    send(joycon2::set_player_lights(output_report::player_lamp_pattern(player_number)));
+}
+
+void JoyCon2Commands::rumble_preset(uint8_t preset) {
+    send(joycon2::play_vibration_preset(preset));
+}
+
+void JoyCon2Commands::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this] { return (queue_.empty() && !writing_) || !running_; });
+}
+
+JoyCon2Commands::Stats JoyCon2Commands::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void JoyCon2Commands::run() {
+    auto next_slot = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return !queue_.empty() || !running_; });
+        if (!running_) {
+            break;
+        }
+        // Pace: one write per interval, commands arriving meanwhile queue
+        // up and may be coalesced
+        if (cv_.wait_until(lock, next_slot, [this] { return !running_; })) {
+            break;
+        }
+        Pending pending = std::move(queue_.front());
+        queue_.pop_front();
+        writing_ = true;
+        lock.unlock();
+        bool written = false;
+        bool failed = false;
+        try {
+            written = writer_->write_without_response(pending.bytes.data(), pending.bytes.size());
+        } catch (const std::exception&) {
+            failed = true;
+        }
+        auto now = std::chrono::steady_clock::now();
+        lock.lock();
+        writing_ = false;
+        next_slot = now + options_.write_interval;
+        if (!written && !failed) {
+            if (pending.busy_retries < options_.max_busy_retries) {
+                // Out of buffers: retry first, once the stack had time to
+                // drain them
+                next_slot = now + std::max<std::chrono::steady_clock::duration>(options_.write_interval, options_.busy_backoff);
+                stats_.busy++;
+                pending.busy_retries++;
+                queue_.push_front(std::move(pending));
+                continue;
+            }
+            failed = true;
+        }
+        if (failed) {
+            // Link error, rejected or never accepted: the command is dropped
+            stats_.failed++;
+            if (queue_.empty()) {
+                idle_cv_.notify_all();
+            }
+            continue;
+        }
+        stats_.writes++;
+        stats_.max_latency = std::max(stats_.max_latency, std::chrono::duration_cast<std::chrono::microseconds>(now - pending.queued));
+        if (queue_.empty()) {
+            idle_cv_.notify_all();
+        }
+    }
+    idle_cv_.notify_all();
+}
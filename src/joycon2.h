@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Transport for Joy-Con 2 commands: the writable GATT characteristic on
+// Windows (bluetooth.cpp), FakeGattWriter in the tests.
+class GattWriter {
+public:
+    virtual ~GattWriter() = default;
+    // One write-without-response packet. Returns false when the stack is
+    // out of buffers and the write should be retried later, throws on a
+    // link error or when the device rejected the write.
+    virtual bool write_without_response(const uint8_t* data, size_t size) = 0;
+};
+
+// Joy-Con 2 command encoding, as observed on the link:
+// [command] [0x91 request] [0x01 BLE] [subcommand] [0x00] [length] [0x00 0x00] [data]
+namespace joycon2 {
+
+constexpr uint8_t REQUEST = 0x91;
+constexpr uint8_t INTERFACE_BLE = 0x01;
+constexpr size_t HEADER_SIZE = 8;
+
+struct Command {
+    uint8_t command;
+    uint8_t subcommand;
+    std::vector<uint8_t> data;
+
+    std::vector<uint8_t> encode() const;
+};
+
+// Feature bits of the 0x0C commands
+enum Feature : uint8_t {
+    FEATURE_BUTTONS = 0x01,
+    FEATURE_STICKS = 0x02,
+    FEATURE_IMU = 0x04,
+    FEATURE_MOUSE = 0x10,
+    FEATURE_CURRENT = 0x20,
+    FEATURE_MAGNETOMETER = 0x80,
+};
+
+Command configure_features(uint8_t features);
+Command enable_features(uint8_t features);
+Command disable_features(uint8_t features);
+Command set_player_lights(uint8_t pattern);
+Command play_vibration_preset(uint8_t preset);
+
+}
+
+struct JoyCon2Options {
+    // Minimum spacing between writes, so command traffic leaves room for
+    // the notification stream in every connection event
+    std::chrono::microseconds write_interval{15000};
+    // send() throws once this many writes are waiting
+    size_t max_queue = 16;
+    // A refused write is retried first after this long (at least one
+    // write_interval), about one connection interval. A command refused
+    // max_busy_retries times in a row is dropped as failed, so it cannot
+    // hold up the ones queued after it.
+    std::chrono::microseconds busy_backoff{7500};
+    int max_busy_retries = 8;
+};
+
+// Paced command channel to a Joy-Con 2. Commands are queued and written
+// by a sender thread, at most one write per write_interval. A command that
+// replaces state (lamp, features) supersedes a queued one of the same kind
+// instead of adding another write; enabling and disabling the same
+// features count as the same kind. Vibration presets are events and are
+// always written.
+class JoyCon2Commands {
+public:
+    explicit JoyCon2Commands(std::shared_ptr<GattWriter> writer, const JoyCon2Options& options = {});
+    ~JoyCon2Commands();
+
+    JoyCon2Commands(const JoyCon2Commands&) = delete;
+    JoyCon2Commands& operator=(const JoyCon2Commands&) = delete;
+
+    // coalesce: drop a queued command that sets the same state and queue
+    // this one at the tail, so it is still written after everything sent
+    // before it. Ignored for vibration.
+    void send(const joycon2::Command& command, bool coalesce = true);
+
+    // Same intent as the JoyCon calls for Joy-Con 1
+    void enable_imu(bool enable = true);
+    void set_player_lamp(int player_number);
+    void rumble_preset(uint8_t preset);
+
+    // Blocks until everything queued so far has been written
+    void flush();
+
+    struct Stats {
+        uint64_t commands = 0;      // send() calls
+        uint64_t writes = 0;        // packets handed to the writer
+        uint64_t coalesced = 0;     // commands folded into a queued one
+        uint64_t busy = 0;          // writes the stack refused and retried
+        uint64_t failed = 0;        // dropped commands: writes that threw or ran out of retries
+        std::chrono::microseconds max_latency{0};   // send() to write
+    };
+    Stats get_stats() const;
+
+private:
+    struct Pending {
+        uint32_t key;
+        bool coalesce;
+        int busy_retries = 0;
+        std::vector<uint8_t> bytes;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    std::shared_ptr<GattWriter> writer_;
+    JoyCon2Options options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable idle_cv_;
+    std::deque<Pending> queue_;
+    bool writing_;
+    bool running_;
+    Stats stats_;
+    std::thread sender_;
+
+    void run();
+};
@@ -0,0 +1,211 @@
+#include "joycon_c.h"
+#include "constants.h"
+#include "joycon.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    constexpr size_t EVENT_CAPACITY = 256;
+
+    thread_local std::string last_error;
+
+    int64_t to_ns(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    joycon_result fail(joycon_result result, const char* message) {
+        last_error = message;
+        return result;
+    }
+
+    // Exceptions must not cross the C boundary
+    template <class F>
+    joycon_result guarded(F&& f) {
+        try {
+            f();
+            last_error.clear();
+            return JOYCON_OK;
+        } catch (const std::invalid_argument& e) {
+            return fail(JOYCON_ERROR_INVALID_ARGUMENT, e.what());
+        } catch (const std::runtime_error& e) {
+            return fail(JOYCON_ERROR_IO, e.what());
+        } catch (const std::exception& e) {
+            return fail(JOYCON_ERROR_UNKNOWN, e.what());
+        } catch (...) {
+            return fail(JOYCON_ERROR_UNKNOWN, "unknown error");
+        }
+    }
+}
+
+struct joycon_handle {
+    std::unique_ptr<JoyCon> joycon;
+    size_t hook_id = 0;
+
+    // Single writer (the input thread), seqlock readers
+    std::atomic<uint32_t> sequence{0};
+    joycon_snapshot snapshot{};
+
+    // Single-producer single-consumer event ring
+    std::array<joycon_event, EVENT_CAPACITY> events{};
+    std::atomic<uint64_t> event_head{0};     // next to read
+    std::atomic<uint64_t> event_tail{0};     // next to write
+    std::atomic<uint64_t> dropped{0};
+
+    void on_report(JoyCon& jc) {
+        auto report = jc.get_input_report();
+        JoyCon::Status status = jc.get_status();
+
+        joycon_snapshot next{};
+        next.host_time_ns = to_ns(jc.get_report_time());
+        next.device_time_ns = to_ns(jc.get_device_time());
+        next.buttons = report[3] | (report[4] << 8) | (report[5] << 16);
+        next.product_id = jc.get_product_id();
+        next.battery_level = static_cast<uint8_t>(status.battery.level);
+        next.battery_charging = static_cast<uint8_t>(status.battery.charging);
+        next.sticks[0] = status.analog_sticks.left.horizontal;
+        next.sticks[1] = status.analog_sticks.left.vertical;
+        next.sticks[2] = status.analog_sticks.right.horizontal;
+        next.sticks[3] = status.analog_sticks.right.vertical;
+        next.accel[0] = status.accel.x;
+        next.accel[1] = status.accel.y;
+        next.accel[2] = status.accel.z;
+        next.gyro[0] = status.gyro.x;
+        next.gyro[1] = status.gyro.y;
+        next.gyro[2] = status.gyro.z;
+
+        // Only this thread writes snapshot, reading it here needs no seqlock
+        uint32_t previous = snapshot.buttons;
+        bool first = snapshot.report_count == 0;
+        next.report_count = snapshot.report_count + 1;
+
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        snapshot = next;
+        sequence.store(seq + 2, std::memory_order_release);
+
+        if (first || next.buttons == previous) return;
+        uint64_t tail = event_tail.load(std::memory_order_relaxed);
+        if (tail - event_head.load(std::memory_order_acquire) >= EVENT_CAPACITY) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        joycon_event& event = events[tail % EVENT_CAPACITY];
+        event.host_time_ns = next.host_time_ns;
+        event.buttons = next.buttons;
+        event.pressed = next.buttons & ~previous;
+        event.released = previous & ~next.buttons;
+        event_tail.store(tail + 1, std::memory_order_release);
+    }
+
+    void read_snapshot(joycon_snapshot& out) const {
+        while (true) {
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1) continue;
+            out = snapshot;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before) return;
+        }
+    }
+};
+
+static_assert(sizeof(joycon_snapshot) == 72, "joycon_snapshot layout is part of the ABI");
+static_assert(sizeof(joycon_event) == 24, "joycon_event layout is part of the ABI");
+
+extern "C" {
+
+uint32_t joycon_api_version(void) {
+    return JOYCON_C_API_VERSION;
+}
+
+joycon_result joycon_open(uint16_t product_id, const wchar_t* serial, joycon_handle** out_handle) {
+    if (!out_handle) {
+        return fail(JOYCON_ERROR_INVALID_ARGUMENT, "out_handle is NULL");
+    }
+    *out_handle = nullptr;
+    if (JOYCON_PRODUCT_IDS.count(product_id) == 0) {
+        return fail(JOYCON_ERROR_INVALID_ARGUMENT, "not a supported product id");
+    }
+    std::unique_ptr<joycon_handle> handle;
+    joycon_result result = guarded([&] {
+        handle = std::make_unique<joycon_handle>();
+        handle->joycon = std::make_unique<JoyCon>(JOYCON_VENDOR_ID, product_id, serial ? std::wstring(serial) : std::wstring());
+        joycon_handle* h = handle.get();
+        h->hook_id = h->joycon->register_update_hook([h](JoyCon& jc) { h->on_report(jc); });
+    });
+    // The constructor throws runtime_error when no device matches
+    if (result == JOYCON_ERROR_IO) {
+        result = JOYCON_ERROR_NOT_FOUND;
+    }
+    if (result == JOYCON_OK) {
+        *out_handle = handle.release();
+    }
+    return result;
+}
+
+void joycon_close(joycon_handle* handle) {
+    if (!handle) return;
+    handle->joycon->unregister_update_hook(handle->hook_id);
+    delete handle;
+}
+
+joycon_result joycon_poll_many(joycon_handle* const* handles, size_t count, joycon_snapshot* out_snapshots) {
+    if (count > 0 && (!handles || !out_snapshots)) {
+        return fail(JOYCON_ERROR_INVALID_ARGUMENT, "handles or out_snapshots is NULL");
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (!handles[i]) {
+            return fail(JOYCON_ERROR_INVALID_ARGUMENT, "NULL handle");
+        }
+        handles[i]->read_snapshot(out_snapshots[i]);
+    }
+    last_error.clear();
+    return JOYCON_OK;
+}
+
+size_t joycon_drain_events(joycon_handle* const* handles, size_t count, joycon_event* out_events, size_t max) {
+    if (!handles || !out_events) return 0;
+    size_t written = 0;
+    for (size_t i = 0; i < count && written < max; ++i) {
+        joycon_handle* h = handles[i];
+        if (!h) continue;
+        uint64_t head = h->event_head.load(std::memory_order_relaxed);
+        uint64_t tail = h->event_tail.load(std::memory_order_acquire);
+        while (head < tail && written < max) {
+            joycon_event& event = out_events[written++];
+            event = h->events[head % EVENT_CAPACITY];
+            event.handle_index = static_cast<uint32_t>(i);
+            head++;
+        }
+        h->event_head.store(head, std::memory_order_release);
+    }
+    return written;
+}
+
+uint64_t joycon_dropped_events(const joycon_handle* handle) {
+    return handle ? handle->dropped.load(std::memory_order_relaxed) : 0;
+}
+
+joycon_result joycon_set_player_lamp(joycon_handle* handle, int player_number) {
+    if (!handle) {
+        return fail(JOYCON_ERROR_INVALID_ARGUMENT, "NULL handle");
+    }
+    return guarded([&] { handle->joycon->set_player_lamp(player_number); });
+}
+
+joycon_result joycon_status_offset(joycon_handle* handle) {
+    if (!handle) {
+        return fail(JOYCON_ERROR_INVALID_ARGUMENT, "NULL handle");
+    }
+    return guarded([&] { handle->joycon->status_offset(); });
+}
+
+const char* joycon_last_error(void) {
+    return last_error.c_str();
+}
+
+}
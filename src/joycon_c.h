@@ -0,0 +1,90 @@
+// joycon_c.h
+// Stable C interface for embedding and language bindings. Plain C types
+// only, controllers are opaque handles. Each handle decodes every report
+// once on its input thread into a snapshot; joycon_poll_many() copies the
+// snapshots of many controllers in one call without taking any lock.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+// Exported from the joycon_c shared library. Define JOYCON_C_STATIC when
+// compiling joycon_c.cpp straight into a program instead.
+#if defined(JOYCON_C_STATIC)
+#define JOYCON_C_API
+#elif defined(_WIN32)
+#if defined(JOYCON_C_BUILD)
+#define JOYCON_C_API __declspec(dllexport)
+#else
+#define JOYCON_C_API __declspec(dllimport)
+#endif
+#else
+#define JOYCON_C_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JOYCON_C_API_VERSION 1
+
+typedef struct joycon_handle joycon_handle;
+
+typedef enum joycon_result {
+    JOYCON_OK = 0,
+    JOYCON_ERROR_INVALID_ARGUMENT = -1,
+    JOYCON_ERROR_NOT_FOUND = -2,    // no matching device, or it failed to open
+    JOYCON_ERROR_IO = -3,           // the device stopped answering
+    JOYCON_ERROR_UNKNOWN = -4
+} joycon_result;
+
+// Decoded state of the last report. buttons holds report bytes 3..5
+// (byte 3 in bits 0-7), the same layout as the shared-memory region.
+typedef struct joycon_snapshot {
+    uint64_t report_count;      // 0 until the first report
+    int64_t host_time_ns;       // steady_clock time the report was received
+    int64_t device_time_ns;     // report tick on the synchronized device clock
+    uint32_t buttons;
+    uint16_t product_id;
+    uint8_t battery_level;
+    uint8_t battery_charging;
+    int32_t sticks[4];          // left h/v, right h/v, status offset applied
+    float accel[3];
+    float gyro[3];              // status offset applied
+} joycon_snapshot;
+
+// Button change between two consecutive reports
+typedef struct joycon_event {
+    int64_t host_time_ns;
+    uint32_t handle_index;      // index into the handles passed to joycon_drain_events()
+    uint32_t buttons;           // state after the change
+    uint32_t pressed;           // bits that went down
+    uint32_t released;          // bits that went up
+} joycon_event;
+
+JOYCON_C_API uint32_t joycon_api_version(void);
+
+// Opens the controller with the given product id (0x2006 Joy-Con L,
+// 0x2007 Joy-Con R, 0x2009 Pro Controller, 0x200E charging grip).
+// serial may be NULL to take the first one found.
+JOYCON_C_API joycon_result joycon_open(uint16_t product_id, const wchar_t* serial, joycon_handle** out_handle);
+JOYCON_C_API void joycon_close(joycon_handle* handle);
+
+// Fills out_snapshots[i] for handles[i], i < count
+JOYCON_C_API joycon_result joycon_poll_many(joycon_handle* const* handles, size_t count, joycon_snapshot* out_snapshots);
+
+// Moves up to max queued events of all handles into out_events, handle by
+// handle and oldest first within a handle. Returns the number written.
+// Each handle queues up to 256 events, further ones are counted as dropped.
+JOYCON_C_API size_t joycon_drain_events(joycon_handle* const* handles, size_t count, joycon_event* out_events, size_t max);
+JOYCON_C_API uint64_t joycon_dropped_events(const joycon_handle* handle);
+
+JOYCON_C_API joycon_result joycon_set_player_lamp(joycon_handle* handle, int player_number);
+JOYCON_C_API joycon_result joycon_status_offset(joycon_handle* handle);
+
+// Message of the last error on the calling thread, "" if none
+JOYCON_C_API const char* joycon_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,162 @@
+#include "joycon_coro.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    constexpr size_t SPI_CHUNK_SIZE = 0x1D;
+
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    Detached run_detached(joycon_coro::Task<void> task) {
+        co_await std::move(task);
+    }
+}
+
+namespace joycon_coro {
+
+void QueueExecutor::post(std::coroutine_handle<> handle) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(handle);
+    }
+    cv_.notify_one();
+}
+
+size_t QueueExecutor::run_pending() {
+    std::deque<std::coroutine_handle<>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready.swap(queue_);
+    }
+    // Coroutines posted while these run wait for the next call
+    for (auto handle : ready) {
+        handle.resume();
+    }
+    return ready.size();
+}
+
+bool QueueExecutor::wait_for(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, timeout, [this] { return !queue_.empty(); });
+}
+
+void spawn(Executor& executor, Task<void> task) {
+    executor.post(run_detached(std::move(task)).handle);
+}
+
+}
+
+AsyncJoyCon::AsyncJoyCon(JoyCon& joycon, joycon_coro::Executor& executor)
+    : joycon_(joycon),
+      executor_(executor),
+      buttons_(0),
+      have_buttons_(false)
+{
+    hook_id_ = joycon_.register_update_hook([this](JoyCon& jc) { on_report(jc); });
+}
+
+AsyncJoyCon::~AsyncJoyCon() {
+    joycon_.unregister_update_hook(hook_id_);
+}
+
+AsyncJoyCon::ReportAwaiter AsyncJoyCon::next_report() {
+    return ReportAwaiter(*this);
+}
+
+AsyncJoyCon::ButtonAwaiter AsyncJoyCon::button_event(uint32_t mask) {
+    return ButtonAwaiter(*this, mask);
+}
+
+AsyncJoyCon::SpiAwaiter AsyncJoyCon::spi_request(uint32_t address, uint8_t size, std::chrono::milliseconds timeout) {
+    return SpiAwaiter(*this, address, size, timeout);
+}
+
+joycon_coro::Task<std::vector<uint8_t>> AsyncJoyCon::spi_read(uint32_t address, size_t size, std::chrono::milliseconds timeout) {
+    std::vector<uint8_t> result;
+    result.reserve(size);
+    for (size_t offset = 0; offset < size; offset += SPI_CHUNK_SIZE) {
+        auto chunk = static_cast<uint8_t>(std::min(SPI_CHUNK_SIZE, size - offset));
+        auto data = co_await spi_request(static_cast<uint32_t>(address + offset), chunk, timeout);
+        result.insert(result.end(), data.begin(), data.end());
+    }
+    co_return result;
+}
+
+void AsyncJoyCon::ReportAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    std::lock_guard<std::mutex> lock(owner_.mutex_);
+    owner_.report_waiters_.push_back(this);
+}
+
+void AsyncJoyCon::ButtonAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    std::lock_guard<std::mutex> lock(owner_.mutex_);
+    owner_.button_waiters_.push_back(this);
+}
+
+void AsyncJoyCon::SpiAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    auto request = JoyCon::build_subcommand(output_report::SpiFlashRead{address_, size_});
+    // Runs on the input thread. Once the handle is posted the coroutine
+    // may resume and free this awaiter, so nothing touches it afterwards.
+    owner_.joycon_.send_subcmd_async(request, [this, handle, request](const std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE>* reply) {
+        if (!reply) {
+            error_ = "SPI read timed out";
+        } else if (!output_report::SpiFlashRead::verify_reply(request, *reply)) {
+            error_ = "SPI read reply did not verify";
+        } else {
+            auto data = reply->begin() + output_report::SpiFlashRead::REPLY_DATA;
+            data_.assign(data, data + size_);
+        }
+        owner_.executor_.post(handle);
+    }, timeout_);
+}
+
+std::vector<uint8_t> AsyncJoyCon::SpiAwaiter::await_resume() {
+    if (error_) {
+        throw std::runtime_error(error_);
+    }
+    return std::move(data_);
+}
+
+void AsyncJoyCon::on_report(JoyCon& joycon) {
+    Report report{joycon.get_input_report(), joycon.get_device_time()};
+    uint32_t buttons = report.data[3] | (report.data[4] << 8) | (report.data[5] << 16);
+    uint32_t changed = have_buttons_ ? buttons ^ buttons_ : 0;
+    buttons_ = buttons;
+    have_buttons_ = true;
+
+    std::vector<ReportAwaiter*> reports;
+    std::vector<ButtonAwaiter*> presses;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reports.swap(report_waiters_);
+        if (changed) {
+            auto split = std::stable_partition(button_waiters_.begin(), button_waiters_.end(),
+                                               [changed](const ButtonAwaiter* w) { return (w->mask_ & changed) == 0; });
+            presses.assign(split, button_waiters_.end());
+            button_waiters_.erase(split, button_waiters_.end());
+        }
+    }
+
+    for (ReportAwaiter* waiter : reports) {
+        waiter->report_ = report;
+        executor_.post(waiter->handle_);
+    }
+    for (ButtonAwaiter* waiter : presses) {
+        uint32_t mask = waiter->mask_;
+        waiter->event_.buttons = buttons;
+        waiter->event_.pressed = buttons & changed & mask;
+        waiter->event_.released = ~buttons & changed & mask;
+        waiter->event_.time = report.time;
+        executor_.post(waiter->handle_);
+    }
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "joycon.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace joycon_coro {
+
+// Where awaiting coroutines are resumed. Awaitables never resume a
+// coroutine on the input thread, they post it here.
+class Executor {
+public:
+    virtual ~Executor() = default;
+    virtual void post(std::coroutine_handle<> handle) = 0;
+};
+
+// Executor drained by the caller, e.g. once per frame from a game loop
+class QueueExecutor : public Executor {
+public:
+    void post(std::coroutine_handle<> handle) override;
+    // Resumes everything queued so far, returns how many were resumed
+    size_t run_pending();
+    // Blocks until something is queued or the timeout passes
+    bool wait_for(std::chrono::milliseconds timeout);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::coroutine_handle<>> queue_;
+};
+
+// Lazily started coroutine result. co_await runs it to completion and
+// yields its value or rethrows its exception.
+template <class T = void>
+class Task;
+
+namespace detail {
+    template <class T>
+    struct PromiseBase {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            template <class P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+                auto continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    template <class T>
+    struct Promise : PromiseBase<T> {
+        std::variant<std::monostate, T> value;
+        Task<T> get_return_object();
+        template <class U>
+        void return_value(U&& v) { value.template emplace<1>(std::forward<U>(v)); }
+        T result() {
+            if (this->error) std::rethrow_exception(this->error);
+            return std::move(std::get<1>(value));
+        }
+    };
+
+    template <>
+    struct Promise<void> : PromiseBase<void> {
+        Task<void> get_return_object();
+        void return_void() {}
+        void result() {
+            if (error) std::rethrow_exception(error);
+        }
+    };
+}
+
+template <class T>
+class Task {
+public:
+    using promise_type = detail::Promise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+        handle_.promise().continuation = continuation;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().result(); }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+    template <class T>
+    Task<T> Promise<T>::get_return_object() {
+        return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+    }
+    inline Task<void> Promise<void>::get_return_object() {
+        return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+    }
+}
+
+// Starts a task on the executor without waiting for it. The task frees
+// itself when done; an exception escaping it calls std::terminate, as for
+// std::thread.
+void spawn(Executor& executor, Task<void> task);
+
+}
+
+// Awaitable view of a JoyCon. One update hook serves every waiting
+// coroutine, so thousands of per-controller tasks need no threads of
+// their own. Must outlive the coroutines awaiting it; the executor must
+// outlive both.
+class AsyncJoyCon {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Report {
+        std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE> data;
+        clock::time_point time;     // device time of the report
+    };
+
+    // buttons holds report bytes 3..5 (byte 3 in bits 0-7), the layout of
+    // the shared-memory region and the C API
+    struct ButtonEvent {
+        uint32_t buttons = 0;       // state after the change
+        uint32_t pressed = 0;
+        uint32_t released = 0;
+        clock::time_point time;
+    };
+
+    AsyncJoyCon(JoyCon& joycon, joycon_coro::Executor& executor);
+    ~AsyncJoyCon();
+
+    AsyncJoyCon(const AsyncJoyCon&) = delete;
+    AsyncJoyCon& operator=(const AsyncJoyCon&) = delete;
+
+    JoyCon& joycon() { return joycon_; }
+
+    class ReportAwaiter;
+    class ButtonAwaiter;
+    class SpiAwaiter;
+
+    // The first report received after the await starts
+    ReportAwaiter next_report();
+    // The next change of any button in mask
+    ButtonAwaiter button_event(uint32_t mask = 0xFFFFFF);
+    // Reads any size in 0x1D-byte requests; throws std::runtime_error on a
+    // timeout or a reply that does not match the request
+    joycon_coro::Task<std::vector<uint8_t>> spi_read(uint32_t address, size_t size, std::chrono::milliseconds timeout = std::chrono::milliseconds(200));
+
+    class ReportAwaiter {
+    public:
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        Report await_resume() { return std::move(report_); }
+
+    private:
+        friend class AsyncJoyCon;
+        explicit ReportAwaiter(AsyncJoyCon& owner) : owner_(owner) {}
+        AsyncJoyCon& owner_;
+        std::coroutine_handle<> handle_;
+        Report report_{};
+    };
+
+    class ButtonAwaiter {
+    public:
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        ButtonEvent await_resume() { return event_; }
+
+    private:
+        friend class AsyncJoyCon;
+        ButtonAwaiter(AsyncJoyCon& owner, uint32_t mask) : owner_(owner), mask_(mask) {}
+        AsyncJoyCon& owner_;
+        uint32_t mask_;
+        std::coroutine_handle<> handle_;
+        ButtonEvent event_;
+    };
+
+    // One SPI read request of at most 0x1D bytes
+    class SpiAwaiter {
+    public:
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        std::vector<uint8_t> await_resume();
+
+    private:
+        friend class AsyncJoyCon;
+        SpiAwaiter(AsyncJoyCon& owner, uint32_t address, uint8_t size, std::chrono::milliseconds timeout)
+            : owner_(owner), address_(address), size_(size), timeout_(timeout) {}
+        AsyncJoyCon& owner_;
+        uint32_t address_;
+        uint8_t size_;
+        std::chrono::milliseconds timeout_;
+        std::vector<uint8_t> data_;
+        const char* error_ = nullptr;
+    };
+
+private:
+    JoyCon& joycon_;
+    joycon_coro::Executor& executor_;
+    size_t hook_id_;
+
+    std::mutex mutex_;
+    std::vector<ReportAwaiter*> report_waiters_;
+    std::vector<ButtonAwaiter*> button_waiters_;
+    uint32_t buttons_;      // input thread only
+    bool have_buttons_;     // input thread only
+
+    SpiAwaiter spi_request(uint32_t address, uint8_t size, std::chrono::milliseconds timeout);
+    void on_report(JoyCon& joycon);
+};
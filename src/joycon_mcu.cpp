@@ -0,0 +1,337 @@
+#include "joycon_mcu.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+    // First byte of the MCU part of a 0x31 report
+    constexpr uint8_t MCU_DATA_STATUS = 0x01;
+    constexpr uint8_t MCU_DATA_IR = 0x03;
+    constexpr uint8_t MCU_DATA_NFC = 0x2A;
+    constexpr uint8_t MCU_DATA_EMPTY = 0xFF;
+
+    // MCU state in status replies (byte 7 of the MCU part)
+    constexpr uint8_t MCU_STATE_STANDBY = 0x01;
+    constexpr uint8_t MCU_STATE_NFC = 0x04;
+    constexpr uint8_t MCU_STATE_IR = 0x07;
+    constexpr size_t MCU_STATE_OFFSET = 7;
+
+    // IR data: fragment number, then the fragment pixels
+    constexpr size_t IR_FRAGMENT_NUMBER_OFFSET = 3;
+    constexpr size_t IR_PIXELS_OFFSET = 10;
+
+    // NFC state: 0x09 once a tag is in range, then UID length and UID
+    constexpr uint8_t NFC_TAG_FOUND = 0x09;
+    constexpr size_t NFC_UID_LENGTH_OFFSET = 15;
+    constexpr size_t NFC_UID_OFFSET = 16;
+
+    constexpr int STATE_ATTEMPTS = 20;
+    constexpr std::chrono::milliseconds STATE_POLL_INTERVAL{50};
+}
+
+JoyConMcu::JoyConMcu(JoyCon& joycon)
+    : joycon_(joycon),
+      link_hook_id_(0),
+      mcu_state_(0),
+      state_seen_(false),
+      mode_(Mode::OFF),
+      frame_(IR_MAX_FRAME_SIZE),
+      received_count_(0),
+      max_fragment_(0),
+      next_fragment_(0),
+      last_fragment_(0),
+      width_(0),
+      height_(0),
+      frame_number_(0),
+      tag_present_(false),
+      mcu_reports_(0),
+      fragments_(0),
+      duplicate_fragments_(0),
+      missed_requests_(0),
+      frames_(0),
+      dropped_frames_(0),
+      send_errors_(0),
+      link_resets_(0),
+      ir_started_ns_(0),
+      ir_start_frames_(0)
+{
+    if (!joycon.is_right()) {
+        throw std::invalid_argument("MCU modes need a right Joy-Con");
+    }
+    joycon_.set_mcu_handler([this](const uint8_t* data, size_t size) { on_mcu_data(data, size); });
+    link_hook_id_ = joycon_.register_link_hook([this](JoyCon&, const JoyCon::LinkEvent& event) { on_link_event(event); });
+}
+
+JoyConMcu::~JoyConMcu() {
+    joycon_.unregister_link_hook(link_hook_id_);
+    bool active;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        active = mode_ != Mode::OFF;
+    }
+    if (active) {
+        try {
+            stop();
+        } catch (const std::exception&) {
+        }
+    }
+    joycon_.set_mcu_handler(nullptr);
+}
+
+void JoyConMcu::start_ir(std::function<void(const IrFrame&)> on_frame, const IrOptions& options) {
+    check_not_input_thread();
+    if (options.exposure_us > 600) throw std::invalid_argument("exposure_us must be 0-600");
+    if (options.digital_gain < 1 || options.digital_gain > 16) throw std::invalid_argument("digital_gain must be 1-16");
+
+    uint16_t width, height;
+    switch (options.resolution) {
+        case IrResolution::R320x240: width = 320; height = 240; break;
+        case IrResolution::R160x120: width = 160; height = 120; break;
+        case IrResolution::R80x60: width = 80; height = 60; break;
+        case IrResolution::R40x30: width = 40; height = 30; break;
+        default: throw std::invalid_argument("Invalid IR resolution");
+    }
+    auto max_fragment = static_cast<uint8_t>(width * height / IR_FRAGMENT_SIZE - 1);
+
+    enter_mode(output_report::McuMode::IR, MCU_STATE_IR);
+    send_subcommand(output_report::SetIrConfig{max_fragment});
+
+    // Exposure is in 1/31200 ms steps, manual exposure, then apply
+    uint16_t exposure = static_cast<uint16_t>(options.exposure_us * 31200 / 1000);
+    output_report::WriteIrRegisters registers;
+    registers.registers = {{
+        {0x00, 0x2E, static_cast<uint8_t>(options.resolution)},
+        {0x01, 0x30, static_cast<uint8_t>(exposure & 0xFF)},
+        {0x01, 0x31, static_cast<uint8_t>(exposure >> 8)},
+        {0x01, 0x32, 0x00},
+        {0x01, 0x2E, static_cast<uint8_t>((options.digital_gain & 0x0F) << 4)},
+        {0x01, 0x2F, static_cast<uint8_t>((options.digital_gain & 0xF0) >> 4)},
+        {0x00, 0x07, 0x01},
+    }};
+    registers.count = 7;
+    send_subcommand(registers);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        on_frame_ = std::move(on_frame);
+        width_ = width;
+        height_ = height;
+        max_fragment_ = max_fragment;
+        frame_number_ = 0;
+        reset_frame();
+        last_fragment_ = max_fragment;
+        mode_ = Mode::IR;
+    }
+    ir_start_frames_ = frames_.load();
+    ir_started_ns_ = std::chrono::steady_clock::now().time_since_epoch().count();
+    // Acknowledging the last fragment asks for the next frame
+    send_request(output_report::IrAck{max_fragment});
+}
+
+void JoyConMcu::start_nfc(std::function<void(const NfcTag&)> on_tag) {
+    check_not_input_thread();
+    enter_mode(output_report::McuMode::NFC, MCU_STATE_NFC);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        on_tag_ = std::move(on_tag);
+        tag_present_ = false;
+        mode_ = Mode::NFC;
+    }
+    send_request(output_report::NfcCommand{output_report::NfcCommand::START_POLLING});
+}
+
+void JoyConMcu::stop() {
+    check_not_input_thread();
+    set_mode(Mode::OFF);
+    send_subcommand(output_report::SetMcuState{output_report::McuState::SUSPEND});
+    send_subcommand(output_report::SetReportMode{output_report::ReportMode::STANDARD_FULL});
+}
+
+JoyConMcu::Stats JoyConMcu::get_stats() const {
+    Stats stats;
+    stats.mcu_reports = mcu_reports_.load(std::memory_order_relaxed);
+    stats.fragments = fragments_.load(std::memory_order_relaxed);
+    stats.duplicate_fragments = duplicate_fragments_.load(std::memory_order_relaxed);
+    stats.missed_requests = missed_requests_.load(std::memory_order_relaxed);
+    stats.frames = frames_.load(std::memory_order_relaxed);
+    stats.dropped_frames = dropped_frames_.load(std::memory_order_relaxed);
+    stats.send_errors = send_errors_.load(std::memory_order_relaxed);
+    stats.link_resets = link_resets_.load(std::memory_order_relaxed);
+    int64_t started = ir_started_ns_.load();
+    if (started != 0) {
+        auto elapsed = std::chrono::steady_clock::now() - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(started));
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        if (seconds > 0) stats.frames_per_second = (stats.frames - ir_start_frames_.load()) / seconds;
+    }
+    return stats;
+}
+
+void JoyConMcu::check_not_input_thread() const {
+    // A callback would wait for the lock it is holding, or for MCU
+    // replies only its own thread can deliver
+    if (joycon_.is_input_thread()) {
+        throw std::logic_error("JoyConMcu mode switch from an MCU callback or hook");
+    }
+}
+
+void JoyConMcu::on_mcu_data(const uint8_t* data, size_t size) {
+    // Input thread
+    std::lock_guard<std::mutex> lock(mutex_);
+    mcu_reports_.fetch_add(1, std::memory_order_relaxed);
+    switch (data[0]) {
+        case MCU_DATA_STATUS:
+            if (size > MCU_STATE_OFFSET) {
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                mcu_state_ = data[MCU_STATE_OFFSET];
+                state_seen_ = true;
+                state_cv_.notify_all();
+            }
+            break;
+        case MCU_DATA_IR:
+            if (mode_ == Mode::IR) on_ir_fragment(data, size);
+            break;
+        case MCU_DATA_NFC:
+            if (mode_ == Mode::NFC) on_nfc_state(data, size);
+            break;
+        case MCU_DATA_EMPTY:
+            // Nothing sent while waiting for an ack, repeat the last one
+            if (mode_ == Mode::IR) send_request(output_report::IrAck{last_fragment_});
+            break;
+        default:
+            break;
+    }
+}
+
+void JoyConMcu::on_link_event(const JoyCon::LinkEvent& event) {
+    // Input thread. The reopened controller has its MCU suspended and the
+    // replay sends standard reports, a mode kept here would wait for
+    // fragments and tags that never come.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (event.state == JoyCon::LinkState::CONNECTED || mode_ == Mode::OFF) {
+        return;
+    }
+    mode_ = Mode::OFF;
+    reset_frame();
+    tag_present_ = false;
+    ir_started_ns_ = 0;
+    link_resets_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void JoyConMcu::on_ir_fragment(const uint8_t* data, size_t size) {
+    uint8_t fragment = data[IR_FRAGMENT_NUMBER_OFFSET];
+    if (size < IR_PIXELS_OFFSET + IR_FRAGMENT_SIZE || fragment > max_fragment_) {
+        return;
+    }
+    fragments_.fetch_add(1, std::memory_order_relaxed);
+    last_fragment_ = fragment;
+
+    if (received_.test(fragment)) {
+        // A first fragment again means the camera gave up on the frame
+        if (fragment == 0 && received_count_ > 1) {
+            dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+            reset_frame();
+        } else {
+            duplicate_fragments_.fetch_add(1, std::memory_order_relaxed);
+            send_request(output_report::IrAck{fragment});
+            return;
+        }
+    }
+
+    std::memcpy(frame_.data() + fragment * IR_FRAGMENT_SIZE, data + IR_PIXELS_OFFSET, IR_FRAGMENT_SIZE);
+    received_.set(fragment);
+    ++received_count_;
+    while (next_fragment_ < max_fragment_ && received_.test(next_fragment_)) {
+        ++next_fragment_;
+    }
+
+    if (received_count_ == static_cast<size_t>(max_fragment_) + 1) {
+        IrFrame frame{frame_.data(), width_, height_, ++frame_number_, joycon_.get_device_time()};
+        frames_.fetch_add(1, std::memory_order_relaxed);
+        if (on_frame_) on_frame_(frame);
+        reset_frame();
+        send_request(output_report::IrAck{fragment});
+        return;
+    }
+
+    output_report::IrAck ack{fragment};
+    if (fragment > next_fragment_ && !received_.test(next_fragment_)) {
+        ack.request_missed = true;
+        ack.missed_fragment = next_fragment_;
+        missed_requests_.fetch_add(1, std::memory_order_relaxed);
+    }
+    send_request(ack);
+}
+
+void JoyConMcu::on_nfc_state(const uint8_t* data, size_t size) {
+    bool found = size > NFC_UID_OFFSET && data[MCU_STATE_OFFSET] == NFC_TAG_FOUND;
+    if (found && !tag_present_) {
+        NfcTag tag;
+        tag.uid_length = std::min<uint8_t>(data[NFC_UID_LENGTH_OFFSET], static_cast<uint8_t>(tag.uid.size()));
+        tag.uid_length = static_cast<uint8_t>(std::min<size_t>(tag.uid_length, size - NFC_UID_OFFSET));
+        std::copy_n(data + NFC_UID_OFFSET, tag.uid_length, tag.uid.begin());
+        tag.time = joycon_.get_device_time();
+        if (on_tag_) on_tag_(tag);
+    }
+    tag_present_ = found;
+    send_request(output_report::NfcCommand{output_report::NfcCommand::GET_STATUS});
+}
+
+void JoyConMcu::enter_mode(output_report::McuMode mode, uint8_t state) {
+    if (joycon_.is_simple_mode()) {
+        throw std::logic_error("MCU modes need full reports, not simple mode");
+    }
+    if (joycon_.get_transport() == Transport::USB) {
+        throw std::logic_error("MCU modes need Bluetooth, USB reports stop at 64 bytes");
+    }
+    set_mode(Mode::OFF);
+    send_subcommand(output_report::SetReportMode{output_report::ReportMode::NFC_IR});
+    send_subcommand(output_report::SetMcuState{output_report::McuState::RESUME});
+    wait_state(MCU_STATE_STANDBY);
+    send_subcommand(output_report::SetMcuMode{mode});
+    wait_state(state);
+}
+
+void JoyConMcu::wait_state(uint8_t state) {
+    for (int attempt = 0; attempt < STATE_ATTEMPTS; ++attempt) {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_seen_ = false;
+        }
+        send_request(output_report::McuStatusRequest{});
+        std::unique_lock<std::mutex> lock(state_mutex_);
+        if (state_cv_.wait_for(lock, STATE_POLL_INTERVAL, [&] { return state_seen_ && mcu_state_ == state; })) {
+            return;
+        }
+    }
+    throw std::runtime_error("MCU did not reach the requested state");
+}
+
+void JoyConMcu::set_mode(Mode mode) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    mode_ = mode;
+}
+
+void JoyConMcu::reset_frame() {
+    received_.reset();
+    received_count_ = 0;
+    next_fragment_ = 0;
+}
+
+template <class Command>
+void JoyConMcu::send_subcommand(const Command& command) {
+    auto [ack, data] = joycon_.send_subcmd_get_response(JoyCon::build_subcommand(command));
+    if (!ack) {
+        throw std::runtime_error("MCU subcommand got NACK");
+    }
+}
+
+template <class Request>
+void JoyConMcu::send_request(const Request& request) {
+    // Also used on the input thread, count failures instead of throwing
+    try {
+        joycon_.send_output_report(output_report::build_mcu_request(0, JoyCon::DEFAULT_RUMBLE_DATA, request));
+    } catch (const std::runtime_error&) {
+        send_errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "joycon.h"
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// IR sensor resolutions, as values of the resolution register
+enum class IrResolution : uint8_t {
+    R320x240 = 0x00,
+    R160x120 = 0x50,
+    R80x60 = 0x64,
+    R40x30 = 0x69,
+};
+
+struct IrOptions {
+    IrResolution resolution = IrResolution::R320x240;
+    uint16_t exposure_us = 300;     // 0-600
+    uint8_t digital_gain = 1;       // 1-16
+};
+
+// One IR image, 8-bit grayscale, row major. pixels points into the
+// reassembly buffer and is only valid during the frame callback.
+struct IrFrame {
+    const uint8_t* pixels;
+    uint16_t width;
+    uint16_t height;
+    uint32_t frame_number;
+    std::chrono::steady_clock::time_point time;
+};
+
+struct NfcTag {
+    std::array<uint8_t, 10> uid{};
+    uint8_t uid_length = 0;
+    std::chrono::steady_clock::time_point time;
+};
+
+// Drives the MCU of a right Joy-Con: switches it to 0x31 reports and into
+// IR camera or NFC mode. IR frames are reassembled straight from the input
+// thread's read buffer into one preallocated frame buffer, fragments are
+// acknowledged as they arrive and missing ones requested again. Callbacks
+// run on the input thread. A lost link drops the MCU back to OFF: the
+// controller comes back in standby with 0x30 reports, call start_ir() or
+// start_nfc() again from a link hook or after the reconnect.
+class JoyConMcu {
+public:
+    static constexpr size_t IR_FRAGMENT_SIZE = 300;
+    static constexpr size_t IR_MAX_FRAME_SIZE = 320 * 240;
+
+    explicit JoyConMcu(JoyCon& joycon);
+    ~JoyConMcu();
+
+    JoyConMcu(const JoyConMcu&) = delete;
+    JoyConMcu& operator=(const JoyConMcu&) = delete;
+
+    // on_frame and on_tag run on the input thread with the JoyCon's hook
+    // lock and this JoyConMcu's lock held. They must not call back into this JoyConMcu (start_ir,
+    // start_nfc and stop throw std::logic_error there) or make blocking
+    // JoyCon calls; hand such work to another thread.
+    void start_ir(std::function<void(const IrFrame&)> on_frame, const IrOptions& options = {});
+    // Calls on_tag once each time a tag comes into range
+    void start_nfc(std::function<void(const NfcTag&)> on_tag);
+    // Back to standby and standard 0x30 reports
+    void stop();
+
+    struct Stats {
+        uint64_t mcu_reports = 0;
+        uint64_t fragments = 0;
+        uint64_t duplicate_fragments = 0;
+        uint64_t missed_requests = 0;   // retransmissions asked for
+        uint64_t frames = 0;
+        uint64_t dropped_frames = 0;    // abandoned with fragments missing
+        uint64_t send_errors = 0;
+        uint64_t link_resets = 0;       // IR or NFC mode ended by a lost link
+        double frames_per_second = 0.0; // since start_ir()
+    };
+    Stats get_stats() const;
+
+private:
+    enum class Mode { OFF, IR, NFC };
+
+    JoyCon& joycon_;
+    size_t link_hook_id_;
+
+    // MCU state from status replies, for the blocking mode switches
+    std::mutex state_mutex_;
+    std::condition_variable state_cv_;
+    uint8_t mcu_state_;
+    bool state_seen_;
+
+    // Everything below is used on the input thread and only changed with
+    // mutex_ held
+    std::mutex mutex_;
+    Mode mode_;
+    std::function<void(const IrFrame&)> on_frame_;
+    std::function<void(const NfcTag&)> on_tag_;
+    std::vector<uint8_t> frame_;
+    std::bitset<256> received_;
+    size_t received_count_;
+    uint8_t max_fragment_;
+    uint8_t next_fragment_;
+    uint8_t last_fragment_;
+    uint16_t width_;
+    uint16_t height_;
+    uint32_t frame_number_;
+    bool tag_present_;
+
+    std::atomic<uint64_t> mcu_reports_;
+    std::atomic<uint64_t> fragments_;
+    std::atomic<uint64_t> duplicate_fragments_;
+    std::atomic<uint64_t> missed_requests_;
+    std::atomic<uint64_t> frames_;
+    std::atomic<uint64_t> dropped_frames_;
+    std::atomic<uint64_t> send_errors_;
+    std::atomic<uint64_t> link_resets_;
+    std::atomic<int64_t> ir_started_ns_;
+    std::atomic<uint64_t> ir_start_frames_;
+
+    void check_not_input_thread() const;
+    void on_mcu_data(const uint8_t* data, size_t size);
+    void on_link_event(const JoyCon::LinkEvent& event);
+    void on_ir_fragment(const uint8_t* data, size_t size);
+    void on_nfc_state(const uint8_t* data, size_t size);
+    void enter_mode(output_report::McuMode mode, uint8_t state);
+    void wait_state(uint8_t state);
+    void set_mode(Mode mode);
+    void reset_frame();
+    template <class Command>
+    void send_subcommand(const Command& command);
+    template <class Request>
+    void send_request(const Request& request);
+};
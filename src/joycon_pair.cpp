@@ -0,0 +1,179 @@
+#include "joycon_pair.h"
+#include <algorithm>
+
+JoyConPair::JoyConPair(JoyCon& left, JoyCon& right,
+                       std::chrono::microseconds merge_window,
+                       std::chrono::microseconds timeout)
+    : left_(left),
+      right_(right),
+      merge_window_(merge_window),
+      timeout_(timeout),
+      running_(true),
+      sequence_(0),
+      delivering_(false),
+      next_hook_id_(0)
+{
+    if (!left.is_left()) {
+        throw std::invalid_argument("left JoyCon is not a left Joy-Con");
+    }
+    if (!right.is_right()) {
+        throw std::invalid_argument("right JoyCon is not a right Joy-Con");
+    }
+
+    timeout_thread_ = std::thread(&JoyConPair::timeout_loop, this);
+    left_hook_id_ = left_.register_update_hook([this](JoyCon& jc) { on_report(0, jc); });
+    right_hook_id_ = right_.register_update_hook([this](JoyCon& jc) { on_report(1, jc); });
+}
+
+JoyConPair::~JoyConPair() {
+    left_.unregister_update_hook(left_hook_id_);
+    right_.unregister_update_hook(right_hook_id_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_one();
+    if (timeout_thread_.joinable()) {
+        timeout_thread_.join();
+    }
+}
+
+size_t JoyConPair::register_update_hook(std::function<void(JoyConPair&)> callback) {
+    std::lock_guard<std::mutex> lock(hooks_mutex_);
+    size_t id = next_hook_id_++;
+    hooks_.emplace_back(id, std::move(callback));
+    return id;
+}
+
+void JoyConPair::unregister_update_hook(size_t hook_id) {
+    std::lock_guard<std::mutex> lock(hooks_mutex_);
+    hooks_.erase(std::remove_if(hooks_.begin(), hooks_.end(),
+        [hook_id](const auto& hook) { return hook.first == hook_id; }), hooks_.end());
+}
+
+JoyConPair::Status JoyConPair::get_status() const {
+    std::lock_guard<std::mutex> lock(status_mutex_);
+    return status_;
+}
+
+void JoyConPair::on_report(int side, JoyCon& joycon) {
+    JoyCon::Status status = joycon.get_status();
+    clock::time_point aligned = joycon.get_device_time();
+    clock::time_point received = joycon.get_report_time();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Half& half = halves_[side];
+        Half& other = halves_[1 - side];
+
+        // The other half of the previous tick never came, don't hold this side back
+        if (half.pending) {
+            publish(side == 0, side == 1);
+        }
+
+        half.aligned = aligned;
+        half.arrived = received;
+        half.status = status;
+        half.pending = true;
+
+        bool merged = false;
+        if (other.pending) {
+            auto gap = half.aligned - other.aligned;
+            if (gap < gap.zero()) gap = -gap;
+            if (gap <= merge_window_) {
+                publish(true, true);
+                merged = true;
+            } else if (other.aligned < half.aligned) {
+                // Too far apart to be the same tick, flush the older one alone
+                publish(side == 1, side == 0);
+            } else {
+                publish(side == 0, side == 1);
+                merged = true;
+            }
+        }
+        if (!merged) {
+            cv_.notify_one();
+        }
+    }
+    deliver();
+}
+
+void JoyConPair::publish(bool left_fresh, bool right_fresh) {
+    Half& l = halves_[0];
+    Half& r = halves_[1];
+
+    Status s;
+    s.buttons.left = l.status.buttons.left;
+    s.buttons.right = r.status.buttons.right;
+    s.analog_sticks.left = l.status.analog_sticks.left;
+    s.analog_sticks.right = r.status.analog_sticks.right;
+    s.left = {l.status.battery, l.status.accel, l.status.gyro, l.aligned, !left_fresh};
+    s.right = {r.status.battery, r.status.accel, r.status.gyro, r.aligned, !right_fresh};
+    if (left_fresh && right_fresh) {
+        s.timestamp = std::max(l.aligned, r.aligned);
+    } else {
+        s.timestamp = left_fresh ? l.aligned : r.aligned;
+    }
+    s.sequence = ++sequence_;
+
+    if (left_fresh) l.pending = false;
+    if (right_fresh) r.pending = false;
+
+    // mutex_ held, the caller delivers once it is released
+    published_.push_back(s);
+}
+
+void JoyConPair::deliver() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (delivering_) {
+        // The delivering thread picks the queued ticks up before it stops
+        return;
+    }
+    delivering_ = true;
+    while (!published_.empty()) {
+        Status s = published_.front();
+        published_.pop_front();
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> status_lock(status_mutex_);
+            status_ = s;
+        }
+        try {
+            std::lock_guard<std::mutex> hooks_lock(hooks_mutex_);
+            for (auto& [id, cb] : hooks_) {
+                cb(*this);
+            }
+        } catch (...) {
+            lock.lock();
+            delivering_ = false;
+            throw;
+        }
+        lock.lock();
+    }
+    delivering_ = false;
+}
+
+void JoyConPair::timeout_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        clock::time_point deadline = clock::time_point::max();
+        for (const Half& half : halves_) {
+            if (half.pending) deadline = std::min(deadline, half.arrived + timeout_);
+        }
+        if (deadline == clock::time_point::max()) {
+            cv_.wait(lock);
+            continue;
+        }
+        if (cv_.wait_until(lock, deadline) == std::cv_status::timeout) {
+            auto now = clock::now();
+            bool left_expired = halves_[0].pending && halves_[0].arrived + timeout_ <= now;
+            bool right_expired = halves_[1].pending && halves_[1].arrived + timeout_ <= now;
+            if (left_expired || right_expired) {
+                publish(left_expired, right_expired);
+                lock.unlock();
+                deliver();
+                lock.lock();
+            }
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "joycon.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fuses a left and a right JoyCon into one virtual dual controller.
+// Reports from both sides are aligned on a common timeline (each side's
+// device timer synchronized to the host clock) and merged as soon as both halves
+// of a tick arrived, or after the timeout with the last known other half.
+class JoyConPair {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::microseconds DEFAULT_MERGE_WINDOW{7500};
+    static constexpr std::chrono::microseconds DEFAULT_TIMEOUT{15000};
+
+    JoyConPair(JoyCon& left, JoyCon& right,
+               std::chrono::microseconds merge_window = DEFAULT_MERGE_WINDOW,
+               std::chrono::microseconds timeout = DEFAULT_TIMEOUT);
+    ~JoyConPair();
+
+    JoyConPair(const JoyConPair&) = delete;
+    JoyConPair& operator=(const JoyConPair&) = delete;
+
+    // Register merged-state hook, called once per tick in sequence order,
+    // with get_status() returning that tick. Runs on whichever thread
+    // completed a tick (a JoyCon input thread or the timeout thread), after
+    // the pair's state lock is released; a tick completed while another
+    // thread is delivering is handed to that thread instead of waiting.
+    // Being on an input thread, the JoyCon hook rules apply. Must not
+    // register or unregister pair hooks from inside a hook.
+    size_t register_update_hook(std::function<void(JoyConPair&)> callback);
+    void unregister_update_hook(size_t hook_id);
+
+    struct Status {
+        JoyCon::Status::Buttons buttons;
+        JoyCon::Status::AnalogSticks analog_sticks;
+        struct Side {
+            JoyCon::Status::Battery battery{};
+            JoyCon::Status::Accel accel;
+            JoyCon::Status::Gyro gyro;
+            clock::time_point timestamp;  // aligned time of this half
+            bool stale = true;            // true if this half did not arrive for the tick
+        } left, right;
+        clock::time_point timestamp;      // aligned time of the tick
+        uint64_t sequence = 0;
+    };
+    Status get_status() const;
+
+    JoyCon& left() { return left_; }
+    JoyCon& right() { return right_; }
+
+private:
+    // Per-side state, aligned is the report tick on the host clock as
+    // given by the side's DeviceClock
+    struct Half {
+        JoyCon::Status status{};
+        clock::time_point aligned;
+        clock::time_point arrived;
+        bool pending = false;
+    };
+
+    JoyCon& left_;
+    JoyCon& right_;
+    std::chrono::microseconds merge_window_;
+    std::chrono::microseconds timeout_;
+
+    size_t left_hook_id_;
+    size_t right_hook_id_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool running_;
+    Half halves_[2];
+    uint64_t sequence_;
+    // Ticks published but not yet handed to the hooks, and whether a
+    // thread is handing them over
+    std::deque<Status> published_;
+    bool delivering_;
+
+    // Held while hooks run
+    std::mutex hooks_mutex_;
+    std::vector<std::pair<size_t, std::function<void(JoyConPair&)>>> hooks_;
+    size_t next_hook_id_;
+
+    mutable std::mutex status_mutex_;
+    Status status_;
+
+    std::thread timeout_thread_;
+
+    void on_report(int side, JoyCon& joycon);
+    void publish(bool left_fresh, bool right_fresh);
+    void deliver();
+    void timeout_loop();
+};
@@ -0,0 +1,360 @@
+// output_report.h
+// Compile-time described Joy-Con output reports. Every command builds into
+// a fixed-size std::array, so sending one never allocates.
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+namespace output_report {
+
+constexpr size_t OUTPUT_REPORT_SIZE = 49;
+constexpr size_t RUMBLE_SIZE = 8;
+using Rumble = std::array<uint8_t, RUMBLE_SIZE>;
+
+constexpr uint8_t RUMBLE_AND_SUBCOMMAND = 0x01;
+constexpr uint8_t RUMBLE_ONLY = 0x10;
+constexpr uint8_t MCU_REQUEST = 0x11;
+// USB only: wired mode commands, answered by report 0x81 echoing the command
+constexpr uint8_t USB_COMMAND = 0x80;
+constexpr uint8_t USB_REPLY = 0x81;
+
+struct Report {
+    std::array<uint8_t, OUTPUT_REPORT_SIZE> data{};
+    size_t size = 0;
+
+    constexpr uint8_t subcommand() const { return data[10]; }
+};
+
+enum class ReportMode : uint8_t {
+    STANDARD_FULL = 0x30,
+    NFC_IR = 0x31,
+    SIMPLE_HID = 0x3F,
+};
+
+enum class UsbCommand : uint8_t {
+    STATUS = 0x01,          // reply carries the controller type and MAC
+    HANDSHAKE = 0x02,
+    BAUDRATE_3M = 0x03,     // controller UART to 3 Mbit, needs a new handshake
+    NO_TIMEOUT = 0x04,      // HID only over USB, no reply
+    ENABLE_TIMEOUT = 0x05,  // lets the controller time out and go back to Bluetooth
+};
+
+enum class McuState : uint8_t {
+    SUSPEND = 0x00,
+    RESUME = 0x01,
+    RESUME_FOR_UPDATE = 0x02,
+};
+
+enum class McuMode : uint8_t {
+    STANDBY = 0x01,
+    NFC = 0x04,
+    IR = 0x05,
+};
+
+// CRC-8 (polynomial 0x07) the MCU expects on its configuration packets
+constexpr uint8_t mcu_crc8(const uint8_t* data, size_t size) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Subcommands. Each one has its id and writes its own arguments.
+// Reply: firmware version, controller type (1 L, 2 R, 3 Pro), MAC address
+struct RequestDeviceInfo {
+    static constexpr uint8_t ID = 0x02;
+    constexpr size_t write_args(uint8_t*) const { return 0; }
+};
+
+struct SetReportMode {
+    static constexpr uint8_t ID = 0x03;
+    ReportMode mode;
+    constexpr size_t write_args(uint8_t* out) const { out[0] = static_cast<uint8_t>(mode); return 1; }
+};
+
+struct SetHciState {
+    static constexpr uint8_t ID = 0x06;
+    uint8_t state = 0x00;   // 0x00 disconnects
+    constexpr size_t write_args(uint8_t* out) const { out[0] = state; return 1; }
+};
+
+struct SpiFlashRead {
+    static constexpr uint8_t ID = 0x10;
+    // 0x21 reply: ack, subcommand, address and size echoed, then the data
+    static constexpr size_t REPLY_ACK = 13;
+    static constexpr size_t REPLY_ARGS = 15;
+    static constexpr size_t REPLY_DATA = 20;
+    static constexpr uint8_t ACK = 0x90;
+    uint32_t address;
+    uint8_t size;
+    constexpr size_t write_args(uint8_t* out) const {
+        for (int i = 0; i < 4; ++i) out[i] = (address >> (8 * i)) & 0xFF;
+        out[4] = size;
+        return 5;
+    }
+    // The reply is for this request: acknowledged with data, same address
+    // and size; the data starts at REPLY_DATA
+    template <size_t N>
+    static constexpr bool verify_reply(const Report& request, const std::array<uint8_t, N>& reply) {
+        static_assert(N > REPLY_DATA);
+        return reply[REPLY_ACK] == ACK && reply[REPLY_ACK + 1] == ID
+            && std::equal(request.data.begin() + 11, request.data.begin() + 16, reply.begin() + REPLY_ARGS);
+    }
+};
+
+struct SpiFlashWrite {
+    static constexpr uint8_t ID = 0x11;
+    static constexpr size_t MAX_SIZE = 0x1D;
+    uint32_t address;
+    uint8_t size;
+    std::array<uint8_t, MAX_SIZE> data{};
+    constexpr size_t write_args(uint8_t* out) const {
+        // One report carries at most MAX_SIZE bytes
+        if (size > MAX_SIZE) throw std::invalid_argument("SPI write larger than one report");
+        for (int i = 0; i < 4; ++i) out[i] = (address >> (8 * i)) & 0xFF;
+        out[4] = size;
+        for (size_t i = 0; i < size; ++i) out[5 + i] = data[i];
+        return 5 + size;
+    }
+};
+
+struct SetMcuState {
+    static constexpr uint8_t ID = 0x22;
+    McuState state;
+    constexpr size_t write_args(uint8_t* out) const { out[0] = static_cast<uint8_t>(state); return 1; }
+};
+
+struct SetPlayerLights {
+    static constexpr uint8_t ID = 0x30;
+    uint8_t pattern;        // low nibble: on, high nibble: flashing
+    constexpr size_t write_args(uint8_t* out) const { out[0] = pattern; return 1; }
+};
+
+struct EnableImu {
+    static constexpr uint8_t ID = 0x40;
+    bool enable;
+    constexpr size_t write_args(uint8_t* out) const { out[0] = enable ? 0x01 : 0x00; return 1; }
+};
+
+struct ImuConfig {
+    static constexpr uint8_t ID = 0x41;
+    uint8_t gyro_sensitivity = 0x03;    // 2000 dps
+    uint8_t accel_sensitivity = 0x00;   // 8 G
+    uint8_t gyro_performance = 0x01;    // 208 Hz
+    uint8_t accel_filter = 0x01;        // 100 Hz anti-aliasing
+    constexpr size_t write_args(uint8_t* out) const {
+        out[0] = gyro_sensitivity;
+        out[1] = accel_sensitivity;
+        out[2] = gyro_performance;
+        out[3] = accel_filter;
+        return 4;
+    }
+};
+
+// MCU configuration shares subcommand 0x21, the first argument selects what
+// is configured. Arguments run to the end of the report, CRC in the last byte.
+struct SetMcuMode {
+    static constexpr uint8_t ID = 0x21;
+    McuMode mode;
+    constexpr size_t write_args(uint8_t* out) const {
+        out[0] = 0x21;
+        out[1] = 0x00;
+        out[2] = static_cast<uint8_t>(mode);
+        for (size_t i = 3; i < 37; ++i) out[i] = 0;
+        out[37] = mcu_crc8(out + 1, 36);
+        return 38;
+    }
+};
+
+struct SetIrConfig {
+    static constexpr uint8_t ID = 0x21;
+    uint8_t max_fragment;           // last fragment number of a frame
+    constexpr size_t write_args(uint8_t* out) const {
+        out[0] = 0x23;
+        out[1] = 0x01;
+        out[2] = 0x07;              // image transfer mode
+        out[3] = max_fragment;
+        out[4] = 0x00;              // required MCU firmware 5.0
+        out[5] = 0x05;
+        for (size_t i = 6; i < 37; ++i) out[i] = 0;
+        out[37] = mcu_crc8(out + 1, 36);
+        return 38;
+    }
+};
+
+struct IrRegister {
+    uint8_t page;
+    uint8_t address;
+    uint8_t value;
+};
+
+struct WriteIrRegisters {
+    static constexpr uint8_t ID = 0x21;
+    static constexpr size_t MAX_REGISTERS = 9;
+    std::array<IrRegister, MAX_REGISTERS> registers{};
+    uint8_t count = 0;
+    constexpr size_t write_args(uint8_t* out) const {
+        out[0] = 0x23;
+        out[1] = 0x04;
+        out[2] = count;
+        for (size_t i = 3; i < 37; ++i) out[i] = 0;
+        for (size_t i = 0; i < count && i < MAX_REGISTERS; ++i) {
+            out[3 + 3 * i] = registers[i].page;
+            out[4 + 3 * i] = registers[i].address;
+            out[5 + 3 * i] = registers[i].value;
+        }
+        out[37] = mcu_crc8(out + 1, 36);
+        return 38;
+    }
+};
+
+struct EnableVibration {
+    static constexpr uint8_t ID = 0x48;
+    bool enable;
+    constexpr size_t write_args(uint8_t* out) const { out[0] = enable ? 0x01 : 0x00; return 1; }
+};
+
+template <class Command>
+constexpr Report build_subcommand(uint8_t packet_number, const Rumble& rumble, const Command& command) {
+    Report report;
+    report.data[0] = RUMBLE_AND_SUBCOMMAND;
+    report.data[1] = packet_number & 0xF;
+    for (size_t i = 0; i < RUMBLE_SIZE; ++i) report.data[2 + i] = rumble[i];
+    report.data[10] = Command::ID;
+    report.size = 11 + command.write_args(report.data.data() + 11);
+    return report;
+}
+
+constexpr Report build_rumble(uint8_t packet_number, const Rumble& rumble) {
+    Report report;
+    report.data[0] = RUMBLE_ONLY;
+    report.data[1] = packet_number & 0xF;
+    for (size_t i = 0; i < RUMBLE_SIZE; ++i) report.data[2 + i] = rumble[i];
+    report.size = 2 + RUMBLE_SIZE;
+    return report;
+}
+
+// Sent as is, without packet number or rumble
+constexpr Report build_usb_command(UsbCommand command) {
+    Report report;
+    report.data[0] = USB_COMMAND;
+    report.data[1] = static_cast<uint8_t>(command);
+    report.size = 2;
+    return report;
+}
+
+// MCU requests, sent in 0x11 reports. Same framing as subcommands, always
+// full size with a CRC of the arguments in the last byte.
+struct McuStatusRequest {
+    static constexpr uint8_t ID = 0x01;
+    constexpr size_t write_args(uint8_t*) const { return 0; }
+};
+
+struct NfcCommand {
+    static constexpr uint8_t ID = 0x02;
+    static constexpr uint8_t START_POLLING = 0x01;
+    static constexpr uint8_t STOP_POLLING = 0x02;
+    static constexpr uint8_t GET_STATUS = 0x04;
+    uint8_t command;
+    constexpr size_t write_args(uint8_t* out) const {
+        out[0] = command;
+        out[1] = 0x00;
+        out[2] = 0x00;
+        out[3] = 0x08;              // final packet
+        if (command != START_POLLING) {
+            out[4] = 0x00;
+            return 5;
+        }
+        out[4] = 0x05;              // argument length
+        out[5] = 0x00;
+        out[6] = 0xFF;              // poll until a tag shows up
+        out[7] = 0xFF;
+        out[8] = 0x00;
+        out[9] = 0x01;
+        return 10;
+    }
+};
+
+// Acknowledges an IR image fragment, optionally asking for a missed one
+struct IrAck {
+    static constexpr uint8_t ID = 0x03;
+    uint8_t fragment;
+    bool request_missed = false;
+    uint8_t missed_fragment = 0;
+    constexpr size_t write_args(uint8_t* out) const {
+        out[0] = request_missed ? 0x01 : 0x00;
+        out[1] = request_missed ? missed_fragment : 0x00;
+        out[2] = 0x00;
+        out[3] = fragment;
+        for (size_t i = 4; i < 36; ++i) out[i] = 0;
+        out[36] = 0xFF;             // acknowledgements enabled
+        return 37;
+    }
+};
+
+template <class Request>
+constexpr Report build_mcu_request(uint8_t packet_number, const Rumble& rumble, const Request& request) {
+    Report report;
+    report.data[0] = MCU_REQUEST;
+    report.data[1] = packet_number & 0xF;
+    for (size_t i = 0; i < RUMBLE_SIZE; ++i) report.data[2 + i] = rumble[i];
+    report.data[10] = Request::ID;
+    request.write_args(report.data.data() + 11);
+    report.data[OUTPUT_REPORT_SIZE - 1] = mcu_crc8(report.data.data() + 11, 36);
+    report.size = OUTPUT_REPORT_SIZE;
+    return report;
+}
+
+// Player number (1-8) to the 4-lamp pattern shown by the Switch
+constexpr uint8_t player_lamp_pattern(int player_number) {
+    switch (player_number) {
+        case 1: return 0b0001;
+        case 2: return 0b0011;
+        case 3: return 0b0111;
+        case 4: return 0b1111;
+        case 5: return 0b1001;
+        case 6: return 0b1010;
+        case 7: return 0b1011;
+        case 8: return 0b0110;
+        default: throw std::invalid_argument("Invalid player number");
+    }
+}
+
+// Builders are usable in constant expressions, hence allocation free
+static_assert(build_subcommand(1, Rumble{}, EnableImu{true}).size == 12);
+static_assert(build_subcommand(1, Rumble{}, SpiFlashRead{0x6020, 24}).data[12] == 0x60);
+static_assert([] {
+    auto request = build_subcommand(1, Rumble{}, SpiFlashRead{0x6020, 24});
+    std::array<uint8_t, 49> reply{};
+    reply[SpiFlashRead::REPLY_ACK] = SpiFlashRead::ACK;
+    reply[SpiFlashRead::REPLY_ACK + 1] = SpiFlashRead::ID;
+    std::copy_n(request.data.begin() + 11, 5, reply.begin() + SpiFlashRead::REPLY_ARGS);
+    bool valid = SpiFlashRead::verify_reply(request, reply);
+    reply[SpiFlashRead::REPLY_ARGS + 4] = 23;
+    return valid && !SpiFlashRead::verify_reply(request, reply);
+}());
+static_assert(build_subcommand(17, Rumble{}, SetPlayerLights{player_lamp_pattern(2)}).data[1] == 1);
+static_assert(build_rumble(0, Rumble{}).size == 10);
+static_assert(build_subcommand(0, Rumble{}, SpiFlashWrite{0x8010, SpiFlashWrite::MAX_SIZE}).size <= OUTPUT_REPORT_SIZE);
+static_assert(build_subcommand(0, Rumble{}, SpiFlashWrite{0x8010, SpiFlashWrite::MAX_SIZE}).data[15] == SpiFlashWrite::MAX_SIZE);
+// A write that throws is not a constant expression
+template <uint8_t Size>
+constexpr bool spi_write_builds = requires {
+    typename std::integral_constant<size_t, build_subcommand(0, Rumble{}, SpiFlashWrite{0x8010, Size}).size>;
+};
+static_assert(spi_write_builds<SpiFlashWrite::MAX_SIZE>);
+static_assert(!spi_write_builds<SpiFlashWrite::MAX_SIZE + 1>);
+static_assert(!spi_write_builds<0xFF>);
+static_assert(build_subcommand(0, Rumble{}, SetMcuMode{McuMode::IR}).size == OUTPUT_REPORT_SIZE);
+static_assert(build_mcu_request(0, Rumble{}, IrAck{5}).data[14] == 5);
+static_assert(build_mcu_request(0, Rumble{}, McuStatusRequest{}).size == OUTPUT_REPORT_SIZE);
+
+}
@@ -0,0 +1,167 @@
+// report_layout.h
+// Compile-time device variants. Each variant states which halves and
+// buttons it physically has; Snapshot<V> holds only those fields and
+// decode<V>() reads only those bits, with no side checks at runtime.
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace report_layout {
+
+constexpr size_t REPORT_SIZE = 49;
+using Report = std::array<uint8_t, REPORT_SIZE>;
+
+// Controller type in the device info reply (subcommand 0x02)
+enum class DeviceType : uint8_t { LEFT = 1, RIGHT = 2, PRO = 3 };
+
+struct Left {
+    static constexpr uint16_t PRODUCT_ID = 0x2006;
+    static constexpr DeviceType DEVICE_TYPE = DeviceType::LEFT;
+    static constexpr bool HAS_LEFT = true;
+    static constexpr bool HAS_RIGHT = false;
+    static constexpr bool HAS_RAIL = true;     // SL/SR on the rail
+};
+
+struct Right {
+    static constexpr uint16_t PRODUCT_ID = 0x2007;
+    static constexpr DeviceType DEVICE_TYPE = DeviceType::RIGHT;
+    static constexpr bool HAS_LEFT = false;
+    static constexpr bool HAS_RIGHT = true;
+    static constexpr bool HAS_RAIL = true;
+};
+
+struct Pro {
+    static constexpr uint16_t PRODUCT_ID = 0x2009;
+    static constexpr DeviceType DEVICE_TYPE = DeviceType::PRO;
+    static constexpr bool HAS_LEFT = true;
+    static constexpr bool HAS_RIGHT = true;
+    static constexpr bool HAS_RAIL = false;
+};
+
+// A Joy-Con in the charging grip: one HID interface per Joy-Con, all with
+// the grip's product id, each reporting like the Joy-Con of that side
+template <class Side>
+struct ChargingGrip {
+    static constexpr uint16_t PRODUCT_ID = 0x200E;
+    static constexpr DeviceType DEVICE_TYPE = Side::DEVICE_TYPE;
+    static constexpr bool HAS_LEFT = Side::HAS_LEFT;
+    static constexpr bool HAS_RIGHT = Side::HAS_RIGHT;
+    static constexpr bool HAS_RAIL = Side::HAS_RAIL;
+};
+
+struct None {};
+
+struct RailButtons {
+    bool sr : 1;
+    bool sl : 1;
+};
+
+struct Stick {
+    int16_t horizontal = 0;
+    int16_t vertical = 0;
+};
+
+template <bool Rail>
+struct LeftHalf : std::conditional_t<Rail, RailButtons, None> {
+    Stick stick;
+    bool down : 1;
+    bool up : 1;
+    bool right : 1;
+    bool left : 1;
+    bool l : 1;
+    bool zl : 1;
+    bool minus : 1;
+    bool capture : 1;
+    bool stick_pressed : 1;
+};
+
+template <bool Rail>
+struct RightHalf : std::conditional_t<Rail, RailButtons, None> {
+    Stick stick;
+    bool y : 1;
+    bool x : 1;
+    bool b : 1;
+    bool a : 1;
+    bool r : 1;
+    bool zr : 1;
+    bool plus : 1;
+    bool home : 1;
+    bool stick_pressed : 1;
+};
+
+// Sticks are raw 12-bit counts here; TypedJoyCon subtracts the status
+// offset and fills in the calibrated IMU values.
+template <class V>
+struct Snapshot {
+    uint8_t timer = 0;
+    uint8_t battery_level = 0;
+    bool charging = false;
+    [[no_unique_address]] std::conditional_t<V::HAS_LEFT, LeftHalf<V::HAS_RAIL>, None> left{};
+    [[no_unique_address]] std::conditional_t<V::HAS_RIGHT, RightHalf<V::HAS_RAIL>, None> right{};
+    std::array<float, 3> accel{};
+    std::array<float, 3> gyro{};
+};
+
+namespace detail {
+    constexpr bool bit(const Report& r, size_t byte, int bit) { return (r[byte] >> bit) & 1; }
+
+    constexpr Stick stick(const Report& r, size_t offset) {
+        Stick s;
+        s.horizontal = static_cast<int16_t>(r[offset] | ((r[offset + 1] & 0x0F) << 8));
+        s.vertical = static_cast<int16_t>((r[offset + 1] >> 4) | (r[offset + 2] << 4));
+        return s;
+    }
+}
+
+// Decodes buttons, sticks, battery and timer of a standard (0x30/0x31)
+// report, the same bits as the JoyCon getters
+template <class V>
+constexpr Snapshot<V> decode(const Report& r) {
+    using detail::bit;
+    Snapshot<V> s;
+    s.timer = r[1];
+    s.battery_level = static_cast<uint8_t>(r[2] >> 5);
+    s.charging = bit(r, 2, 4);
+    if constexpr (V::HAS_RIGHT) {
+        s.right.stick = detail::stick(r, 9);
+        s.right.y = bit(r, 3, 0);
+        s.right.x = bit(r, 3, 1);
+        s.right.b = bit(r, 3, 2);
+        s.right.a = bit(r, 3, 3);
+        if constexpr (V::HAS_RAIL) {
+            s.right.sr = bit(r, 3, 4);
+            s.right.sl = bit(r, 3, 5);
+        }
+        s.right.r = bit(r, 3, 6);
+        s.right.zr = bit(r, 3, 7);
+        s.right.plus = bit(r, 4, 1);
+        s.right.stick_pressed = bit(r, 4, 2);
+        s.right.home = bit(r, 4, 4);
+    }
+    if constexpr (V::HAS_LEFT) {
+        s.left.stick = detail::stick(r, 6);
+        s.left.minus = bit(r, 4, 0);
+        s.left.stick_pressed = bit(r, 4, 3);
+        s.left.capture = bit(r, 4, 5);
+        s.left.down = bit(r, 5, 0);
+        s.left.up = bit(r, 5, 1);
+        s.left.right = bit(r, 5, 2);
+        s.left.left = bit(r, 5, 3);
+        if constexpr (V::HAS_RAIL) {
+            s.left.sr = bit(r, 5, 4);
+            s.left.sl = bit(r, 5, 5);
+        }
+        s.left.l = bit(r, 5, 6);
+        s.left.zl = bit(r, 5, 7);
+    }
+    return s;
+}
+
+static_assert(sizeof(Snapshot<Left>) < sizeof(Snapshot<Pro>));
+static_assert(sizeof(Snapshot<Right>) == sizeof(Snapshot<ChargingGrip<Right>>));
+static_assert(decode<Right>(Report{0x30, 0x05, 0x90, 0x08}).right.a);
+static_assert(decode<Left>(Report{0x30, 0x05, 0x90, 0x00, 0x00, 0x40}).left.l);
+
+}
@@ -0,0 +1,155 @@
+#include "resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+    int64_t to_ns(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    // Two ring entries to blend and the weight of the second one. Past
+    // the newest entry these are the last two (extrapolation), before the
+    // oldest the oldest one alone.
+    template <class Point, size_t N>
+    struct Bracket {
+        Point first{};
+        Point second{};
+        bool found = false;
+        bool extrapolate = false;
+
+        void pick(const std::array<Point, N>& ring, uint64_t count, int64_t time) {
+            found = count > 0;
+            if (!found) return;
+            uint64_t newest = count - 1;
+            uint64_t oldest = count > N ? count - N : 0;
+            uint64_t i = newest;
+            while (i > oldest && ring[i % N].time_ns > time) --i;
+            if (ring[i % N].time_ns > time) {
+                first = second = ring[i % N];
+            } else if (i < newest) {
+                first = ring[i % N];
+                second = ring[(i + 1) % N];
+            } else {
+                extrapolate = ring[i % N].time_ns < time;
+                first = i > oldest ? ring[(i - 1) % N] : ring[i % N];
+                second = ring[i % N];
+            }
+        }
+
+        float weight(int64_t time) const {
+            int64_t span = second.time_ns - first.time_ns;
+            return span > 0 ? static_cast<float>(time - first.time_ns) / span : 0.0f;
+        }
+    };
+
+    float lerp(float a, float b, float w) { return a + (b - a) * w; }
+    int lerp_int(int a, int b, float w) { return static_cast<int>(std::lround(lerp(static_cast<float>(a), static_cast<float>(b), w))); }
+}
+
+JoyConResampler::JoyConResampler(JoyCon& joycon, const ResamplerOptions& options)
+    : joycon_(joycon),
+      options_(options),
+      sequence_(0),
+      imu_count_(0),
+      input_count_(0),
+      imu_{},
+      input_{}
+{
+    if (!(options_.rate_hz > 0.0)) {
+        throw std::invalid_argument("rate_hz must be positive");
+    }
+    period_ = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / options_.rate_hz));
+    if (period_.count() <= 0) {
+        throw std::invalid_argument("rate_hz too high");
+    }
+    hook_id_ = joycon_.register_update_hook([this](JoyCon& jc) { on_report(jc); });
+}
+
+JoyConResampler::~JoyConResampler() {
+    joycon_.unregister_update_hook(hook_id_);
+}
+
+void JoyConResampler::on_report(JoyCon& joycon) {
+    JoyCon::Status status = joycon.get_status();
+    auto report = joycon.get_input_report();
+    auto times = joycon.get_sample_times();
+    auto device_time = joycon.get_device_time();
+
+    uint32_t seq = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (int i = 0; i < 3; ++i) {
+        ImuPoint& p = imu_[imu_count_ % IMU_HISTORY];
+        p.time_ns = to_ns(times[i]);
+        p.accel = {joycon.get_accel_x(report, i), joycon.get_accel_y(report, i), joycon.get_accel_z(report, i)};
+        p.gyro = {joycon.get_gyro_x(report, i) - joycon.status_offset_.gyro_x,
+                  joycon.get_gyro_y(report, i) - joycon.status_offset_.gyro_y,
+                  joycon.get_gyro_z(report, i) - joycon.status_offset_.gyro_z};
+        imu_count_++;
+    }
+    InputPoint& input = input_[input_count_ % INPUT_HISTORY];
+    input.time_ns = to_ns(device_time);
+    input.status = status;
+    input_count_++;
+
+    sequence_.store(seq + 2, std::memory_order_release);
+}
+
+JoyConResampler::Sample JoyConResampler::sample_at(clock::time_point time) const {
+    Sample sample;
+    sample.time = time;
+
+    Bracket<ImuPoint, IMU_HISTORY> imu;
+    Bracket<InputPoint, INPUT_HISTORY> input;
+    int64_t t = to_ns(time);
+    while (true) {
+        uint32_t before = sequence_.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        imu.pick(imu_, imu_count_, t);
+        input.pick(input_, input_count_, t);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == before) break;
+    }
+    if (!input.found) {
+        return sample;
+    }
+    sample.valid = true;
+
+    // Bounded lookahead: never extrapolate further than max_lookahead
+    int64_t lookahead = std::chrono::duration_cast<std::chrono::nanoseconds>(options_.max_lookahead).count();
+    int64_t imu_t = imu.extrapolate ? std::min(t, imu.second.time_ns + lookahead) : t;
+    int64_t input_t = input.extrapolate ? std::min(t, input.second.time_ns + lookahead) : t;
+    sample.extrapolated = imu.extrapolate || input.extrapolate;
+
+    // Buttons are never blended, take the latest report not after time
+    const JoyCon::Status& a = input.first.status;
+    const JoyCon::Status& b = input.second.status;
+    sample.status = input_t >= input.second.time_ns ? b : a;
+    float w = input.weight(input_t);
+    sample.status.analog_sticks.left.horizontal = lerp_int(a.analog_sticks.left.horizontal, b.analog_sticks.left.horizontal, w);
+    sample.status.analog_sticks.left.vertical = lerp_int(a.analog_sticks.left.vertical, b.analog_sticks.left.vertical, w);
+    sample.status.analog_sticks.right.horizontal = lerp_int(a.analog_sticks.right.horizontal, b.analog_sticks.right.horizontal, w);
+    sample.status.analog_sticks.right.vertical = lerp_int(a.analog_sticks.right.vertical, b.analog_sticks.right.vertical, w);
+
+    if (imu.found) {
+        float wi = imu.weight(imu_t);
+        sample.status.accel = {lerp(imu.first.accel[0], imu.second.accel[0], wi),
+                               lerp(imu.first.accel[1], imu.second.accel[1], wi),
+                               lerp(imu.first.accel[2], imu.second.accel[2], wi)};
+        sample.status.gyro = {lerp(imu.first.gyro[0], imu.second.gyro[0], wi),
+                              lerp(imu.first.gyro[1], imu.second.gyro[1], wi),
+                              lerp(imu.first.gyro[2], imu.second.gyro[2], wi)};
+    }
+    return sample;
+}
+
+JoyConResampler::Sample JoyConResampler::sample_tick(clock::time_point now) const {
+    return sample_at(tick_time(now));
+}
+
+JoyConResampler::clock::time_point JoyConResampler::tick_time(clock::time_point now) const {
+    auto since_epoch = now.time_since_epoch();
+    return clock::time_point(since_epoch - since_epoch % period_) - options_.delay;
+}
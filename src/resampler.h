@@ -0,0 +1,72 @@
+#pragma once
+
+#include "joycon.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+struct ResamplerOptions {
+    // Consumer frame rate, sample_tick() snaps to this grid
+    double rate_hz = 120.0;
+    // Shift of the timeline into the past. With a delay of about one
+    // report period queries interpolate instead of extrapolating.
+    std::chrono::microseconds delay{0};
+    // Queries further ahead of the newest sample are clamped
+    std::chrono::microseconds max_lookahead{8000};
+};
+
+// Resamples a JoyCon onto a consumer timeline. The input thread appends
+// every IMU sample (at its synchronized host time) and every report's
+// buttons and sticks to rings guarded by a seqlock; sample_at() reads them
+// lock-free from any thread and never blocks the input thread.
+class JoyConResampler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Sample {
+        clock::time_point time;
+        JoyCon::Status status;      // sticks and IMU interpolated, buttons of the latest report not after time
+        bool extrapolated = false;  // time was past the newest sample
+        bool valid = false;         // false until the first report
+    };
+
+    explicit JoyConResampler(JoyCon& joycon, const ResamplerOptions& options = {});
+    ~JoyConResampler();
+
+    JoyConResampler(const JoyConResampler&) = delete;
+    JoyConResampler& operator=(const JoyConResampler&) = delete;
+
+    Sample sample_at(clock::time_point time) const;
+    // Sample at the latest grid tick not after now, minus the delay
+    Sample sample_tick(clock::time_point now = clock::now()) const;
+    clock::time_point tick_time(clock::time_point now) const;
+
+private:
+    static constexpr size_t IMU_HISTORY = 64;
+    static constexpr size_t INPUT_HISTORY = 16;
+
+    struct ImuPoint {
+        int64_t time_ns;
+        std::array<float, 3> accel;
+        std::array<float, 3> gyro;
+    };
+    struct InputPoint {
+        int64_t time_ns;
+        JoyCon::Status status;
+    };
+
+    JoyCon& joycon_;
+    ResamplerOptions options_;
+    clock::duration period_;
+    size_t hook_id_;
+
+    // Single writer (the input thread), seqlock readers
+    std::atomic<uint32_t> sequence_;
+    uint64_t imu_count_;
+    uint64_t input_count_;
+    std::array<ImuPoint, IMU_HISTORY> imu_;
+    std::array<InputPoint, INPUT_HISTORY> input_;
+
+    void on_report(JoyCon& joycon);
+};
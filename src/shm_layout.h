@@ -0,0 +1,60 @@
+// shm_layout.h
+// Layout of the shared-memory region written by SharedMemoryPublisher.
+// Kept free of JoyCon/hidapi includes so reader processes only need this
+// file and shm_reader.h.
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace joycon_shm {
+
+constexpr uint32_t MAGIC = 0x534D434A;  // "JCMS"
+constexpr uint32_t VERSION = 1;
+constexpr size_t MAX_CONTROLLERS = 8;
+constexpr size_t HISTORY_SIZE = 32;
+constexpr size_t REPORT_SIZE = 49;
+constexpr const char* DEFAULT_NAME = "/joycon++";
+
+// Decoded state of the last report. buttons holds report bytes 3..5
+// (byte 3 in bits 0-7), bit positions follow the JoyCon button getters.
+struct ControllerState {
+    uint64_t report_count;
+    int64_t host_time_ns;       // steady_clock time the report was received
+    uint32_t buttons;
+    uint8_t battery_level;
+    uint8_t battery_charging;
+    uint8_t timer;
+    uint8_t reserved;
+    int32_t sticks[4];          // left h/v, right h/v, status offset applied
+    float accel[3];
+    float gyro[3];              // status offset applied
+};
+
+struct HistoryEntry {
+    int64_t host_time_ns;
+    uint8_t report[REPORT_SIZE];
+    uint8_t reserved[7];
+};
+
+// One seqlock per controller: the sequence is odd while the publisher
+// writes, readers retry until they see the same even value around a copy.
+struct ControllerSlot {
+    std::atomic<uint32_t> sequence;
+    uint32_t product_id;        // 0 while the slot is unused
+    ControllerState state;
+    uint64_t history_count;     // total entries ever written
+    HistoryEntry history[HISTORY_SIZE];
+};
+
+struct Region {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    ControllerSlot slots[MAX_CONTROLLERS];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock needs a lock-free sequence");
+
+}
@@ -0,0 +1,141 @@
+#if defined(__unix__) || defined(__APPLE__)
+
+#include "shm_publisher.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+static_assert(joycon_shm::REPORT_SIZE == JoyCon::INPUT_REPORT_SIZE, "history entries hold raw reports");
+
+SharedMemoryPublisher::SharedMemoryPublisher(const std::string& name)
+    : name_(name),
+      region_(nullptr)
+{
+    // Never take over a region another publisher, or a stale one left by a
+    // crashed process, still owns: its readers would see two writers
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        throw std::runtime_error("Shared memory " + name_ + " already exists, another publisher is running or it is stale (shm_unlink it)");
+    }
+    if (fd < 0) {
+        throw std::runtime_error(std::string("shm_open failed: ") + std::strerror(errno));
+    }
+    if (ftruncate(fd, sizeof(joycon_shm::Region)) < 0) {
+        int err = errno;
+        ::close(fd);
+        shm_unlink(name_.c_str());
+        throw std::runtime_error(std::string("ftruncate failed: ") + std::strerror(err));
+    }
+    void* map = mmap(nullptr, sizeof(joycon_shm::Region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(name_.c_str());
+        throw std::runtime_error(std::string("mmap failed: ") + std::strerror(errno));
+    }
+
+    std::memset(map, 0, sizeof(joycon_shm::Region));
+    region_ = static_cast<joycon_shm::Region*>(map);
+    for (auto& slot : region_->slots) {
+        new (&slot.sequence) std::atomic<uint32_t>(0);
+    }
+    region_->version = joycon_shm::VERSION;
+    region_->slot_count = joycon_shm::MAX_CONTROLLERS;
+    region_->slot_size = sizeof(joycon_shm::ControllerSlot);
+    // Magic last, readers validate it before anything else
+    std::atomic_thread_fence(std::memory_order_release);
+    region_->magic = joycon_shm::MAGIC;
+}
+
+SharedMemoryPublisher::~SharedMemoryPublisher() {
+    for (size_t i = 0; i < joycon_shm::MAX_CONTROLLERS; ++i) {
+        remove_controller(static_cast<int>(i));
+    }
+    munmap(region_, sizeof(joycon_shm::Region));
+    shm_unlink(name_.c_str());
+}
+
+int SharedMemoryPublisher::add_controller(JoyCon& joycon) {
+    int slot = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < joycon_shm::MAX_CONTROLLERS; ++i) {
+            if (!bindings_[i].joycon) {
+                slot = static_cast<int>(i);
+                bindings_[i].joycon = &joycon;
+                bindings_[i].product_id = joycon.get_product_id();
+                break;
+            }
+        }
+    }
+    if (slot < 0) {
+        throw std::runtime_error("No free shared memory slot");
+    }
+    bindings_[slot].hook_id = joycon.register_update_hook([this, slot](JoyCon& jc) { on_report(slot, jc); });
+    return slot;
+}
+
+void SharedMemoryPublisher::remove_controller(int slot) {
+    if (slot < 0 || slot >= static_cast<int>(joycon_shm::MAX_CONTROLLERS)) throw std::out_of_range("slot");
+    JoyCon* joycon;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        joycon = bindings_[slot].joycon;
+    }
+    if (!joycon) return;
+    joycon->unregister_update_hook(bindings_[slot].hook_id);
+
+    joycon_shm::ControllerSlot& s = region_->slots[slot];
+    uint32_t seq = s.sequence.load(std::memory_order_relaxed);
+    s.sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.product_id = 0;
+    s.sequence.store(seq + 2, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    bindings_[slot].joycon = nullptr;
+}
+
+void SharedMemoryPublisher::on_report(int slot, JoyCon& joycon) {
+    auto received = joycon.get_report_time();
+    auto report = joycon.get_input_report();
+    JoyCon::Status status = joycon.get_status();
+
+    joycon_shm::ControllerState state{};
+    state.host_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(received.time_since_epoch()).count();
+    state.buttons = report[3] | (report[4] << 8) | (report[5] << 16);
+    state.battery_level = static_cast<uint8_t>(status.battery.level);
+    state.battery_charging = static_cast<uint8_t>(status.battery.charging);
+    state.timer = report[1];
+    state.sticks[0] = status.analog_sticks.left.horizontal;
+    state.sticks[1] = status.analog_sticks.left.vertical;
+    state.sticks[2] = status.analog_sticks.right.horizontal;
+    state.sticks[3] = status.analog_sticks.right.vertical;
+    state.accel[0] = status.accel.x;
+    state.accel[1] = status.accel.y;
+    state.accel[2] = status.accel.z;
+    state.gyro[0] = status.gyro.x;
+    state.gyro[1] = status.gyro.y;
+    state.gyro[2] = status.gyro.z;
+
+    // Single writer per slot: this JoyCon's input thread
+    joycon_shm::ControllerSlot& s = region_->slots[slot];
+    uint32_t seq = s.sequence.load(std::memory_order_relaxed);
+    s.sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    state.report_count = s.state.report_count + 1;
+    s.product_id = bindings_[slot].product_id;
+    s.state = state;
+    joycon_shm::HistoryEntry& entry = s.history[s.history_count % joycon_shm::HISTORY_SIZE];
+    entry.host_time_ns = state.host_time_ns;
+    std::memcpy(entry.report, report.data(), joycon_shm::REPORT_SIZE);
+    s.history_count++;
+
+    s.sequence.store(seq + 2, std::memory_order_release);
+}
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include "joycon.h"
+#include "shm_layout.h"
+#include <array>
+#include <mutex>
+#include <string>
+
+// Publishes per-controller snapshots and a short raw report history into a
+// POSIX shared-memory region (see shm_layout.h), written from the input
+// thread of each JoyCon. Readers use SharedMemoryReader from shm_reader.h.
+// The constructor throws if the region already exists.
+class SharedMemoryPublisher {
+public:
+    explicit SharedMemoryPublisher(const std::string& name = joycon_shm::DEFAULT_NAME);
+    ~SharedMemoryPublisher();
+
+    SharedMemoryPublisher(const SharedMemoryPublisher&) = delete;
+    SharedMemoryPublisher& operator=(const SharedMemoryPublisher&) = delete;
+
+    // Returns the slot the JoyCon was assigned to
+    int add_controller(JoyCon& joycon);
+    void remove_controller(int slot);
+
+private:
+    struct Binding {
+        JoyCon* joycon = nullptr;
+        size_t hook_id = 0;
+        uint16_t product_id = 0;
+    };
+
+    std::string name_;
+    joycon_shm::Region* region_;
+    std::mutex mutex_;
+    std::array<Binding, joycon_shm::MAX_CONTROLLERS> bindings_;
+
+    void on_report(int slot, JoyCon& joycon);
+};
+
+#endif
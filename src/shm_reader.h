@@ -0,0 +1,107 @@
+// shm_reader.h
+// Reader side of the JoyCon++ shared-memory state, header only.
+// Once mapped, reading a snapshot is plain memory access: no syscalls,
+// no sockets, any number of reader processes.
+#pragma once
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include "shm_layout.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+class SharedMemoryReader {
+public:
+    explicit SharedMemoryReader(const std::string& name = joycon_shm::DEFAULT_NAME) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("shm_open failed: ") + std::strerror(errno));
+        }
+        void* map = mmap(nullptr, sizeof(joycon_shm::Region), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            throw std::runtime_error(std::string("mmap failed: ") + std::strerror(errno));
+        }
+        region_ = static_cast<const joycon_shm::Region*>(map);
+        if (region_->magic != joycon_shm::MAGIC || region_->version != joycon_shm::VERSION
+            || region_->slot_size != sizeof(joycon_shm::ControllerSlot)
+            || region_->slot_count > joycon_shm::MAX_CONTROLLERS) {
+            munmap(const_cast<joycon_shm::Region*>(region_), sizeof(joycon_shm::Region));
+            throw std::runtime_error("shared memory layout mismatch");
+        }
+    }
+
+    ~SharedMemoryReader() {
+        munmap(const_cast<joycon_shm::Region*>(region_), sizeof(joycon_shm::Region));
+    }
+
+    SharedMemoryReader(const SharedMemoryReader&) = delete;
+    SharedMemoryReader& operator=(const SharedMemoryReader&) = delete;
+
+    // Consistent copy of a controller state, false if the slot is unused or
+    // no consistent copy was seen within MAX_ATTEMPTS (publisher died in
+    // the middle of a write)
+    bool read_state(size_t slot, joycon_shm::ControllerState& out) const {
+        const joycon_shm::ControllerSlot& s = get_slot(slot);
+        uint32_t product_id = 0;
+        bool consistent = read_consistent(s, [&] {
+            product_id = s.product_id;
+            std::memcpy(&out, &s.state, sizeof(out));
+        });
+        return consistent && product_id != 0;
+    }
+
+    // Copies up to max most recent reports, oldest first, returns the count;
+    // 0 as well when no consistent copy was seen
+    size_t read_history(size_t slot, joycon_shm::HistoryEntry* out, size_t max) const {
+        const joycon_shm::ControllerSlot& s = get_slot(slot);
+        size_t n = 0;
+        bool consistent = read_consistent(s, [&] {
+            uint64_t total = s.history_count;
+            n = static_cast<size_t>(std::min<uint64_t>({total, max, joycon_shm::HISTORY_SIZE}));
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t idx = (total - n + i) % joycon_shm::HISTORY_SIZE;
+                std::memcpy(&out[i], &s.history[idx], sizeof(joycon_shm::HistoryEntry));
+            }
+        });
+        return consistent ? n : 0;
+    }
+
+    size_t slot_count() const { return region_->slot_count; }
+
+    // A write takes well under a microsecond, this covers a publisher that
+    // is preempted mid-write many times over
+    static constexpr int MAX_ATTEMPTS = 100000;
+
+private:
+    const joycon_shm::Region* region_;
+
+    const joycon_shm::ControllerSlot& get_slot(size_t slot) const {
+        if (slot >= region_->slot_count) throw std::out_of_range("slot");
+        return region_->slots[slot];
+    }
+
+    template <class Copy>
+    static bool read_consistent(const joycon_shm::ControllerSlot& s, Copy copy) {
+        for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+            uint32_t before = s.sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            copy();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.sequence.load(std::memory_order_relaxed) == before) return true;
+        }
+        return false;
+    }
+};
+
+#endif
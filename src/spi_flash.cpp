@@ -0,0 +1,153 @@
+#include "spi_flash.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+    constexpr size_t CHUNK_SIZE = output_report::SpiFlashWrite::MAX_SIZE;
+
+    double rate(size_t bytes, std::chrono::steady_clock::time_point start) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return seconds > 0 ? bytes / seconds : 0.0;
+    }
+}
+
+SpiFlash::SpiFlash(JoyCon& joycon, const SpiFlashOptions& options)
+    : joycon_(joycon),
+      options_(options),
+      requests_(0),
+      retries_(0),
+      bytes_read_(0),
+      bytes_written_(0),
+      read_rate_(0.0),
+      serial_rate_(0.0),
+      write_rate_(0.0)
+{
+    if (options_.window == 0) {
+        throw std::invalid_argument("window must be at least 1");
+    }
+}
+
+std::vector<uint8_t> SpiFlash::read(uint32_t address, size_t size) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> result(size);
+
+    struct Chunk {
+        uint32_t address;
+        uint8_t size;
+        int attempts = 0;
+    };
+    std::vector<Chunk> chunks;
+    for (size_t offset = 0; offset < size; offset += CHUNK_SIZE) {
+        chunks.push_back({static_cast<uint32_t>(address + offset), static_cast<uint8_t>(std::min(CHUNK_SIZE, size - offset))});
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<size_t> queue;
+    for (size_t i = 0; i < chunks.size(); ++i) queue.push_back(i);
+    size_t in_flight = 0;
+    size_t completed = 0;
+    std::string error;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (completed < chunks.size() && error.empty()) {
+        while (in_flight < options_.window && !queue.empty()) {
+            size_t index = queue.front();
+            queue.pop_front();
+            Chunk& chunk = chunks[index];
+            chunk.attempts++;
+            in_flight++;
+            auto request = JoyCon::build_subcommand(output_report::SpiFlashRead{chunk.address, chunk.size});
+            lock.unlock();
+            requests_.fetch_add(1, std::memory_order_relaxed);
+            // Runs on the input thread
+            auto done = [&, index, request](const std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE>* reply) {
+                const Chunk& c = chunks[index];
+                bool valid = reply && output_report::SpiFlashRead::verify_reply(request, *reply);
+                std::lock_guard<std::mutex> guard(mutex);
+                in_flight--;
+                if (valid) {
+                    std::copy_n(reply->begin() + output_report::SpiFlashRead::REPLY_DATA, c.size, result.begin() + (c.address - address));
+                    completed++;
+                } else if (c.attempts <= options_.retries) {
+                    retries_.fetch_add(1, std::memory_order_relaxed);
+                    queue.push_front(index);
+                } else {
+                    error = reply ? "SPI read reply did not verify" : "SPI read timed out";
+                }
+                cv.notify_one();
+            };
+            try {
+                joycon_.send_subcmd_async(request, done, options_.timeout);
+            } catch (const std::exception& e) {
+                lock.lock();
+                in_flight--;
+                error = e.what();
+                break;
+            }
+            lock.lock();
+        }
+        cv.wait(lock, [&] { return !error.empty() || completed == chunks.size() || (in_flight < options_.window && !queue.empty()); });
+    }
+    // Callbacks reference this frame, wait for the ones still out
+    cv.wait(lock, [&] { return in_flight == 0; });
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+
+    bytes_read_.fetch_add(size, std::memory_order_relaxed);
+    read_rate_ = rate(size, start);
+    return result;
+}
+
+std::vector<uint8_t> SpiFlash::read_serial(uint32_t address, size_t size) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> result;
+    result.reserve(size);
+    for (size_t offset = 0; offset < size; offset += CHUNK_SIZE) {
+        auto chunk = static_cast<uint8_t>(std::min(CHUNK_SIZE, size - offset));
+        auto data = joycon_.spi_flash_read(static_cast<uint32_t>(address + offset), chunk);
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        result.insert(result.end(), data.begin(), data.end());
+    }
+    bytes_read_.fetch_add(size, std::memory_order_relaxed);
+    serial_rate_ = rate(size, start);
+    return result;
+}
+
+void SpiFlash::write(uint32_t address, const std::vector<uint8_t>& data) {
+    if (address < USER_CALIBRATION_BEGIN || address + data.size() > USER_CALIBRATION_END) {
+        throw std::out_of_range("SPI writes are limited to the user calibration area");
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < data.size(); offset += CHUNK_SIZE) {
+        output_report::SpiFlashWrite command{static_cast<uint32_t>(address + offset), static_cast<uint8_t>(std::min(CHUNK_SIZE, data.size() - offset))};
+        std::copy_n(data.begin() + offset, command.size, command.data.begin());
+        auto [ack, reply] = joycon_.send_subcmd_get_response(JoyCon::build_subcommand(command));
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        // reply[2] is the write status, 0 on success
+        if (!ack || reply[2] != 0x00) {
+            throw std::runtime_error("SPI write failed");
+        }
+    }
+    if (read(address, data.size()) != data) {
+        throw std::runtime_error("SPI write did not verify");
+    }
+    bytes_written_.fetch_add(data.size(), std::memory_order_relaxed);
+    write_rate_ = rate(data.size(), start);
+}
+
+SpiFlash::Stats SpiFlash::get_stats() const {
+    Stats stats;
+    stats.requests = requests_.load(std::memory_order_relaxed);
+    stats.retries = retries_.load(std::memory_order_relaxed);
+    stats.bytes_read = bytes_read_.load(std::memory_order_relaxed);
+    stats.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+    stats.read_bytes_per_second = read_rate_.load();
+    stats.serial_bytes_per_second = serial_rate_.load();
+    stats.write_bytes_per_second = write_rate_.load();
+    return stats;
+}
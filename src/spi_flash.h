@@ -0,0 +1,57 @@
+#pragma once
+
+#include "joycon.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+struct SpiFlashOptions {
+    // Read requests kept in flight at once
+    size_t window = 4;
+    // Per request timeout and how often a chunk is retried before giving up
+    std::chrono::milliseconds timeout{200};
+    int retries = 3;
+};
+
+// Bulk access to a Joy-Con's SPI flash. Ranges are split into 0x1D-byte
+// chunks; reads keep several requests in flight, each reply is matched
+// and verified on its echoed address and size, failed chunks are retried.
+// Writes (subcommand 0x11) are limited to the user calibration area and
+// read back to verify.
+class SpiFlash {
+public:
+    static constexpr uint32_t USER_CALIBRATION_BEGIN = 0x8010;
+    static constexpr uint32_t USER_CALIBRATION_END = 0x8040;
+
+    explicit SpiFlash(JoyCon& joycon, const SpiFlashOptions& options = {});
+
+    std::vector<uint8_t> read(uint32_t address, size_t size);
+    // One request at a time, the baseline the pipelined read is measured against
+    std::vector<uint8_t> read_serial(uint32_t address, size_t size);
+    // Throws std::out_of_range outside the user calibration area
+    void write(uint32_t address, const std::vector<uint8_t>& data);
+
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t retries = 0;
+        uint64_t bytes_read = 0;
+        uint64_t bytes_written = 0;
+        double read_bytes_per_second = 0.0;     // of the last read()
+        double serial_bytes_per_second = 0.0;   // of the last read_serial()
+        double write_bytes_per_second = 0.0;    // of the last write()
+    };
+    Stats get_stats() const;
+
+private:
+    JoyCon& joycon_;
+    SpiFlashOptions options_;
+
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> retries_;
+    std::atomic<uint64_t> bytes_read_;
+    std::atomic<uint64_t> bytes_written_;
+    std::atomic<double> read_rate_;
+    std::atomic<double> serial_rate_;
+    std::atomic<double> write_rate_;
+};
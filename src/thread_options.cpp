@@ -0,0 +1,80 @@
+#include "thread_options.h"
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+#ifndef _WIN32
+    [[noreturn]] void throw_errno(const char* what, int err) {
+        throw std::runtime_error(std::string(what) + ": " + std::strerror(err));
+    }
+#endif
+}
+
+void apply_thread_options(const ReaderThreadOptions& options) {
+    if (options.realtime_priority < 0 || options.realtime_priority > 99) {
+        throw std::invalid_argument("realtime_priority must be 0-99");
+    }
+    if (options.nice < -20 || options.nice > 19) {
+        throw std::invalid_argument("nice must be -20 to 19");
+    }
+
+#ifdef _WIN32
+    int priority = THREAD_PRIORITY_NORMAL;
+    if (options.realtime_priority >= 50) priority = THREAD_PRIORITY_TIME_CRITICAL;
+    else if (options.realtime_priority > 0) priority = THREAD_PRIORITY_HIGHEST;
+    else if (options.nice < 0) priority = THREAD_PRIORITY_ABOVE_NORMAL;
+    else if (options.nice > 0) priority = THREAD_PRIORITY_BELOW_NORMAL;
+    if (!SetThreadPriority(GetCurrentThread(), priority)) {
+        throw std::runtime_error("SetThreadPriority failed: " + std::to_string(GetLastError()));
+    }
+    if (!options.cpus.empty()) {
+        DWORD_PTR mask = 0;
+        for (int cpu : options.cpus) {
+            if (cpu < 0 || cpu >= static_cast<int>(sizeof(DWORD_PTR) * 8)) throw std::out_of_range("cpu");
+            mask |= DWORD_PTR(1) << cpu;
+        }
+        if (!SetThreadAffinityMask(GetCurrentThread(), mask)) {
+            throw std::runtime_error("SetThreadAffinityMask failed: " + std::to_string(GetLastError()));
+        }
+    }
+#else
+    sched_param param{};
+    int policy = SCHED_OTHER;
+    if (options.realtime_priority > 0) {
+        policy = SCHED_FIFO;
+        param.sched_priority = options.realtime_priority;
+    }
+    if (int err = pthread_setschedparam(pthread_self(), policy, &param)) {
+        throw_errno("pthread_setschedparam failed", err);
+    }
+    // On Linux PRIO_PROCESS with 0 is the calling thread, not the process
+    if (policy == SCHED_OTHER && setpriority(PRIO_PROCESS, 0, options.nice) < 0) {
+        throw_errno("setpriority failed", errno);
+    }
+    if (!options.cpus.empty()) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : options.cpus) {
+            if (cpu < 0 || cpu >= CPU_SETSIZE) throw std::out_of_range("cpu");
+            CPU_SET(cpu, &set);
+        }
+        if (int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+            throw_errno("pthread_setaffinity_np failed", err);
+        }
+#else
+        throw std::runtime_error("CPU affinity is not supported on this platform");
+#endif
+    }
+#endif
+}
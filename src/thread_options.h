@@ -0,0 +1,26 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+// Scheduling of a JoyCon input thread, per device or as the default for
+// every JoyCon created afterwards (JoyCon::set_default_reader_options).
+struct ReaderThreadOptions {
+    // 1-99 runs the thread SCHED_FIFO at that priority (Windows: above
+    // normal up to time critical), 0 keeps the normal scheduler. Needs
+    // CAP_SYS_NICE or an rtprio limit on Linux.
+    int realtime_priority = 0;
+    // Nice value under the normal scheduler, -20 to 19 (Windows: the sign
+    // selects above or below normal priority)
+    int nice = 0;
+    // CPUs the thread may run on, empty means any (not available on macOS)
+    std::vector<int> cpus;
+    // After each report keep polling without blocking this long before
+    // going back to a blocking read. Trades one busy core for not having
+    // to be woken up and scheduled again. 0 disables busy-polling.
+    std::chrono::microseconds spin_budget{0};
+};
+
+// Applies priority and affinity to the calling thread, throws
+// std::runtime_error if the system refuses
+void apply_thread_options(const ReaderThreadOptions& options);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "joycon.h"
+#include "constants.h"
+#include "report_layout.h"
+
+// A JoyCon fixed at compile time to one device variant, e.g.
+// TypedJoyCon<report_layout::Left> or TypedJoyCon<report_layout::Pro>.
+// get_snapshot() decodes only the fields the variant physically has into
+// its smaller Snapshot type, without any runtime side checks.
+template <class V>
+class TypedJoyCon : public JoyCon {
+public:
+    using Variant = V;
+    using Snapshot = report_layout::Snapshot<V>;
+
+    explicit TypedJoyCon(const std::wstring& serial = L"", bool simple_mode = false, const TransportOptions& transport = {})
+        : JoyCon(JOYCON_VENDOR_ID, V::PRODUCT_ID, serial, simple_mode, transport)
+    {
+        if constexpr (V::PRODUCT_ID == CHARGING_GRIP_PRODUCT_ID) {
+            // Both grip interfaces share the product id, pick one by serial
+            // and check it is the requested side (type is read on connect)
+            constexpr JoyConType expected = V::DEVICE_TYPE == report_layout::DeviceType::LEFT ? LEFT : RIGHT;
+            if (type != expected) {
+                throw std::runtime_error("Charging grip interface is not the requested Joy-Con");
+            }
+        }
+    }
+
+    // Last report and the calibration in effect for it, taken under one
+    // lock like get_status(), decoded outside it
+    Snapshot get_snapshot() const {
+        std::array<uint8_t, INPUT_REPORT_SIZE> report;
+        Calibration calibration = get_calibration(report);
+        return decode(report, calibration);
+    }
+
+    Snapshot decode(const std::array<uint8_t, INPUT_REPORT_SIZE>& report) const {
+        return decode(report, get_calibration());
+    }
+
+    // Status offset applied, IMU calibrated like the JoyCon getters
+    static Snapshot decode(const std::array<uint8_t, INPUT_REPORT_SIZE>& report, const Calibration& calibration) {
+        Snapshot s = report_layout::decode<V>(report);
+        const Offset& offset = calibration.status_offset;
+        if constexpr (V::HAS_LEFT) {
+            s.left.stick.horizontal = static_cast<int16_t>(s.left.stick.horizontal - offset.stick_left_horizontal);
+            s.left.stick.vertical = static_cast<int16_t>(s.left.stick.vertical - offset.stick_left_vertical);
+        }
+        if constexpr (V::HAS_RIGHT) {
+            s.right.stick.horizontal = static_cast<int16_t>(s.right.stick.horizontal - offset.stick_right_horizontal);
+            s.right.stick.vertical = static_cast<int16_t>(s.right.stick.vertical - offset.stick_right_vertical);
+        }
+        // First IMU sample: accel x/y/z at bytes 13-18, gyro at 19-24
+        for (size_t axis = 0; axis < 3; ++axis) {
+            auto raw = [&](size_t byte) { return static_cast<int16_t>(report[byte] | (report[byte + 1] << 8)); };
+            s.accel[axis] = (raw(13 + axis * 2) - calibration.accel_offset[axis]) * calibration.accel_coeff[axis];
+            s.gyro[axis] = (raw(19 + axis * 2) - calibration.gyro_offset[axis]) * calibration.gyro_coeff[axis];
+        }
+        s.gyro[0] -= offset.gyro_x;
+        s.gyro[1] -= offset.gyro_y;
+        s.gyro[2] -= offset.gyro_z;
+        return s;
+    }
+};
+
+using LeftJoyCon = TypedJoyCon<report_layout::Left>;
+using RightJoyCon = TypedJoyCon<report_layout::Right>;
+using ProController = TypedJoyCon<report_layout::Pro>;
+template <class Side>
+using GripJoyCon = TypedJoyCon<report_layout::ChargingGrip<Side>>;
@@ -0,0 +1,334 @@
+#ifdef __linux__
+
+#include "uinput_gamepad.h"
+#include <linux/uinput.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <dirent.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    // Nintendo layout, same codes as the kernel hid-nintendo driver
+    constexpr std::array<uint16_t, UinputGamepad::KEY_COUNT> KEY_CODES = {
+        BTN_EAST, BTN_SOUTH, BTN_NORTH, BTN_WEST,
+        BTN_TR, BTN_TR2, BTN_TL, BTN_TL2,
+        BTN_SELECT, BTN_START, BTN_THUMBL, BTN_THUMBR,
+        BTN_MODE, BTN_Z,
+        BTN_DPAD_UP, BTN_DPAD_DOWN, BTN_DPAD_LEFT, BTN_DPAD_RIGHT,
+        BTN_TRIGGER_HAPPY1, BTN_TRIGGER_HAPPY2, BTN_TRIGGER_HAPPY3, BTN_TRIGGER_HAPPY4,
+    };
+    constexpr std::array<uint16_t, UinputGamepad::AXIS_COUNT> AXIS_CODES = {ABS_X, ABS_Y, ABS_RX, ABS_RY};
+
+    constexpr int STICK_RANGE = 2048;
+    constexpr int ACCEL_RANGE = 32767;
+    constexpr int GYRO_RANGE = 32767;
+    constexpr int ACCEL_RES_PER_G = static_cast<int>(JoyCon::ACCEL_UNITS_PER_G);
+    constexpr int GYRO_RES_PER_DPS = static_cast<int>(JoyCon::GYRO_UNITS_PER_DPS);
+
+    constexpr uint16_t NINTENDO_VENDOR_ID = 0x057E;
+
+    void check_ioctl(int res, const char* what) {
+        if (res < 0) {
+            throw std::runtime_error(std::string("uinput ") + what + " failed: " + std::strerror(errno));
+        }
+    }
+
+    void setup_abs(int fd, uint16_t code, int min, int max, int fuzz, int flat, int resolution) {
+        uinput_abs_setup abs{};
+        abs.code = code;
+        abs.absinfo.minimum = min;
+        abs.absinfo.maximum = max;
+        abs.absinfo.fuzz = fuzz;
+        abs.absinfo.flat = flat;
+        abs.absinfo.resolution = resolution;
+        check_ioctl(ioctl(fd, UI_ABS_SETUP, &abs), "UI_ABS_SETUP");
+    }
+
+    void create_device(int fd, const std::string& name, uint16_t product) {
+        uinput_setup setup{};
+        setup.id.bustype = BUS_VIRTUAL;
+        setup.id.vendor = NINTENDO_VENDOR_ID;
+        setup.id.product = product;
+        std::strncpy(setup.name, name.c_str(), UINPUT_MAX_NAME_SIZE - 1);
+        check_ioctl(ioctl(fd, UI_DEV_SETUP, &setup), "UI_DEV_SETUP");
+        check_ioctl(ioctl(fd, UI_DEV_CREATE), "UI_DEV_CREATE");
+    }
+
+    input_event make_event(uint16_t type, uint16_t code, int32_t value) {
+        input_event ev{};
+        ev.type = type;
+        ev.code = code;
+        ev.value = value;
+        return ev;
+    }
+}
+
+UinputGamepad::UinputGamepad(JoyCon& joycon, const UinputGamepadOptions& options)
+    : joycon_(&joycon),
+      pair_(nullptr),
+      hook_id_(0),
+      options_(options),
+      gamepad_fd_(-1),
+      motion_fds_{-1, -1},
+      first_(true),
+      reports_(0),
+      write_errors_(0),
+      last_latency_ns_(0),
+      max_latency_ns_(0),
+      total_latency_ns_(0)
+{
+    create_devices(false);
+    hook_id_ = joycon.register_update_hook([this](JoyCon& jc) { on_report(jc); });
+}
+
+UinputGamepad::UinputGamepad(JoyConPair& pair, const UinputGamepadOptions& options)
+    : joycon_(nullptr),
+      pair_(&pair),
+      hook_id_(0),
+      options_(options),
+      gamepad_fd_(-1),
+      motion_fds_{-1, -1},
+      first_(true),
+      reports_(0),
+      write_errors_(0),
+      last_latency_ns_(0),
+      max_latency_ns_(0),
+      total_latency_ns_(0)
+{
+    create_devices(true);
+    hook_id_ = pair.register_update_hook([this](JoyConPair& p) { on_pair_report(p); });
+}
+
+UinputGamepad::~UinputGamepad() {
+    if (joycon_) joycon_->unregister_update_hook(hook_id_);
+    if (pair_) pair_->unregister_update_hook(hook_id_);
+    destroy_devices();
+}
+
+void UinputGamepad::create_devices(bool dual) {
+    try {
+        gamepad_fd_ = create_gamepad();
+        if (options_.motion) {
+            motion_fds_[0] = create_motion(dual ? " IMU (L)" : " IMU");
+            if (dual) motion_fds_[1] = create_motion(" IMU (R)");
+        }
+    } catch (...) {
+        destroy_devices();
+        throw;
+    }
+}
+
+int UinputGamepad::create_gamepad() {
+    int fd = ::open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("uinput open failed: ") + std::strerror(errno));
+    }
+    try {
+        check_ioctl(ioctl(fd, UI_SET_EVBIT, EV_KEY), "UI_SET_EVBIT");
+        for (uint16_t code : KEY_CODES) {
+            check_ioctl(ioctl(fd, UI_SET_KEYBIT, code), "UI_SET_KEYBIT");
+        }
+        check_ioctl(ioctl(fd, UI_SET_EVBIT, EV_ABS), "UI_SET_EVBIT");
+        for (uint16_t code : AXIS_CODES) {
+            check_ioctl(ioctl(fd, UI_SET_ABSBIT, code), "UI_SET_ABSBIT");
+            setup_abs(fd, code, -STICK_RANGE, STICK_RANGE - 1, 16, 128, 0);
+        }
+        create_device(fd, options_.name, 0x2008);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    return fd;
+}
+
+int UinputGamepad::create_motion(const char* suffix) {
+    int fd = ::open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("uinput open failed: ") + std::strerror(errno));
+    }
+    try {
+        check_ioctl(ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_ACCELEROMETER), "UI_SET_PROPBIT");
+        check_ioctl(ioctl(fd, UI_SET_EVBIT, EV_ABS), "UI_SET_EVBIT");
+        for (uint16_t code : {ABS_X, ABS_Y, ABS_Z}) {
+            check_ioctl(ioctl(fd, UI_SET_ABSBIT, code), "UI_SET_ABSBIT");
+            setup_abs(fd, code, -ACCEL_RANGE, ACCEL_RANGE, 20, 0, ACCEL_RES_PER_G);
+        }
+        for (uint16_t code : {ABS_RX, ABS_RY, ABS_RZ}) {
+            check_ioctl(ioctl(fd, UI_SET_ABSBIT, code), "UI_SET_ABSBIT");
+            setup_abs(fd, code, -GYRO_RANGE, GYRO_RANGE, 16, 0, GYRO_RES_PER_DPS);
+        }
+        check_ioctl(ioctl(fd, UI_SET_EVBIT, EV_MSC), "UI_SET_EVBIT");
+        check_ioctl(ioctl(fd, UI_SET_MSCBIT, MSC_TIMESTAMP), "UI_SET_MSCBIT");
+        create_device(fd, options_.name + suffix, 0x2008);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    return fd;
+}
+
+void UinputGamepad::destroy_devices() {
+    for (int* fd : {&gamepad_fd_, &motion_fds_[0], &motion_fds_[1]}) {
+        if (*fd >= 0) {
+            ioctl(*fd, UI_DEV_DESTROY);
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+UinputGamepad::LatencyStats UinputGamepad::get_latency_stats() const {
+    LatencyStats stats;
+    stats.reports = reports_.load(std::memory_order_relaxed);
+    stats.write_errors = write_errors_.load(std::memory_order_relaxed);
+    stats.last = std::chrono::nanoseconds(last_latency_ns_.load(std::memory_order_relaxed));
+    stats.max = std::chrono::nanoseconds(max_latency_ns_.load(std::memory_order_relaxed));
+    if (stats.reports) {
+        stats.mean = std::chrono::nanoseconds(total_latency_ns_.load(std::memory_order_relaxed) / static_cast<int64_t>(stats.reports));
+    }
+    return stats;
+}
+
+std::string UinputGamepad::get_event_node() const {
+    char sysname[64] = {};
+    check_ioctl(ioctl(gamepad_fd_, UI_GET_SYSNAME(sizeof(sysname)), sysname), "UI_GET_SYSNAME");
+    std::string dir = std::string("/sys/devices/virtual/input/") + sysname;
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        throw std::runtime_error("uinput device not found in sysfs: " + dir);
+    }
+    std::string node;
+    while (dirent* entry = readdir(d)) {
+        if (std::strncmp(entry->d_name, "event", 5) == 0) {
+            node = std::string("/dev/input/") + entry->d_name;
+            break;
+        }
+    }
+    closedir(d);
+    if (node.empty()) {
+        throw std::runtime_error("uinput device has no event node: " + dir);
+    }
+    return node;
+}
+
+UinputGamepad::Frame UinputGamepad::to_frame(const JoyCon::Status::Buttons& buttons, const JoyCon::Status::AnalogSticks& sticks) const {
+    const auto& r = buttons.right;
+    const auto& l = buttons.left;
+    Frame frame;
+    frame.keys = {
+        r.a, r.b, r.x, r.y,
+        r.r, r.zr, l.l, l.zl,
+        l.minus, r.plus, sticks.left.pressed, sticks.right.pressed,
+        r.home, l.capture,
+        l.up, l.down, l.left, l.right,
+        l.sl, l.sr, r.sl, r.sr,
+    };
+    // Joy-Con vertical axes grow upwards, evdev ones downwards
+    auto axis = [](int value) { return std::clamp(value, -STICK_RANGE, STICK_RANGE - 1); };
+    frame.axes = {
+        axis(sticks.left.horizontal - options_.stick_center),
+        axis(options_.stick_center - sticks.left.vertical),
+        axis(sticks.right.horizontal - options_.stick_center),
+        axis(options_.stick_center - sticks.right.vertical),
+    };
+    return frame;
+}
+
+void UinputGamepad::on_report(JoyCon& joycon) {
+    auto received = joycon.get_report_time();
+    auto report = joycon.get_input_report();
+    JoyCon::Status status = joycon.get_status();
+
+    emit_gamepad(to_frame(status.buttons, status.analog_sticks));
+    if (motion_fds_[0] >= 0) {
+        emit_motion(motion_fds_[0], joycon, report, joycon.get_sample_times());
+    }
+    record_latency(received);
+}
+
+void UinputGamepad::on_pair_report(JoyConPair& pair) {
+    auto received = std::max(pair.left().get_report_time(), pair.right().get_report_time());
+    JoyConPair::Status status = pair.get_status();
+
+    emit_gamepad(to_frame(status.buttons, status.analog_sticks));
+    if (motion_fds_[0] >= 0 && !status.left.stale) {
+        emit_motion(motion_fds_[0], status.left);
+    }
+    if (motion_fds_[1] >= 0 && !status.right.stale) {
+        emit_motion(motion_fds_[1], status.right);
+    }
+    record_latency(received);
+}
+
+void UinputGamepad::emit_gamepad(const Frame& frame) {
+    size_t n = 0;
+    for (size_t i = 0; i < KEY_COUNT; ++i) {
+        if (first_ || frame.keys[i] != last_.keys[i]) {
+            gamepad_events_[n++] = make_event(EV_KEY, KEY_CODES[i], frame.keys[i]);
+        }
+    }
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (first_ || frame.axes[i] != last_.axes[i]) {
+            gamepad_events_[n++] = make_event(EV_ABS, AXIS_CODES[i], frame.axes[i]);
+        }
+    }
+    first_ = false;
+    last_ = frame;
+    if (n == 0) return;
+    gamepad_events_[n++] = make_event(EV_SYN, SYN_REPORT, 0);
+    write_events(gamepad_fd_, gamepad_events_.data(), n);
+}
+
+void UinputGamepad::emit_motion(int fd, const JoyCon& joycon, const std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE>& report, const std::array<std::chrono::steady_clock::time_point, 3>& sample_times) {
+    // The three IMU samples, oldest first, all in one write()
+    size_t n = 0;
+    for (int i = 0; i < 3; ++i) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(sample_times[i].time_since_epoch()).count();
+        motion_events_[n++] = make_event(EV_ABS, ABS_X, static_cast<int32_t>(joycon.get_accel_x(report, i)));
+        motion_events_[n++] = make_event(EV_ABS, ABS_Y, static_cast<int32_t>(joycon.get_accel_y(report, i)));
+        motion_events_[n++] = make_event(EV_ABS, ABS_Z, static_cast<int32_t>(joycon.get_accel_z(report, i)));
+        motion_events_[n++] = make_event(EV_ABS, ABS_RX, static_cast<int32_t>(joycon.get_gyro_x(report, i) - joycon.status_offset_.gyro_x));
+        motion_events_[n++] = make_event(EV_ABS, ABS_RY, static_cast<int32_t>(joycon.get_gyro_y(report, i) - joycon.status_offset_.gyro_y));
+        motion_events_[n++] = make_event(EV_ABS, ABS_RZ, static_cast<int32_t>(joycon.get_gyro_z(report, i) - joycon.status_offset_.gyro_z));
+        motion_events_[n++] = make_event(EV_MSC, MSC_TIMESTAMP, static_cast<int32_t>(static_cast<uint32_t>(us)));
+        motion_events_[n++] = make_event(EV_SYN, SYN_REPORT, 0);
+    }
+    write_events(fd, motion_events_.data(), n);
+}
+
+void UinputGamepad::emit_motion(int fd, const JoyConPair::Status::Side& side) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(side.timestamp.time_since_epoch()).count();
+    size_t n = 0;
+    motion_events_[n++] = make_event(EV_ABS, ABS_X, static_cast<int32_t>(side.accel.x));
+    motion_events_[n++] = make_event(EV_ABS, ABS_Y, static_cast<int32_t>(side.accel.y));
+    motion_events_[n++] = make_event(EV_ABS, ABS_Z, static_cast<int32_t>(side.accel.z));
+    motion_events_[n++] = make_event(EV_ABS, ABS_RX, static_cast<int32_t>(side.gyro.x));
+    motion_events_[n++] = make_event(EV_ABS, ABS_RY, static_cast<int32_t>(side.gyro.y));
+    motion_events_[n++] = make_event(EV_ABS, ABS_RZ, static_cast<int32_t>(side.gyro.z));
+    motion_events_[n++] = make_event(EV_MSC, MSC_TIMESTAMP, static_cast<int32_t>(static_cast<uint32_t>(us)));
+    motion_events_[n++] = make_event(EV_SYN, SYN_REPORT, 0);
+    write_events(fd, motion_events_.data(), n);
+}
+
+void UinputGamepad::write_events(int fd, const input_event* events, size_t count) {
+    // Runs on the input thread, count errors instead of throwing
+    ssize_t size = static_cast<ssize_t>(count * sizeof(input_event));
+    if (::write(fd, events, size) != size) {
+        write_errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void UinputGamepad::record_latency(std::chrono::steady_clock::time_point received) {
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - received).count();
+    reports_.fetch_add(1, std::memory_order_relaxed);
+    last_latency_ns_.store(ns, std::memory_order_relaxed);
+    total_latency_ns_.fetch_add(ns, std::memory_order_relaxed);
+    int64_t prev = max_latency_ns_.load(std::memory_order_relaxed);
+    while (ns > prev && !max_latency_ns_.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+    }
+}
+
+#endif
@@ -0,0 +1,95 @@
+#pragma once
+
+#ifdef __linux__
+
+#include "joycon.h"
+#include "joycon_pair.h"
+#include <linux/input.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+struct UinputGamepadOptions {
+    std::string name = "JoyCon++ Virtual Gamepad";
+    // Subtracted from every stick value, set to 0 after JoyCon::status_offset()
+    int stick_center = 2048;
+    // Also create a motion device (INPUT_PROP_ACCELEROMETER) per Joy-Con
+    bool motion = false;
+};
+
+// Drives a Linux uinput virtual gamepad straight from the input thread.
+// Every report is translated into the changed evdev events only, and sent
+// with a single write() terminated by one SYN_REPORT.
+class UinputGamepad {
+public:
+    explicit UinputGamepad(JoyCon& joycon, const UinputGamepadOptions& options = {});
+    explicit UinputGamepad(JoyConPair& pair, const UinputGamepadOptions& options = {});
+    ~UinputGamepad();
+
+    UinputGamepad(const UinputGamepad&) = delete;
+    UinputGamepad& operator=(const UinputGamepad&) = delete;
+
+    // Report-in (host receive time) to evdev-out (write returned) latency
+    struct LatencyStats {
+        uint64_t reports = 0;
+        uint64_t write_errors = 0;
+        std::chrono::nanoseconds last{0};
+        std::chrono::nanoseconds max{0};
+        std::chrono::nanoseconds mean{0};
+    };
+    LatencyStats get_latency_stats() const;
+
+    // evdev node of the gamepad (/dev/input/eventN), e.g. to read it back
+    std::string get_event_node() const;
+
+    static constexpr size_t KEY_COUNT = 22;
+    static constexpr size_t AXIS_COUNT = 4;
+
+private:
+    struct Frame {
+        std::array<int, KEY_COUNT> keys{};
+        std::array<int, AXIS_COUNT> axes{};
+    };
+
+    // Worst case: every key and axis changed, three IMU samples per motion device
+    static constexpr size_t MAX_GAMEPAD_EVENTS = KEY_COUNT + AXIS_COUNT + 1;
+    static constexpr size_t MAX_MOTION_EVENTS = 3 * (6 + 2);
+
+    JoyCon* joycon_;
+    JoyConPair* pair_;
+    size_t hook_id_;
+    UinputGamepadOptions options_;
+
+    int gamepad_fd_;
+    std::array<int, 2> motion_fds_;
+
+    Frame last_;
+    bool first_;
+    std::array<input_event, MAX_GAMEPAD_EVENTS> gamepad_events_;
+    std::array<input_event, MAX_MOTION_EVENTS> motion_events_;
+
+    std::atomic<uint64_t> reports_;
+    std::atomic<uint64_t> write_errors_;
+    std::atomic<int64_t> last_latency_ns_;
+    std::atomic<int64_t> max_latency_ns_;
+    std::atomic<int64_t> total_latency_ns_;
+
+    void create_devices(bool dual);
+    int create_gamepad();
+    int create_motion(const char* suffix);
+    void destroy_devices();
+
+    void on_report(JoyCon& joycon);
+    void on_pair_report(JoyConPair& pair);
+    void emit_gamepad(const Frame& frame);
+    void emit_motion(int fd, const JoyCon& joycon, const std::array<uint8_t, JoyCon::INPUT_REPORT_SIZE>& report, const std::array<std::chrono::steady_clock::time_point, 3>& sample_times);
+    void emit_motion(int fd, const JoyConPair::Status::Side& side);
+    void write_events(int fd, const input_event* events, size_t count);
+    void record_latency(std::chrono::steady_clock::time_point received);
+
+    Frame to_frame(const JoyCon::Status::Buttons& buttons, const JoyCon::Status::AnalogSticks& sticks) const;
+};
+
+#endif
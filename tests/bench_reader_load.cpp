@@ -0,0 +1,117 @@
+// Input thread scheduling under CPU load: report intervals and delivery
+// delay jitter of the simulated controller with every core kept busy,
+// once with the default ReaderThreadOptions and once tuned (SCHED_FIFO
+// where permitted, else a negative nice value, plus busy-polling).
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr auto RUN_TIME = 2s;
+
+    // Spinning threads at normal priority, two per core
+    class CpuLoad {
+    public:
+        explicit CpuLoad(bool enabled) {
+            if (!enabled) return;
+            unsigned n = std::max(2u, 2 * std::thread::hardware_concurrency());
+            for (unsigned i = 0; i < n; ++i) {
+                threads_.emplace_back([this] {
+                    volatile uint64_t x = 0;
+                    while (!stop_.load(std::memory_order_relaxed)) x = x + 1;
+                });
+            }
+        }
+        ~CpuLoad() {
+            stop_ = true;
+            for (auto& t : threads_) t.join();
+        }
+    private:
+        std::atomic<bool> stop_{false};
+        std::vector<std::thread> threads_;
+    };
+
+    // Host receive intervals seen by a hook, in microseconds
+    struct Intervals {
+        std::mutex mutex;
+        std::vector<double> us;
+        std::chrono::steady_clock::time_point last;
+    };
+
+    void run(JoyCon& joycon, const char* name, bool loaded) {
+        Intervals intervals;
+        intervals.us.reserve(1000);
+        size_t id = joycon.register_update_hook([&](JoyCon& jc) {
+            auto time = jc.get_report_time();
+            std::lock_guard<std::mutex> lock(intervals.mutex);
+            if (intervals.last.time_since_epoch().count() != 0 && intervals.us.size() < intervals.us.capacity()) {
+                intervals.us.push_back(std::chrono::duration<double, std::micro>(time - intervals.last).count());
+            }
+            intervals.last = time;
+        });
+        joycon.reset_transport_stats();
+        {
+            CpuLoad load(loaded);
+            std::this_thread::sleep_for(RUN_TIME);
+        }
+        joycon.unregister_update_hook(id);
+        auto stats = joycon.get_transport_stats();
+
+        std::vector<double> us;
+        {
+            std::lock_guard<std::mutex> lock(intervals.mutex);
+            us = intervals.us;
+        }
+        CHECK(us.size() > 50);
+        std::sort(us.begin(), us.end());
+        std::printf("  %-28s reports %4zu, interval p50 %6.0f us, p99 %6.0f us, max %6.0f us, delay jitter %5lld us\n",
+                    name, us.size() + 1, us[us.size() / 2], us[us.size() * 99 / 100], us.back(),
+                    static_cast<long long>(stats.delay_jitter.count()));
+    }
+}
+
+int main() {
+    fake_hidapi::reset();
+    JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+    std::printf("%u CPUs, %zu load threads\n", std::thread::hardware_concurrency(),
+                static_cast<size_t>(std::max(2u, 2 * std::thread::hardware_concurrency())));
+
+    run(joycon, "idle, default", false);
+    run(joycon, "loaded, default", true);
+
+    // Strongest tuning the system allows
+    ReaderThreadOptions tuned;
+    tuned.spin_budget = 500us;
+    std::string how;
+    tuned.realtime_priority = 50;
+    try {
+        joycon.set_reader_options(tuned);
+        how = "SCHED_FIFO 50";
+    } catch (const std::runtime_error&) {
+        tuned.realtime_priority = 0;
+        tuned.nice = -10;
+        try {
+            joycon.set_reader_options(tuned);
+            how = "nice -10";
+        } catch (const std::runtime_error&) {
+            tuned.nice = 0;
+            joycon.set_reader_options(tuned);
+            how = "no priority";
+        }
+    }
+    std::string name = "loaded, " + how + " + spin";
+    run(joycon, name.c_str(), true);
+
+    joycon.set_reader_options({});
+    return 0;
+}
@@ -0,0 +1,64 @@
+// Reconnect timing over the simulated transport: link loss to the first
+// report of the new generation, and reopen to that report (state replay
+// included), with the device back at once and after failed reopens. The
+// lamp and vibration must be sent again after every reopen.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr int LOSSES = 10;
+
+    bool wrote_subcommand(uint8_t id, uint8_t arg) {
+        for (const auto& output : fake_hidapi::outputs()) {
+            if (output.data.size() > 11 && output.data[0] == 0x01 && output.data[10] == id && output.data[11] == arg) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(const char* name, int failed_opens) {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        joycon.set_player_lamp(2);
+        joycon.enable_vibration(true);
+
+        std::vector<double> downtime_ms, reopen_ms;
+        for (int i = 1; i <= LOSSES; ++i) {
+            fake_hidapi::clear_outputs();
+            fake_hidapi::fail_opens(failed_opens);
+            fake_hidapi::fail_read_after(0);
+            CHECK(wait_until([&] { return joycon.get_reconnect_stats().reconnects == uint64_t(i); }, 10000ms));
+            CHECK(wrote_subcommand(0x30, output_report::player_lamp_pattern(2)));
+            CHECK(wrote_subcommand(0x48, 0x01));
+            auto stats = joycon.get_reconnect_stats();
+            downtime_ms.push_back(std::chrono::duration<double, std::milli>(stats.last_downtime).count());
+            reopen_ms.push_back(std::chrono::duration<double, std::milli>(stats.last_reconnect_to_report).count());
+        }
+        auto stats = joycon.get_reconnect_stats();
+        CHECK(stats.link_losses == LOSSES);
+        CHECK(stats.attempts == uint64_t(LOSSES * (failed_opens + 1)));
+
+        std::sort(downtime_ms.begin(), downtime_ms.end());
+        std::sort(reopen_ms.begin(), reopen_ms.end());
+        std::printf("  %-24s loss to report p50 %7.1f ms, max %7.1f ms; reopen to report p50 %6.1f ms, max %6.1f ms\n",
+                    name, downtime_ms[LOSSES / 2], downtime_ms.back(), reopen_ms[LOSSES / 2], reopen_ms.back());
+        // Backoff 50ms, 100ms, ... before each reopen
+        CHECK(downtime_ms.front() >= 50.0 * ((1 << failed_opens) - 1) + 50.0);
+        CHECK(reopen_ms.back() < 1000.0);
+    }
+}
+
+int main() {
+    std::printf("%d link losses each\n", LOSSES);
+    run("device back at once", 0);
+    run("after 2 failed reopens", 2);
+    return 0;
+}
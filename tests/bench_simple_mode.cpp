@@ -0,0 +1,89 @@
+// Cost of a controller in full and in simple mode: reports, bytes and
+// input thread wakeups per second and input thread CPU time, with a
+// button pressed or released ten times a second as a kiosk user would.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <pthread.h>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr auto RUN_TIME = 3s;
+    constexpr auto PRESS_INTERVAL = 100ms;
+
+    struct Result {
+        double reports = 0, bytes = 0, wakeups = 0, cpu_ms = 0;   // per second
+    };
+
+    double thread_cpu_ms(pthread_t thread) {
+        clockid_t clock;
+        CHECK(pthread_getcpuclockid(thread, &clock) == 0);
+        timespec t{};
+        CHECK(clock_gettime(clock, &t) == 0);
+        return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+    }
+
+    Result run(bool simple_mode) {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID, L"", simple_mode);
+
+        // The input thread, for its CPU clock
+        std::atomic<bool> have_thread{false};
+        pthread_t input_thread{};
+        size_t id = joycon.register_update_hook([&](JoyCon&) {
+            if (!have_thread) {
+                input_thread = pthread_self();
+                have_thread = true;
+            }
+        });
+        fake_hidapi::Input input;
+        input.buttons = {0x01, 0x00, 0x00};
+        fake_hidapi::set_input(input);
+        CHECK(wait_until([&] { return have_thread.load(); }));
+
+        auto before = joycon.get_report_stats();
+        auto device_before = fake_hidapi::get_stats();
+        double cpu_before = thread_cpu_ms(input_thread);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; std::chrono::steady_clock::now() - start < RUN_TIME; ++i) {
+            input.buttons[0] = i % 2 ? 0x01 : 0x00;
+            fake_hidapi::set_input(input);
+            std::this_thread::sleep_for(PRESS_INTERVAL);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cpu_after = thread_cpu_ms(input_thread);
+        auto after = joycon.get_report_stats();
+        auto device_after = fake_hidapi::get_stats();
+        joycon.unregister_update_hook(id);
+
+        Result r;
+        r.reports = (device_after.reports - device_before.reports) / seconds;
+        r.bytes = (after.bytes - before.bytes) / seconds;
+        r.wakeups = (after.reads - before.reads) / seconds;
+        r.cpu_ms = (cpu_after - cpu_before) / seconds;
+        CHECK(after.reports > before.reports);
+        return r;
+    }
+
+    void print(const char* name, const Result& r) {
+        std::printf("  %-6s %7.1f reports/s, %8.0f bytes/s, %7.1f wakeups/s, %6.3f ms CPU/s\n",
+                    name, r.reports, r.bytes, r.wakeups, r.cpu_ms);
+    }
+}
+
+int main() {
+    Result full = run(false);
+    Result simple = run(true);
+    print("full", full);
+    print("simple", simple);
+    // Simple reports are only sent on a change
+    CHECK(simple.reports < full.reports / 2);
+    CHECK(simple.wakeups < full.wakeups / 2);
+    return 0;
+}
@@ -0,0 +1,64 @@
+// SPI flash read throughput over the simulated transport with a Bluetooth
+// like reply delay: one request at a time against the pipelined read with
+// several requests in flight, and the same with lost replies retried.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "spi_flash.h"
+#include <cstdio>
+
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr uint32_t ADDRESS = 0x20000;
+    constexpr size_t SIZE = 0x800;
+
+    SpiFlash::Stats run(const char* name, size_t window, int drop_every) {
+        fake_hidapi::reset();
+        std::vector<uint8_t> pattern(SIZE);
+        for (size_t i = 0; i < pattern.size(); ++i) pattern[i] = static_cast<uint8_t>(i * 7 + 3);
+        fake_hidapi::write_flash(ADDRESS, pattern);
+        fake_hidapi::DeviceOptions options;
+        options.reply_delay = 8ms;
+        fake_hidapi::set_options(options);
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        if (drop_every > 0) {
+            // Options apply to devices opened afterwards, drop the link once
+            options.drop_every = drop_every;
+            fake_hidapi::set_options(options);
+            fake_hidapi::fail_read_after(0);
+            CHECK(wait_until([&] { return joycon.get_reconnect_stats().reconnects == 1; }));
+        }
+
+        SpiFlashOptions flash_options;
+        flash_options.window = window;
+        flash_options.timeout = 100ms;
+        flash_options.retries = 8;
+        SpiFlash flash(joycon, flash_options);
+        CHECK(flash.read(ADDRESS, SIZE) == pattern);
+        if (drop_every == 0) {
+            CHECK(flash.read_serial(ADDRESS, SIZE) == pattern);
+        }
+        auto stats = flash.get_stats();
+        std::printf("  %-26s read %8.0f bytes/s", name, stats.read_bytes_per_second);
+        if (drop_every == 0) {
+            std::printf(", serial %8.0f bytes/s, %4.1fx", stats.serial_bytes_per_second,
+                        stats.read_bytes_per_second / stats.serial_bytes_per_second);
+        }
+        std::printf("; %llu requests, %llu retries\n", static_cast<unsigned long long>(stats.requests),
+                    static_cast<unsigned long long>(stats.retries));
+        return stats;
+    }
+}
+
+int main() {
+    std::printf("%zu bytes, 8 ms reply delay\n", SIZE);
+    run("window 1", 1, 0);
+    auto pipelined = run("window 4", 4, 0);
+    run("window 8", 8, 0);
+    auto lossy = run("window 4, 1 in 10 lost", 4, 10);
+    CHECK(pipelined.read_bytes_per_second > 2 * pipelined.serial_bytes_per_second);
+    CHECK(lossy.retries > 0);
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Bluetooth against USB through the charging grip on the simulated
+// transport: report interval and delivery delay jitter, with Bluetooth
+// reports delivered up to one connection interval late as on a real link.
+// USB output must be framed in 64-byte reports, kept alive by no-timeout
+// commands after a single handshake.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include <cstdio>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr auto RUN_TIME = 3s;
+    constexpr auto KEEPALIVE = 200ms;
+
+    JoyCon::TransportStats run(Transport transport) {
+        fake_hidapi::reset();
+        fake_hidapi::DeviceOptions options;
+        options.delivery_jitter = 7500us;   // Bluetooth only
+        options.grip_type = 2;
+        fake_hidapi::set_options(options);
+        TransportOptions transport_options;
+        transport_options.transport = transport;
+        transport_options.keepalive_interval = KEEPALIVE;
+        uint16_t product_id = transport == Transport::USB ? CHARGING_GRIP_PRODUCT_ID : JOYCON_R_PRODUCT_ID;
+        JoyCon joycon(JOYCON_VENDOR_ID, product_id, L"", false, transport_options);
+        CHECK(joycon.is_right());
+
+        CHECK(wait_until([&] { return joycon.get_report_stats().reports > 2; }));
+        joycon.reset_transport_stats();
+        std::this_thread::sleep_for(RUN_TIME);
+        joycon.set_player_lamp(1);
+        auto stats = joycon.get_transport_stats();
+
+        auto device = fake_hidapi::get_stats();
+        size_t frames = 0, usb_frames = 0;
+        for (const auto& output : fake_hidapi::outputs()) {
+            ++frames;
+            if (output.data.size() == JoyCon::USB_REPORT_SIZE) ++usb_frames;
+        }
+        if (transport == Transport::USB) {
+            CHECK(usb_frames == frames);
+            // One handshake sequence, sending 0x80 0x02 before and after the baud rate switch
+            CHECK(stats.handshakes == 1 && device.usb_handshakes == 2);
+            // Handshake plus one per keepalive interval
+            CHECK(stats.keepalives + 2 >= static_cast<uint64_t>(RUN_TIME / KEEPALIVE));
+            CHECK(device.usb_no_timeouts == stats.keepalives + 1);
+        } else {
+            CHECK(usb_frames == 0);
+            CHECK(device.usb_handshakes == 0 && stats.handshakes == 0);
+        }
+        CHECK(stats.samples > 100);
+        return stats;
+    }
+
+    void print(const char* name, const JoyCon::TransportStats& s) {
+        std::printf("  %-10s interval mean %6lld us, jitter %5lld us, max %6lld us; delay mean %5lld us, jitter %5lld us;"
+                    " %llu keepalives\n",
+                    name, static_cast<long long>(s.mean_interval.count()), static_cast<long long>(s.interval_jitter.count()),
+                    static_cast<long long>(s.max_interval.count()), static_cast<long long>(s.mean_delay.count()),
+                    static_cast<long long>(s.delay_jitter.count()), static_cast<unsigned long long>(s.keepalives));
+    }
+}
+
+int main() {
+    auto bluetooth = run(Transport::BLUETOOTH);
+    auto usb = run(Transport::USB);
+    print("Bluetooth", bluetooth);
+    print("USB", usb);
+    // Standard deviations swing with scheduling hiccups on a busy host,
+    // the mean delay does not
+    CHECK(usb.mean_delay < bluetooth.mean_delay);
+    return 0;
+}
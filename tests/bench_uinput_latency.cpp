@@ -0,0 +1,118 @@
+// Report-in to evdev-out latency of UinputGamepad, read back through the
+// evdev node it creates: a button toggled on the simulated controller is
+// timed from the host receive time of its report to the kernel timestamp
+// of the evdev event and to the moment a reader wakes up with it.
+// Skipped without access to /dev/uinput.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "uinput_gamepad.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <memory>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr int TOGGLES = 200;
+
+    struct Summary {
+        double mean_us = 0, p50_us = 0, p99_us = 0, max_us = 0;
+    };
+
+    Summary summarize(std::vector<double> us) {
+        Summary s;
+        std::sort(us.begin(), us.end());
+        for (double v : us) s.mean_us += v / us.size();
+        s.p50_us = us[us.size() / 2];
+        s.p99_us = us[us.size() * 99 / 100];
+        s.max_us = us.back();
+        return s;
+    }
+
+    void print(const char* what, const Summary& s) {
+        std::printf("  %-28s mean %7.1f us, p50 %7.1f us, p99 %7.1f us, max %7.1f us\n",
+                    what, s.mean_us, s.p50_us, s.p99_us, s.max_us);
+    }
+
+    std::chrono::steady_clock::time_point event_time(const input_event& ev) {
+        return std::chrono::steady_clock::time_point(std::chrono::seconds(ev.input_event_sec) + std::chrono::microseconds(ev.input_event_usec));
+    }
+}
+
+int main() {
+    fake_hidapi::reset();
+    JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+
+    // Registered before the gamepad, so it runs first on each report
+    std::atomic<int64_t> change_ns{0};
+    int last_a = 0;
+    joycon.register_update_hook([&](JoyCon& jc) {
+        int a = jc.get_button_a(jc.get_input_report());
+        if (a != last_a) {
+            last_a = a;
+            change_ns = jc.get_report_time().time_since_epoch().count();
+        }
+    });
+
+    std::unique_ptr<UinputGamepad> gamepad;
+    int fd = -1;
+    try {
+        gamepad = std::make_unique<UinputGamepad>(joycon);
+        fd = ::open(gamepad->get_event_node().c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    } catch (const std::runtime_error& e) {
+        std::printf("skipped: %s\n", e.what());
+        return SKIP_TEST;
+    }
+    if (fd < 0) {
+        std::printf("skipped: cannot open the evdev node\n");
+        return SKIP_TEST;
+    }
+    // Event timestamps on the steady_clock time base
+    int clock = CLOCK_MONOTONIC;
+    CHECK(ioctl(fd, EVIOCSCLOCKID, &clock) == 0);
+
+    std::vector<double> to_event, to_reader;
+    fake_hidapi::Input input;
+    for (int i = 0; i < TOGGLES; ++i) {
+        input.buttons[0] = (i % 2 == 0) ? 0x08 : 0x00;
+        fake_hidapi::set_input(input);
+        int expected = i % 2 == 0 ? 1 : 0;
+        bool seen = false;
+        auto deadline = std::chrono::steady_clock::now() + 500ms;
+        while (!seen && std::chrono::steady_clock::now() < deadline) {
+            pollfd p{fd, POLLIN, 0};
+            if (poll(&p, 1, 100) <= 0) continue;
+            input_event ev;
+            while (read(fd, &ev, sizeof(ev)) == sizeof(ev)) {
+                if (ev.type == EV_KEY && ev.code == BTN_EAST && ev.value == expected) {
+                    auto woke = std::chrono::steady_clock::now();
+                    auto received = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(change_ns.load()));
+                    to_event.push_back(std::chrono::duration<double, std::micro>(event_time(ev) - received).count());
+                    to_reader.push_back(std::chrono::duration<double, std::micro>(woke - received).count());
+                    seen = true;
+                }
+            }
+        }
+        CHECK(seen);
+        std::this_thread::sleep_for(20ms);
+    }
+    ::close(fd);
+
+    std::printf("uinput latency over %d button changes\n", TOGGLES);
+    print("report in -> evdev event", summarize(to_event));
+    print("report in -> reader wakeup", summarize(to_reader));
+    UinputGamepad::LatencyStats stats = gamepad->get_latency_stats();
+    std::printf("  write() returned after        mean %7.1f us, max %7.1f us over %llu reports\n",
+                stats.mean.count() / 1e3, stats.max.count() / 1e3, static_cast<unsigned long long>(stats.reports));
+    CHECK(stats.write_errors == 0);
+    return 0;
+}
@@ -0,0 +1,46 @@
+// check.h
+// Minimal assertions for the test executables: a failed CHECK prints the
+// expression and location and ends the test with exit code 1.
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+
+#define CHECK(expr)                                                             \
+    do {                                                                        \
+        if (!(expr)) {                                                          \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #expr); \
+            std::exit(1);                                                       \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_THROWS(expr, type)                                                \
+    do {                                                                        \
+        bool thrown_ = false;                                                   \
+        try {                                                                   \
+            (void)(expr);                                                       \
+        } catch (const type&) {                                                 \
+            thrown_ = true;                                                     \
+        }                                                                       \
+        if (!thrown_) {                                                         \
+            std::fprintf(stderr, "%s:%d: CHECK_THROWS failed: %s did not throw %s\n", __FILE__, __LINE__, #expr, #type); \
+            std::exit(1);                                                       \
+        }                                                                       \
+    } while (0)
+
+// ctest reports this exit code as skipped, e.g. without /dev/uinput
+constexpr int SKIP_TEST = 77;
+
+// Polls until done() or the timeout, for state set by other threads
+inline bool wait_until(const std::function<bool()>& done, std::chrono::milliseconds timeout = std::chrono::milliseconds(2000)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!done()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
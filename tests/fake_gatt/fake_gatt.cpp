@@ -0,0 +1,54 @@
+#include "fake_gatt.h"
+#include <stdexcept>
+
+FakeGattWriter::FakeGattWriter(const FakeGattOptions& options)
+    : options_(options),
+      start_(std::chrono::steady_clock::now()),
+      event_(-1),
+      event_writes_(0),
+      link_lost_(false)
+{
+    if (options_.connection_interval.count() <= 0 || options_.packets_per_event <= 0) {
+        throw std::invalid_argument("invalid fake link parameters");
+    }
+}
+
+bool FakeGattWriter::write_without_response(const uint8_t* data, size_t size) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (link_lost_) {
+        throw std::runtime_error("GATT link lost");
+    }
+    int64_t event = (now - start_) / options_.connection_interval;
+    if (event != event_) {
+        event_ = event;
+        event_writes_ = 0;
+    }
+    if (event_writes_ >= options_.packets_per_event) {
+        stats_.refused++;
+        return false;
+    }
+    event_writes_++;
+    // Counted once, on the write that crosses the line
+    if (event_writes_ + options_.notifications_per_event == options_.packets_per_event + 1) {
+        stats_.starved_events++;
+    }
+    stats_.writes++;
+    writes_.push_back({now, std::vector<uint8_t>(data, data + size)});
+    return true;
+}
+
+std::vector<FakeGattWriter::Write> FakeGattWriter::get_writes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return writes_;
+}
+
+void FakeGattWriter::set_link_lost(bool lost) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    link_lost_ = lost;
+}
+
+FakeGattWriter::Stats FakeGattWriter::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
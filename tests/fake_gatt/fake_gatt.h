@@ -0,0 +1,53 @@
+#pragma once
+
+#include "joycon2.h"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct FakeGattOptions {
+    std::chrono::microseconds connection_interval{7500};
+    // Packets one connection event carries, writes and notifications together
+    int packets_per_event = 4;
+    // Notification packets the controller sends per event
+    int notifications_per_event = 1;
+};
+
+// In-memory GATT link for running JoyCon2Commands without a controller,
+// e.g. on Linux. Records every write and models the per-connection-event
+// packet budget: writes beyond it are refused like a full OS buffer, and
+// events where writes left too little room for notifications are counted.
+class FakeGattWriter : public GattWriter {
+public:
+    explicit FakeGattWriter(const FakeGattOptions& options = {});
+
+    bool write_without_response(const uint8_t* data, size_t size) override;
+
+    struct Write {
+        std::chrono::steady_clock::time_point time;
+        std::vector<uint8_t> data;
+    };
+    std::vector<Write> get_writes() const;
+
+    // Makes the next writes throw, as a dropped link would
+    void set_link_lost(bool lost);
+
+    struct Stats {
+        uint64_t writes = 0;
+        uint64_t refused = 0;
+        uint64_t starved_events = 0;    // events with less room than notifications_per_event
+    };
+    Stats get_stats() const;
+
+private:
+    FakeGattOptions options_;
+    std::chrono::steady_clock::time_point start_;
+
+    mutable std::mutex mutex_;
+    std::vector<Write> writes_;
+    int64_t event_;
+    int event_writes_;
+    bool link_lost_;
+    Stats stats_;
+};
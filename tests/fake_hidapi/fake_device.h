@@ -0,0 +1,87 @@
+// fake_device.h
+// Control side of the simulated controller behind fake_hidapi.cpp. Every
+// device opened through hid_open() is a Joy-Con that streams input reports
+// at the configured interval, answers subcommands from a simulated SPI
+// flash, runs the USB handshake and emulates the MCU (IR fragments, NFC
+// polling) closely enough for the library's protocol code to run unchanged.
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace fake_hidapi {
+
+struct DeviceOptions {
+    std::chrono::microseconds report_interval{15000};
+    // Bluetooth reports are delivered up to this much late, like the
+    // connection events of a real link; USB reports are not
+    std::chrono::microseconds delivery_jitter{0};
+    // Subcommand replies arrive this long after the request
+    std::chrono::microseconds reply_delay{0};
+    // Every n-th subcommand goes unanswered, 0 answers all
+    int drop_every = 0;
+    // Every n-th SPI read reply echoes a wrong size, 0 echoes all correctly
+    int mismatch_every = 0;
+    // Every n-th IR fragment is lost, 0 loses none
+    int ir_drop_every = 0;
+    // Controller type the charging grip reports (1 left, 2 right)
+    uint8_t grip_type = 1;
+};
+
+// Input state put into every report
+struct Input {
+    std::array<uint8_t, 3> buttons{};       // report bytes 3..5
+    std::array<uint16_t, 4> sticks{0x800, 0x800, 0x800, 0x800};     // L h, L v, R h, R v
+    std::array<int16_t, 3> accel{0, 0, 4096};
+    std::array<int16_t, 3> gyro{};
+    std::array<uint8_t, 3> simple{0x00, 0x00, 0x08};    // 0x3F bytes 1..3, hat 8 is neutral
+};
+
+struct Output {
+    std::vector<uint8_t> data;              // as written, USB frames included
+    std::chrono::steady_clock::time_point time;
+};
+
+struct Stats {
+    uint64_t opens = 0;
+    uint64_t reports = 0;                   // input reports delivered, 0x21 replies excluded
+    uint64_t report_bytes = 0;
+    uint64_t replies = 0;
+    uint64_t dropped_replies = 0;
+    uint64_t mcu_crc_errors = 0;
+    uint64_t usb_handshakes = 0;            // 0x80 0x02
+    uint64_t usb_no_timeouts = 0;           // 0x80 0x04, handshake and keepalives
+};
+
+// Back to defaults: options, input, flash, failures, log and stats
+void reset();
+// Applies to devices opened afterwards
+void set_options(const DeviceOptions& options);
+
+void set_input(const Input& input);
+Input get_input();
+
+// SPI flash, 512 KiB. Starts erased (0xFF) apart from factory IMU and stick
+// calibration that decode to identity/centered values and the colors.
+std::vector<uint8_t> read_flash(uint32_t address, size_t size);
+void write_flash(uint32_t address, const std::vector<uint8_t>& data);
+
+// UID reported once NFC polling runs, empty for no tag in range
+void set_nfc_tag(const std::vector<uint8_t>& uid);
+
+// The next count hid_open calls fail
+void fail_opens(int count);
+// After that many more reads on any device its link is lost: reads fail
+// until the device is closed
+void fail_read_after(int reads);
+
+std::vector<Output> outputs();
+void clear_outputs();
+Stats get_stats();
+
+// True on a thread inside one of the hidapi functions. The simulation
+// allocates where a real backend would not, allocation counting skips it.
+bool in_hidapi_call();
+
+}
@@ -0,0 +1,589 @@
+#include "hidapi.h"
+#include "fake_device.h"
+#include "output_report.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t FLASH_SIZE = 0x80000;
+    constexpr size_t STANDARD_SIZE = 49;
+    constexpr size_t MCU_SIZE = 362;
+    constexpr size_t SIMPLE_SIZE = 12;
+    constexpr size_t USB_SIZE = 64;
+    constexpr size_t MCU_OFFSET = 49;
+    constexpr uint8_t BATTERY = 0x8E;      // full, not charging
+
+    struct Global {
+        std::mutex mutex;
+        std::condition_variable cv;
+        fake_hidapi::DeviceOptions options;
+        fake_hidapi::Input input;
+        uint64_t input_version = 0;
+        std::vector<uint8_t> flash;
+        std::vector<uint8_t> nfc_uid;
+        int open_failures = 0;
+        int reads_until_failure = -1;
+        std::vector<fake_hidapi::Output> outputs;
+        fake_hidapi::Stats stats;
+        std::mt19937 rng{1234};
+    };
+
+    Global& global() {
+        static Global g;
+        return g;
+    }
+
+    thread_local int call_depth = 0;
+
+    struct CallScope {
+        CallScope() { ++call_depth; }
+        ~CallScope() { --call_depth; }
+    };
+
+    void put_stick(uint8_t* out, uint16_t h, uint16_t v) {
+        out[0] = h & 0xFF;
+        out[1] = static_cast<uint8_t>(((h >> 8) & 0x0F) | ((v & 0x0F) << 4));
+        out[2] = static_cast<uint8_t>(v >> 4);
+    }
+
+    void put_int16(uint8_t* out, int16_t value) {
+        out[0] = static_cast<uint8_t>(value & 0xFF);
+        out[1] = static_cast<uint8_t>((value >> 8) & 0xFF);
+    }
+
+    void init_flash(std::vector<uint8_t>& flash) {
+        flash.assign(FLASH_SIZE, 0xFF);
+        // Factory IMU calibration: no offsets, reference coefficients
+        uint8_t* imu = flash.data() + 0x6020;
+        for (int a = 0; a < 3; ++a) {
+            put_int16(imu + a * 2, 0);
+            put_int16(imu + 6 + a * 2, 0x4000);
+            put_int16(imu + 12 + a * 2, 0);
+            put_int16(imu + 18 + a * 2, 0x343B);
+        }
+        // Factory stick calibration, centered at 0x800 with 0x600 range.
+        // Left: above, center, below; right: center, below, above.
+        put_stick(flash.data() + 0x603D, 0x600, 0x600);
+        put_stick(flash.data() + 0x6040, 0x800, 0x800);
+        put_stick(flash.data() + 0x6043, 0x600, 0x600);
+        put_stick(flash.data() + 0x6046, 0x800, 0x800);
+        put_stick(flash.data() + 0x6049, 0x600, 0x600);
+        put_stick(flash.data() + 0x604C, 0x600, 0x600);
+        const uint8_t colors[] = {0x82, 0x82, 0x82, 0x0F, 0x0F, 0x0F};
+        std::copy(std::begin(colors), std::end(colors), flash.begin() + 0x6050);
+    }
+
+    struct Delivery {
+        Clock::time_point due;
+        std::vector<uint8_t> data;
+    };
+}
+
+struct hid_device_ {
+    uint16_t product_id = 0;
+    uint8_t type = 0;
+    fake_hidapi::DeviceOptions options;
+    bool nonblocking = false;
+    bool usb_link = false;      // opened as grip or Pro, frames of 64 bytes
+    bool usb_streaming = false;
+    bool failed = false;
+    uint8_t mode = 0x3F;        // what a controller sends after pairing
+    uint8_t timer = 0;
+    Clock::time_point next_report;
+    Clock::time_point next_delivery;
+    uint64_t simple_version = 0;
+    std::deque<Delivery> replies;
+    uint64_t subcommands = 0;
+    uint64_t spi_reads = 0;
+
+    // MCU
+    uint8_t mcu_state = 0;
+    bool status_pending = false;
+    bool ir = false;
+    uint8_t max_fragment = 0;
+    uint8_t next_fragment = 0;
+    int resend = -1;
+    uint64_t ir_fragments = 0;
+    bool nfc_polling = false;
+};
+
+namespace {
+    bool streaming(const hid_device* d) {
+        return !d->usb_link || d->usb_streaming;
+    }
+
+    void put_input(uint8_t* r, const hid_device* d, const fake_hidapi::Input& input) {
+        r[1] = d->timer;
+        r[2] = BATTERY;
+        std::copy(input.buttons.begin(), input.buttons.end(), r + 3);
+        put_stick(r + 6, input.sticks[0], input.sticks[1]);
+        put_stick(r + 9, input.sticks[2], input.sticks[3]);
+        r[12] = 0x00;
+    }
+
+    void schedule_next(hid_device* d, Global& g) {
+        d->next_report += d->options.report_interval;
+        auto delivery = d->next_report;
+        if (!d->usb_link && d->options.delivery_jitter.count() > 0) {
+            std::uniform_int_distribution<int64_t> jitter(0, d->options.delivery_jitter.count());
+            delivery += std::chrono::microseconds(jitter(g.rng));
+        }
+        // Links deliver in order
+        d->next_delivery = std::max(delivery, d->next_delivery);
+    }
+
+    void put_mcu(uint8_t* m, hid_device* d, Global& g) {
+        if (d->status_pending) {
+            d->status_pending = false;
+            m[0] = 0x01;
+            m[7] = d->mcu_state;
+            return;
+        }
+        if (d->ir && d->mcu_state == 0x07) {
+            uint8_t fragment;
+            if (d->resend >= 0) {
+                fragment = static_cast<uint8_t>(d->resend);
+                d->resend = -1;
+            } else {
+                fragment = d->next_fragment;
+                d->next_fragment = d->next_fragment >= d->max_fragment ? 0 : d->next_fragment + 1;
+            }
+            ++d->ir_fragments;
+            if (d->options.ir_drop_every > 0 && d->ir_fragments % d->options.ir_drop_every == 0) {
+                m[0] = 0xFF;
+                return;
+            }
+            m[0] = 0x03;
+            m[3] = fragment;
+            std::memset(m + 10, fragment, 300);
+            return;
+        }
+        if (d->nfc_polling && d->mcu_state == 0x04) {
+            m[0] = 0x2A;
+            if (g.nfc_uid.empty()) {
+                m[7] = 0x01;
+            } else {
+                m[7] = 0x09;
+                m[15] = static_cast<uint8_t>(g.nfc_uid.size());
+                std::copy(g.nfc_uid.begin(), g.nfc_uid.end(), m + 16);
+            }
+            return;
+        }
+        m[0] = 0xFF;
+    }
+
+    // The report due now, empty when simple mode has nothing new to send
+    std::vector<uint8_t> next_input_report(hid_device* d, Global& g) {
+        auto ticks = std::max<int64_t>(d->options.report_interval / std::chrono::microseconds(5000), 1);
+        // Like the host's report queue, only the recent backlog of a device
+        // nobody read from is kept
+        auto behind = (Clock::now() - d->next_report) / d->options.report_interval;
+        if (behind > 32) {
+            d->next_report += (behind - 32) * d->options.report_interval;
+            d->next_delivery = std::max(d->next_delivery, d->next_report);
+            d->timer = static_cast<uint8_t>(d->timer + (behind - 32) * ticks);
+        }
+        d->timer = static_cast<uint8_t>(d->timer + ticks);
+        schedule_next(d, g);
+
+        std::vector<uint8_t> r;
+        if (d->mode == 0x3F) {
+            if (d->simple_version == g.input_version) {
+                return r;
+            }
+            d->simple_version = g.input_version;
+            r.assign(SIMPLE_SIZE, 0);
+            r[0] = 0x3F;
+            std::copy(g.input.simple.begin(), g.input.simple.end(), r.begin() + 1);
+            for (size_t i = 4; i < SIMPLE_SIZE; i += 2) {
+                r[i] = 0x00;
+                r[i + 1] = 0x80;
+            }
+        } else {
+            r.assign(d->mode == 0x31 && !d->usb_link ? MCU_SIZE : STANDARD_SIZE, 0);
+            r[0] = d->mode == 0x31 ? 0x31 : 0x30;
+            put_input(r.data(), d, g.input);
+            for (int sample = 0; sample < 3; ++sample) {
+                uint8_t* p = r.data() + 13 + sample * 12;
+                for (int a = 0; a < 3; ++a) {
+                    put_int16(p + a * 2, g.input.accel[a]);
+                    put_int16(p + 6 + a * 2, g.input.gyro[a]);
+                }
+            }
+            if (r.size() == MCU_SIZE) {
+                put_mcu(r.data() + MCU_OFFSET, d, g);
+            }
+        }
+        if (d->usb_link) {
+            r.resize(USB_SIZE, 0);
+        }
+        return r;
+    }
+
+    void handle_mcu_config(hid_device* d, Global& g, const uint8_t* data) {
+        if (output_report::mcu_crc8(data + 12, 36) != data[48]) {
+            g.stats.mcu_crc_errors++;
+            return;
+        }
+        if (data[11] == 0x21) {
+            uint8_t mode = data[13];
+            d->mcu_state = mode == 0x05 ? 0x07 : mode;
+        } else if (data[11] == 0x23 && data[12] == 0x01) {
+            d->ir = true;
+            d->max_fragment = data[14];
+            d->next_fragment = 0;
+            d->resend = -1;
+        }
+    }
+
+    void handle_subcommand(hid_device* d, Global& g, const uint8_t* data, size_t length) {
+        uint8_t id = data[10];
+        std::vector<uint8_t> r(STANDARD_SIZE, 0);
+        r[0] = 0x21;
+        put_input(r.data(), d, g.input);
+        r[13] = 0x80;
+        r[14] = id;
+        switch (id) {
+            case 0x02:
+                r[13] = 0x82;
+                r[15] = 0x03;
+                r[16] = 0x8B;
+                r[17] = d->type;
+                r[18] = 0x02;
+                for (int i = 0; i < 6; ++i) r[19 + i] = static_cast<uint8_t>(0x10 + i);
+                break;
+            case 0x03:
+                d->mode = data[11];
+                break;
+            case 0x10: {
+                r[13] = 0x90;
+                std::copy(data + 11, data + 16, r.begin() + 15);
+                uint32_t address = data[11] | (data[12] << 8) | (data[13] << 16) | (static_cast<uint32_t>(data[14]) << 24);
+                size_t size = std::min<size_t>(data[15], 0x1D);
+                for (size_t i = 0; i < size; ++i) {
+                    r[20 + i] = address + i < FLASH_SIZE ? g.flash[address + i] : 0xFF;
+                }
+                ++d->spi_reads;
+                if (d->options.mismatch_every > 0 && d->spi_reads % d->options.mismatch_every == 0) {
+                    r[19] ^= 0xFF;
+                }
+                break;
+            }
+            case 0x11: {
+                uint32_t address = data[11] | (data[12] << 8) | (data[13] << 16) | (static_cast<uint32_t>(data[14]) << 24);
+                size_t size = data[15];
+                bool fits = size <= 0x1D && length >= 16 + size && address + size <= FLASH_SIZE;
+                if (fits) {
+                    std::copy(data + 16, data + 16 + size, g.flash.begin() + address);
+                }
+                r[15] = fits ? 0x00 : 0x01;
+                break;
+            }
+            case 0x21:
+                handle_mcu_config(d, g, data);
+                r[13] = 0xA0;
+                break;
+            case 0x22:
+                d->mcu_state = data[11] == 0x01 ? 0x01 : 0x00;
+                if (d->mcu_state == 0) {
+                    d->ir = false;
+                    d->nfc_polling = false;
+                }
+                break;
+            default:
+                break;
+        }
+        ++d->subcommands;
+        if (d->options.drop_every > 0 && d->subcommands % d->options.drop_every == 0) {
+            g.stats.dropped_replies++;
+            return;
+        }
+        if (d->usb_link) {
+            r.resize(USB_SIZE, 0);
+        }
+        auto due = Clock::now() + d->options.reply_delay;
+        if (!d->replies.empty()) {
+            due = std::max(due, d->replies.back().due);
+        }
+        d->replies.push_back({due, std::move(r)});
+    }
+
+    void handle_mcu_request(hid_device* d, Global& g, const uint8_t* data) {
+        if (output_report::mcu_crc8(data + 11, 36) != data[48]) {
+            g.stats.mcu_crc_errors++;
+            return;
+        }
+        switch (data[10]) {
+            case 0x01:
+                d->status_pending = true;
+                break;
+            case 0x02:
+                if (data[11] == 0x01) d->nfc_polling = true;
+                if (data[11] == 0x02) d->nfc_polling = false;
+                break;
+            case 0x03:
+                if (data[11] == 0x01) d->resend = data[12];
+                break;
+            default:
+                break;
+        }
+    }
+
+    void handle_usb_command(hid_device* d, Global& g, const uint8_t* data) {
+        uint8_t command = data[1];
+        if (command == 0x04) {
+            // Keepalives repeat it without restarting the report cadence
+            if (!d->usb_streaming) {
+                d->next_report = Clock::now();
+                d->next_delivery = d->next_report;
+            }
+            d->usb_streaming = true;
+            g.stats.usb_no_timeouts++;
+            return;
+        }
+        if (command == 0x05) {
+            d->usb_streaming = false;
+            return;
+        }
+        if (command == 0x02) {
+            g.stats.usb_handshakes++;
+        }
+        std::vector<uint8_t> r(USB_SIZE, 0);
+        r[0] = 0x81;
+        r[1] = command;
+        if (command == 0x01) {
+            r[3] = d->type;
+        }
+        d->replies.push_back({Clock::now(), std::move(r)});
+    }
+
+    int deliver(const std::vector<uint8_t>& report, unsigned char* data, size_t length) {
+        size_t size = std::min(length, report.size());
+        std::copy_n(report.begin(), size, data);
+        return static_cast<int>(size);
+    }
+}
+
+namespace fake_hidapi {
+
+void reset() {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    g.options = DeviceOptions{};
+    g.input = Input{};
+    g.input_version++;
+    init_flash(g.flash);
+    g.nfc_uid.clear();
+    g.open_failures = 0;
+    g.reads_until_failure = -1;
+    g.outputs.clear();
+    g.stats = Stats{};
+    g.rng.seed(1234);
+}
+
+void set_options(const DeviceOptions& options) {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    g.options = options;
+}
+
+void set_input(const Input& input) {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    g.input = input;
+    g.input_version++;
+    g.cv.notify_all();
+}
+
+Input get_input() {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    return g.input;
+}
+
+std::vector<uint8_t> read_flash(uint32_t address, size_t size) {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    if (g.flash.empty()) init_flash(g.flash);
+    return std::vector<uint8_t>(g.flash.begin() + address, g.flash.begin() + address + size);
+}
+
+void write_flash(uint32_t address, const std::vector<uint8_t>& data) {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    if (g.flash.empty()) init_flash(g.flash);
+    std::copy(data.begin(), data.end(), g.flash.begin() + address);
+}
+
+void set_nfc_tag(const std::vector<uint8_t>& uid) {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    g.nfc_uid = uid;
+}
+
+void fail_opens(int count) {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    g.open_failures = count;
+}
+
+void fail_read_after(int reads) {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    g.reads_until_failure = reads;
+}
+
+std::vector<Output> outputs() {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    return g.outputs;
+}
+
+void clear_outputs() {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    g.outputs.clear();
+}
+
+Stats get_stats() {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    return g.stats;
+}
+
+bool in_hidapi_call() {
+    return call_depth > 0;
+}
+
+}
+
+extern "C" {
+
+int hid_init(void) {
+    return 0;
+}
+
+int hid_exit(void) {
+    return 0;
+}
+
+struct hid_device_info* hid_enumerate(unsigned short, unsigned short) {
+    return nullptr;
+}
+
+void hid_free_enumeration(struct hid_device_info*) {
+}
+
+hid_device* hid_open(unsigned short, unsigned short product_id, const wchar_t*) {
+    CallScope scope;
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    if (g.flash.empty()) init_flash(g.flash);
+    if (g.open_failures > 0) {
+        g.open_failures--;
+        return nullptr;
+    }
+    g.stats.opens++;
+    auto* d = new hid_device_;
+    d->product_id = product_id;
+    d->options = g.options;
+    switch (product_id) {
+        case 0x2006: d->type = 1; break;
+        case 0x2007: d->type = 2; break;
+        case 0x2009: d->type = 3; break;
+        default: d->type = g.options.grip_type; break;
+    }
+    d->usb_link = product_id == 0x200E;
+    d->next_report = Clock::now();
+    d->next_delivery = d->next_report;
+    d->simple_version = g.input_version;
+    return d;
+}
+
+void hid_close(hid_device* dev) {
+    CallScope scope;
+    delete dev;
+}
+
+int hid_set_nonblocking(hid_device* dev, int nonblock) {
+    dev->nonblocking = nonblock != 0;
+    return 0;
+}
+
+const wchar_t* hid_error(hid_device*) {
+    return L"fake hidapi error";
+}
+
+int hid_write(hid_device* dev, const unsigned char* data, size_t length) {
+    CallScope scope;
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    if (dev->failed) {
+        return -1;
+    }
+    g.outputs.push_back({std::vector<uint8_t>(data, data + length), Clock::now()});
+    // The Pro Controller cable is a USB link too, it starts streaming once
+    // the handshake ends
+    if (data[0] == output_report::USB_COMMAND && length >= 2) {
+        dev->usb_link = true;
+        handle_usb_command(dev, g, data);
+    } else if (data[0] == output_report::RUMBLE_AND_SUBCOMMAND && length >= 11) {
+        std::array<uint8_t, STANDARD_SIZE> padded{};
+        std::copy_n(data, std::min(length, padded.size()), padded.begin());
+        handle_subcommand(dev, g, padded.data(), length);
+    } else if (data[0] == output_report::MCU_REQUEST && length >= STANDARD_SIZE) {
+        handle_mcu_request(dev, g, data);
+    }
+    g.cv.notify_all();
+    return static_cast<int>(length);
+}
+
+int hid_read_timeout(hid_device* dev, unsigned char* data, size_t length, int milliseconds) {
+    CallScope scope;
+    Global& g = global();
+    std::unique_lock<std::mutex> lock(g.mutex);
+    if (g.reads_until_failure >= 0 && g.reads_until_failure-- == 0) {
+        dev->failed = true;
+    }
+    if (dev->failed) {
+        return -1;
+    }
+    auto deadline = milliseconds < 0 ? Clock::time_point::max() : Clock::now() + std::chrono::milliseconds(milliseconds);
+    while (true) {
+        auto now = Clock::now();
+        if (!dev->replies.empty() && dev->replies.front().due <= now) {
+            auto reply = std::move(dev->replies.front().data);
+            dev->replies.pop_front();
+            if (reply[0] == 0x21) g.stats.replies++;
+            return deliver(reply, data, length);
+        }
+        if (streaming(dev) && dev->next_delivery <= now) {
+            auto report = next_input_report(dev, g);
+            if (!report.empty()) {
+                g.stats.reports++;
+                g.stats.report_bytes += report.size();
+                return deliver(report, data, length);
+            }
+            continue;
+        }
+        if (milliseconds == 0 || now >= deadline) {
+            return 0;
+        }
+        auto wake = deadline;
+        if (!dev->replies.empty()) wake = std::min(wake, dev->replies.front().due);
+        if (streaming(dev)) wake = std::min(wake, dev->next_delivery);
+        g.cv.wait_until(lock, wake);
+    }
+}
+
+int hid_read(hid_device* dev, unsigned char* data, size_t length) {
+    return hid_read_timeout(dev, data, length, dev->nonblocking ? 0 : -1);
+}
+
+}
@@ -0,0 +1,18 @@
+#include "fake_input_c.h"
+#include "fake_device.h"
+
+extern "C" {
+
+void fake_hidapi_set_buttons(uint8_t byte3, uint8_t byte4, uint8_t byte5) {
+    fake_hidapi::Input input = fake_hidapi::get_input();
+    input.buttons = {byte3, byte4, byte5};
+    fake_hidapi::set_input(input);
+}
+
+void fake_hidapi_set_report_interval_us(uint32_t interval_us) {
+    fake_hidapi::DeviceOptions options;
+    options.report_interval = std::chrono::microseconds(interval_us);
+    fake_hidapi::set_options(options);
+}
+
+}
@@ -0,0 +1,18 @@
+/* C access to the simulated controller for test_c_api, built into the
+ * joycon_c_fake library next to the C API so both share one fake. */
+#pragma once
+#include "joycon_c.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Report bytes 3..5 of every following report */
+JOYCON_C_API void fake_hidapi_set_buttons(uint8_t byte3, uint8_t byte4, uint8_t byte5);
+/* Report interval of devices opened afterwards */
+JOYCON_C_API void fake_hidapi_set_report_interval_us(uint32_t interval_us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,94 @@
+// Output reports are built and sent without touching the heap: operator new
+// is replaced with a counting one and the builders and the JoyCon send
+// paths (lamp, vibration, rumble) run under it. Allocations of the
+// simulated controller itself are not counted, a real hidapi write does
+// not allocate either.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "output_report.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+    thread_local bool counting = false;
+    thread_local uint64_t allocations = 0;
+    int* volatile sink = nullptr;
+
+    void* counted_alloc(std::size_t size) {
+        if (counting && !fake_hidapi::in_hidapi_call()) {
+            ++allocations;
+        }
+        if (void* p = std::malloc(size ? size : 1)) {
+            return p;
+        }
+        throw std::bad_alloc();
+    }
+
+    struct CountAllocations {
+        CountAllocations() { allocations = 0; counting = true; }
+        ~CountAllocations() { counting = false; }
+        uint64_t count() const { return allocations; }
+    };
+}
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try { return counted_alloc(size); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try { return counted_alloc(size); } catch (...) { return nullptr; }
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+int main() {
+    // The counter itself must see allocations
+    {
+        CountAllocations counter;
+        // Through a volatile, so the pair cannot be elided
+        sink = new int(1);
+        delete sink;
+        CHECK(counter.count() == 1);
+    }
+
+    {
+        CountAllocations counter;
+        uint64_t checksum = 0;
+        for (int i = 0; i < 1000; ++i) {
+            using namespace output_report;
+            auto lights = build_subcommand(static_cast<uint8_t>(i), Rumble{}, SetPlayerLights{player_lamp_pattern(1 + i % 8)});
+            auto spi = build_subcommand(static_cast<uint8_t>(i), Rumble{}, SpiFlashWrite{0x8010, static_cast<uint8_t>(i % (SpiFlashWrite::MAX_SIZE + 1))});
+            auto ir = build_subcommand(0, Rumble{}, SetIrConfig{static_cast<uint8_t>(i)});
+            auto ack = build_mcu_request(0, Rumble{}, IrAck{static_cast<uint8_t>(i)});
+            auto rumble = build_rumble(static_cast<uint8_t>(i), Rumble{});
+            checksum += lights.size + spi.size + ir.size + ack.size + rumble.size;
+        }
+        CHECK(checksum > 0);
+        CHECK(counter.count() == 0);
+    }
+
+    fake_hidapi::reset();
+    JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+    // First use of each path outside the counter
+    joycon.set_player_lamp(1);
+    joycon.enable_vibration(true);
+    joycon.rumble_simple();
+    joycon.rumble_stop();
+    {
+        CountAllocations counter;
+        for (int i = 0; i < 200; ++i) {
+            joycon.set_player_lamp(1 + i % 8);
+            joycon.set_player_lamp_flashing(1 + i % 4);
+            joycon.enable_vibration(i % 2 == 0);
+            joycon.rumble_bump();
+            joycon.rumble_stop();
+        }
+        CHECK(counter.count() == 0);
+    }
+    return 0;
+}
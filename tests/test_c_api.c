@@ -0,0 +1,153 @@
+/* The C API from C, through the shared library: open, poll, events, lamp
+ * and error reporting against the simulated controller. Buttons are
+ * driven through the fake's C helpers. */
+#define _POSIX_C_SOURCE 199309L
+#include "joycon_c.h"
+#include "fake_hidapi/fake_input_c.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #expr); \
+            abort(); \
+        } \
+    } while (0)
+
+static void sleep_ms(long ms) {
+    struct timespec t = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&t, NULL);
+}
+
+/* Waits until every handle delivered at least two reports more, so all of
+ * them saw the input set before */
+static void wait_reports(joycon_handle* const* handles, size_t count) {
+    joycon_snapshot before[2], now[2];
+    size_t i, done;
+    int attempt;
+    CHECK(count <= 2);
+    CHECK(joycon_poll_many(handles, count, before) == JOYCON_OK);
+    for (attempt = 0; attempt < 2000; ++attempt) {
+        CHECK(joycon_poll_many(handles, count, now) == JOYCON_OK);
+        for (i = 0, done = 0; i < count; ++i) {
+            if (now[i].report_count >= before[i].report_count + 2) ++done;
+        }
+        if (done == count) return;
+        sleep_ms(1);
+    }
+    CHECK(!"no reports");
+}
+
+static void test_events(joycon_handle* const* handles) {
+    joycon_event events[8];
+    int i;
+
+    /* A pressed and released, each handle in turn, oldest first */
+    fake_hidapi_set_buttons(0x08, 0x00, 0x00);
+    wait_reports(handles, 2);
+    fake_hidapi_set_buttons(0x00, 0x00, 0x00);
+    wait_reports(handles, 2);
+    CHECK(joycon_drain_events(handles, 2, events, 8) == 4);
+    for (i = 0; i < 4; ++i) {
+        CHECK(events[i].handle_index == (uint32_t)(i / 2));
+    }
+    CHECK(events[0].pressed == 0x08 && events[0].released == 0 && events[0].buttons == 0x08);
+    CHECK(events[1].pressed == 0 && events[1].released == 0x08 && events[1].buttons == 0);
+    CHECK(events[0].host_time_ns < events[1].host_time_ns);
+    CHECK(events[2].pressed == 0x08 && events[3].released == 0x08);
+    CHECK(joycon_drain_events(handles, 2, events, 8) == 0);
+
+    /* ZL (byte 5 bit 7) with R (byte 3 bit 6), then max cuts the drain
+     * short and the rest waits for the next call */
+    fake_hidapi_set_buttons(0x40, 0x00, 0x80);
+    wait_reports(handles, 2);
+    fake_hidapi_set_buttons(0x00, 0x00, 0x00);
+    wait_reports(handles, 2);
+    CHECK(joycon_drain_events(handles, 2, events, 3) == 3);
+    CHECK(events[0].handle_index == 0 && events[1].handle_index == 0 && events[2].handle_index == 1);
+    CHECK(events[0].pressed == 0x800040 && events[1].released == 0x800040);
+    CHECK(events[2].pressed == 0x800040);
+    CHECK(joycon_drain_events(handles, 2, events, 8) == 1);
+    CHECK(events[0].handle_index == 1 && events[0].released == 0x800040);
+    CHECK(joycon_drain_events(handles, 2, events, 0) == 0);
+    CHECK(joycon_dropped_events(handles[0]) == 0 && joycon_dropped_events(handles[1]) == 0);
+}
+
+static void test_event_overflow(void) {
+    enum { CHANGES = 300, CAPACITY = 256 };
+    static joycon_event events[CHANGES];
+    joycon_handle* handle = NULL;
+    int i;
+
+    /* A fast device so the ring fills quickly, nobody draining it */
+    fake_hidapi_set_report_interval_us(2000);
+    CHECK(joycon_open(0x2007, NULL, &handle) == JOYCON_OK);
+    fake_hidapi_set_report_interval_us(15000);
+    wait_reports(&handle, 1);
+    for (i = 0; i < CHANGES; ++i) {
+        fake_hidapi_set_buttons(i % 2 ? 0x00 : 0x04, 0x00, 0x00);
+        wait_reports(&handle, 1);
+    }
+    /* The oldest are kept, the newest counted as dropped */
+    CHECK(joycon_dropped_events(handle) == CHANGES - CAPACITY);
+    CHECK(joycon_drain_events(&handle, 1, events, CHANGES) == CAPACITY);
+    CHECK(events[0].pressed == 0x04 && events[1].released == 0x04);
+    CHECK(events[CAPACITY - 1].released == 0x04);
+
+    /* Room again */
+    fake_hidapi_set_buttons(0x04, 0x00, 0x00);
+    wait_reports(&handle, 1);
+    CHECK(joycon_drain_events(&handle, 1, events, CHANGES) == 1);
+    CHECK(events[0].pressed == 0x04);
+    CHECK(joycon_dropped_events(handle) == CHANGES - CAPACITY);
+    fake_hidapi_set_buttons(0x00, 0x00, 0x00);
+    joycon_close(handle);
+}
+
+int main(void) {
+    joycon_handle* handles[2] = {NULL, NULL};
+    joycon_snapshot snapshots[2];
+    joycon_event events[64];
+    int attempt;
+
+    CHECK(joycon_api_version() == JOYCON_C_API_VERSION);
+    CHECK(joycon_open(0x1234, NULL, &handles[0]) == JOYCON_ERROR_INVALID_ARGUMENT);
+    CHECK(joycon_last_error()[0] != '\0');
+
+    CHECK(joycon_open(0x2007, NULL, &handles[0]) == JOYCON_OK);
+    CHECK(joycon_open(0x2006, NULL, &handles[1]) == JOYCON_OK);
+    CHECK(joycon_last_error()[0] == '\0');
+
+    for (attempt = 0; attempt < 200; ++attempt) {
+        CHECK(joycon_poll_many(handles, 2, snapshots) == JOYCON_OK);
+        if (snapshots[0].report_count > 3 && snapshots[1].report_count > 3) break;
+        sleep_ms(10);
+    }
+    CHECK(snapshots[0].product_id == 0x2007);
+    CHECK(snapshots[1].product_id == 0x2006);
+    CHECK(snapshots[0].report_count > 3 && snapshots[1].report_count > 3);
+    CHECK(snapshots[0].accel[2] > 0.0f);      /* resting flat, gravity on z */
+
+    /* Input does not change, no button events */
+    CHECK(joycon_drain_events(handles, 2, events, 64) == 0);
+    CHECK(joycon_dropped_events(handles[0]) == 0);
+
+    test_events(handles);
+
+    CHECK(joycon_set_player_lamp(handles[0], 2) == JOYCON_OK);
+    CHECK(joycon_set_player_lamp(handles[0], 99) == JOYCON_ERROR_INVALID_ARGUMENT);
+    CHECK(joycon_last_error()[0] != '\0');
+    /* Success clears the error of an earlier call */
+    CHECK(joycon_poll_many(handles, 2, snapshots) == JOYCON_OK);
+    CHECK(joycon_last_error()[0] == '\0');
+    CHECK(joycon_poll_many(NULL, 1, snapshots) == JOYCON_ERROR_INVALID_ARGUMENT);
+    CHECK(joycon_last_error()[0] != '\0');
+
+    joycon_close(handles[0]);
+    joycon_close(handles[1]);
+
+    test_event_overflow();
+    return 0;
+}
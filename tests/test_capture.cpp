@@ -0,0 +1,95 @@
+// Stick calibration from the simulated SPI flash, and a capture of it:
+// the header records the stick centers and status offset, the analyzer
+// measures stick drift against those centers.
+#include "check.h"
+#include "capture_analyzer.h"
+#include "capture_writer.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace {
+    // Three horizontal/vertical pairs, 12 bits each
+    std::vector<uint8_t> encode_stick(std::initializer_list<std::array<uint16_t, 2>> values) {
+        std::vector<uint8_t> out;
+        for (const auto& v : values) {
+            out.push_back(static_cast<uint8_t>(v[0] & 0xFF));
+            out.push_back(static_cast<uint8_t>((v[0] >> 8) | ((v[1] & 0x0F) << 4)));
+            out.push_back(static_cast<uint8_t>(v[1] >> 4));
+        }
+        return out;
+    }
+
+    void test_stick_calibration() {
+        fake_hidapi::reset();
+        JoyCon factory(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        auto sticks = factory.get_stick_calibration();
+        CHECK(sticks[1].center == (std::array<uint16_t, 2>{0x800, 0x800}));
+        CHECK(sticks[1].above == (std::array<uint16_t, 2>{0x600, 0x600}));
+        CHECK(sticks[1].below == (std::array<uint16_t, 2>{0x600, 0x600}));
+
+        // User calibration of the left stick: magic, above, center, below
+        std::vector<uint8_t> user = {0xB2, 0xA1};
+        auto values = encode_stick({{0x580, 0x590}, {0x7F0, 0x810}, {0x5A0, 0x5B0}});
+        user.insert(user.end(), values.begin(), values.end());
+        fake_hidapi::write_flash(0x8010, user);
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        sticks = joycon.get_stick_calibration();
+        CHECK(sticks[0].center == (std::array<uint16_t, 2>{0x7F0, 0x810}));
+        CHECK(sticks[0].above == (std::array<uint16_t, 2>{0x580, 0x590}));
+        CHECK(sticks[0].below == (std::array<uint16_t, 2>{0x5A0, 0x5B0}));
+        // A left Joy-Con has no right stick
+        CHECK(sticks[1].center == (std::array<uint16_t, 2>{0x800, 0x800}));
+        CHECK(joycon.get_calibration().sticks[0].center == sticks[0].center);
+    }
+
+    void test_capture_drift() {
+        fake_hidapi::reset();
+        std::vector<uint8_t> user = {0xB2, 0xA1};
+        auto values = encode_stick({{0x600, 0x600}, {0x7F0, 0x810}, {0x600, 0x600}});
+        user.insert(user.end(), values.begin(), values.end());
+        fake_hidapi::write_flash(0x8010, user);
+        fake_hidapi::Input input;
+        input.sticks = {0x7F0 + 12, 0x810 - 7, 0x800, 0x800};
+        fake_hidapi::set_input(input);
+
+        const std::string path = "test_capture.jcap";
+        {
+            JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+            CHECK(wait_until([&] { return joycon.get_report_stats().reports > 2; }));
+            joycon.status_offset();
+            CaptureWriter writer(joycon, path);
+            CHECK(wait_until([&] { return writer.get_records() >= 20; }));
+        }
+
+        joycon_capture::FileHeader header{};
+        std::ifstream file(path, std::ios::binary);
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        CHECK(file.good());
+        CHECK(header.version == 2);
+        CHECK(header.header_size == sizeof(header));
+        CHECK(header.stick_center[0] == 0x7F0 && header.stick_center[1] == 0x810);
+        CHECK(header.status_offset.sticks[0] == 0x7F0 + 12);
+        CHECK(header.status_offset.sticks[1] == 0x810 - 7);
+        CHECK(header.calibration.accel_coeff[2] != 0.0f);
+
+        AnalyzerOptions options;
+        options.keep_columns = false;
+        auto result = analyze_captures({path}, options);
+        const SessionStats& stats = result.sessions[0].stats;
+        CHECK(stats.reports >= 20);
+        CHECK(stats.stick_center[0] == 0x7F0);
+        CHECK(stats.stick_rest_offset[0] == 12.0);
+        CHECK(stats.stick_rest_offset[1] == -7.0);
+        std::remove(path.c_str());
+    }
+}
+
+int main() {
+    test_stick_calibration();
+    test_capture_drift();
+    return 0;
+}
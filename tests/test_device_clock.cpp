@@ -0,0 +1,124 @@
+// DeviceClock on synthetic (timer, host time) input: unwrapping across
+// timer wraps and long gaps, the lower envelope of delivery delay, and
+// drift between the device and host clocks.
+#include "check.h"
+#include "device_clock.h"
+#include <cmath>
+#include <random>
+
+using namespace std::chrono_literals;
+
+namespace {
+    using clock = DeviceClock::clock;
+
+    // A controller reporting every 3 ticks (15 ms), its clock running
+    // drift fast against the host
+    struct Device {
+        clock::time_point start = clock::time_point(100s);
+        double drift = 0.0;
+        int64_t ticks = 0;
+
+        clock::time_point tick_time(int64_t t) const {
+            double host = t * DeviceClock::TICK_PERIOD * (1.0 + drift);
+            return start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(host));
+        }
+        uint8_t timer() const { return static_cast<uint8_t>(ticks & 0xFF); }
+    };
+
+    double ms(clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    void test_unwrap() {
+        DeviceClock dc;
+        Device device;
+        CHECK(!dc.synchronized());
+        dc.update(device.timer(), device.tick_time(0));
+        CHECK(dc.synchronized());
+        // Several wraps of the 8-bit timer
+        for (int i = 0; i < 500; ++i) {
+            device.ticks += 3;
+            dc.update(device.timer(), device.tick_time(device.ticks));
+            CHECK(dc.ticks() == device.ticks);
+        }
+        // 2 s without reports, the timer wrapped more than once meanwhile
+        device.ticks += 400;
+        dc.update(device.timer(), device.tick_time(device.ticks));
+        CHECK(dc.ticks() == device.ticks);
+        device.ticks += 3;
+        dc.update(device.timer(), device.tick_time(device.ticks));
+        CHECK(dc.ticks() == device.ticks);
+
+        // IMU samples 5 ms apart, the newest on the report tick
+        auto samples = dc.sample_times();
+        CHECK(samples[2] == dc.to_host(dc.ticks()));
+        CHECK(std::fabs(ms(samples[2] - samples[1]) - 5.0) < 0.01);
+        CHECK(std::fabs(ms(samples[1] - samples[0]) - 5.0) < 0.01);
+    }
+
+    void test_lower_envelope() {
+        DeviceClock dc;
+        Device device;
+        // 1 ms minimum latency, up to 8 ms of jitter, 1 report in 10 at
+        // the minimum
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<double> jitter(0.0, 8.0);
+        auto delay = [&](int i) {
+            double extra = i % 10 == 0 ? 0.0 : jitter(rng);
+            return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(1.0 + extra));
+        };
+        dc.update(device.timer(), device.tick_time(0) + delay(1));
+        double worst = 0.0;
+        for (int i = 1; i < 1000; ++i) {
+            device.ticks += 3;
+            auto received = device.tick_time(device.ticks) + delay(i);
+            auto host = dc.update(device.timer(), received);
+            // Never later than the report arrived
+            CHECK(host <= received);
+            if (i > 100) {
+                // The tick itself plus the 1 ms minimum latency
+                double error = ms(host - (device.tick_time(device.ticks) + 1ms));
+                worst = std::max(worst, std::fabs(error));
+            }
+        }
+        CHECK(worst < 0.5);
+    }
+
+    void test_drift() {
+        for (double drift : {100e-6, -200e-6}) {
+            DeviceClock dc;
+            Device device;
+            device.drift = drift;
+            dc.update(device.timer(), device.tick_time(0));
+            // One minute of reports with 0-4 ms of jitter
+            std::mt19937 rng(11);
+            std::uniform_int_distribution<int> jitter_us(0, 4000);
+            for (int i = 1; i < 4000; ++i) {
+                device.ticks += 3;
+                auto received = device.tick_time(device.ticks) + std::chrono::microseconds(i % 8 == 0 ? 0 : jitter_us(rng));
+                dc.update(device.timer(), received);
+            }
+            CHECK(std::fabs(dc.drift_ppm() - drift * 1e6) < 20.0);
+            // The model still tracks the tick after a minute
+            CHECK(std::fabs(ms(dc.to_host(dc.ticks()) - device.tick_time(device.ticks))) < 0.5);
+        }
+    }
+
+    void test_reset() {
+        DeviceClock dc;
+        Device device;
+        dc.update(device.timer(), device.tick_time(0));
+        device.ticks += 3;
+        dc.update(device.timer(), device.tick_time(device.ticks));
+        dc.reset();
+        CHECK(!dc.synchronized() && dc.ticks() == 0);
+    }
+}
+
+int main() {
+    test_unwrap();
+    test_lower_envelope();
+    test_drift();
+    test_reset();
+    return 0;
+}
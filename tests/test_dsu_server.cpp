@@ -0,0 +1,176 @@
+// DsuServer over UDP on 127.0.0.1: version, controller info and pad data
+// replies are checked field by field, CRC32 included, as a DSU client
+// (cemuhook) would see them.
+#include "check.h"
+#include "constants.h"
+#include "dsu_server.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr uint32_t MSG_PROTOCOL_VERSION = 0x100000;
+    constexpr uint32_t MSG_CONTROLLER_INFO = 0x100001;
+    constexpr uint32_t MSG_PAD_DATA = 0x100002;
+    constexpr uint32_t CLIENT_ID = 0x12345678;
+
+    // Bitwise CRC-32 (IEEE), independent of the server's table
+    uint32_t crc32(const uint8_t* data, size_t size) {
+        uint32_t c = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; ++i) {
+            c ^= data[i];
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+        }
+        return c ^ 0xFFFFFFFFu;
+    }
+
+    uint16_t get_u16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+    uint32_t get_u32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24); }
+    float get_f32(const uint8_t* p) { return std::bit_cast<float>(get_u32(p)); }
+    void put_u16(uint8_t* p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+    void put_u32(uint8_t* p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = (v >> (8 * i)) & 0xFF; }
+
+    std::vector<uint8_t> request(uint32_t type, const std::vector<uint8_t>& payload) {
+        std::vector<uint8_t> packet(20 + payload.size());
+        std::memcpy(packet.data(), "DSUC", 4);
+        put_u16(packet.data() + 4, DsuServer::PROTOCOL_VERSION);
+        put_u16(packet.data() + 6, static_cast<uint16_t>(packet.size() - 16));
+        put_u32(packet.data() + 12, CLIENT_ID);
+        put_u32(packet.data() + 16, type);
+        std::copy(payload.begin(), payload.end(), packet.begin() + 20);
+        put_u32(packet.data() + 8, crc32(packet.data(), packet.size()));
+        return packet;
+    }
+
+    struct Client {
+        int fd;
+        sockaddr_in server{};
+
+        explicit Client(uint16_t port) {
+            fd = socket(AF_INET, SOCK_DGRAM, 0);
+            CHECK(fd >= 0);
+            server.sin_family = AF_INET;
+            server.sin_port = htons(port);
+            server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        }
+        ~Client() { ::close(fd); }
+
+        void send(const std::vector<uint8_t>& packet) {
+            CHECK(sendto(fd, packet.data(), packet.size(), 0, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) == static_cast<ssize_t>(packet.size()));
+        }
+
+        // Empty on timeout
+        std::vector<uint8_t> receive(int timeout_ms = 1000) {
+            pollfd p{fd, POLLIN, 0};
+            if (poll(&p, 1, timeout_ms) <= 0) return {};
+            std::vector<uint8_t> buffer(2048);
+            ssize_t n = recv(fd, buffer.data(), buffer.size(), 0);
+            CHECK(n > 0);
+            buffer.resize(static_cast<size_t>(n));
+            return buffer;
+        }
+    };
+
+    // Common header checks, CRC computed with the CRC field zeroed
+    void check_reply(std::vector<uint8_t> reply, uint32_t type, size_t size) {
+        CHECK(reply.size() == size);
+        CHECK(std::memcmp(reply.data(), "DSUS", 4) == 0);
+        CHECK(get_u16(reply.data() + 4) == DsuServer::PROTOCOL_VERSION);
+        CHECK(get_u16(reply.data() + 6) == size - 16);
+        CHECK(get_u32(reply.data() + 12) == DsuServerOptions{}.server_id);
+        CHECK(get_u32(reply.data() + 16) == type);
+        uint32_t crc = get_u32(reply.data() + 8);
+        put_u32(reply.data() + 8, 0);
+        CHECK(crc32(reply.data(), reply.size()) == crc);
+    }
+}
+
+int main() {
+    fake_hidapi::reset();
+    fake_hidapi::Input input;
+    input.buttons = {0x08, 0x00, 0x00};     // A
+    input.accel = {0, 0, 4096};
+    input.gyro = {0, 143, 0};               // about 10 dps
+    fake_hidapi::set_input(input);
+
+    JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+    DsuServerOptions options;
+    options.port = 0;
+    DsuServer server(options);
+    CHECK(server.port() != 0);
+    CHECK(server.add_controller(joycon) == 0);
+    Client client(server.port());
+
+    // Protocol version
+    client.send(request(MSG_PROTOCOL_VERSION, {}));
+    auto version = client.receive();
+    check_reply(version, MSG_PROTOCOL_VERSION, 22);
+    CHECK(get_u16(version.data() + 20) == DsuServer::PROTOCOL_VERSION);
+
+    // Controller info for a used and a free slot, one reply each
+    client.send(request(MSG_CONTROLLER_INFO, {2, 0, 0, 0, 0, 1}));
+    for (uint8_t slot : {0, 1}) {
+        auto info = client.receive();
+        check_reply(info, MSG_CONTROLLER_INFO, 32);
+        CHECK(info[20] == slot);
+        CHECK(info[21] == (slot == 0 ? 2 : 0));
+    }
+
+    // A request with a bad CRC is dropped
+    auto bad = request(MSG_PROTOCOL_VERSION, {});
+    bad[8] ^= 0xFF;
+    uint64_t requests = server.get_stats().requests;
+    client.send(bad);
+    CHECK(client.receive(200).empty());
+    CHECK(server.get_stats().requests == requests);
+
+    // A length field shorter than the message type is dropped, even with a
+    // matching CRC and more bytes in the datagram
+    for (uint16_t length : {0, 2, 3}) {
+        auto shorter = request(MSG_CONTROLLER_INFO, {200, 0, 0, 0, 0, 1, 2, 3});
+        put_u16(shorter.data() + 6, length);
+        put_u32(shorter.data() + 8, 0);
+        put_u32(shorter.data() + 8, crc32(shorter.data(), 16 + length));
+        client.send(shorter);
+        CHECK(client.receive(200).empty());
+        CHECK(server.get_stats().requests == requests);
+    }
+
+    // Subscribe to slot 0, pad data follows with every report
+    client.send(request(MSG_PAD_DATA, {1, 0, 0, 0, 0, 0, 0, 0}));
+    uint32_t last_packet = 0;
+    uint64_t last_timestamp = 0;
+    for (int i = 0; i < 30; ++i) {
+        auto pad = client.receive();
+        check_reply(pad, MSG_PAD_DATA, DsuServer::PAD_DATA_SIZE);
+        CHECK(pad[20] == 0);                    // slot
+        CHECK(pad[21] == 2);                    // connected
+        CHECK(pad[31] == 1);                    // active
+        uint32_t packet = get_u32(pad.data() + 32);
+        uint64_t timestamp = get_u32(pad.data() + 68) | (uint64_t(get_u32(pad.data() + 72)) << 32);
+        if (i > 0) {
+            CHECK(packet == last_packet + 1);
+            CHECK(timestamp >= last_timestamp);
+        }
+        last_packet = packet;
+        last_timestamp = timestamp;
+        CHECK(pad[37] & 0x20);                  // A
+        CHECK(pad[50] == 0xFF);                 // analog A
+        CHECK(std::fabs(get_f32(pad.data() + 84) - 1.0f) < 1e-3f);      // accel z in g
+        CHECK(std::fabs(get_f32(pad.data() + 92) - 10.0f) < 0.1f);      // gyro y in dps
+    }
+    CHECK(server.get_stats().send_errors == 0);
+
+    server.remove_controller(0);
+    return 0;
+}
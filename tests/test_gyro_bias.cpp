@@ -0,0 +1,137 @@
+// GyroBiasEstimator on synthetic IMU samples (convergence at rest, frozen
+// during motion, confidence, reset) and bias tracking of a JoyCon against
+// the simulated controller, including the reseed by status_offset().
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "gyro_bias.h"
+#include "joycon.h"
+#include <cmath>
+#include <random>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr std::array<float, 3> BIAS{0.5f, -1.2f, 0.3f};
+
+    // Noisy samples of a controller lying flat, turning at rate deg/s
+    struct Imu {
+        std::mt19937 rng{3};
+        std::normal_distribution<float> gyro_noise{0.0f, 0.1f};
+        std::normal_distribution<float> accel_noise{0.0f, 0.002f};
+
+        std::array<float, 3> gyro(const std::array<float, 3>& rate = {}) {
+            return {BIAS[0] + rate[0] + gyro_noise(rng), BIAS[1] + rate[1] + gyro_noise(rng), BIAS[2] + rate[2] + gyro_noise(rng)};
+        }
+        std::array<float, 3> accel() {
+            return {accel_noise(rng), accel_noise(rng), 1.0f + accel_noise(rng)};
+        }
+    };
+
+    void test_converges_when_still() {
+        GyroBiasEstimator estimator;
+        Imu imu;
+        CHECK(estimator.confidence()[0] == 0.0f);
+        float early = 0.0f;
+        for (int i = 0; i < 4000; ++i) {
+            estimator.add_sample(imu.gyro(), imu.accel());
+            if (i == 500) early = estimator.confidence()[0];
+        }
+        CHECK(estimator.stationary());
+        for (int i = 0; i < 3; ++i) {
+            CHECK(std::fabs(estimator.bias()[i] - BIAS[i]) < 0.05f);
+            CHECK(estimator.confidence()[i] > 0.5f);
+        }
+        // Confidence builds up with time at rest
+        CHECK(early > 0.0f && early < estimator.confidence()[0]);
+    }
+
+    void test_frozen_during_motion() {
+        GyroBiasEstimator estimator;
+        Imu imu;
+        for (int i = 0; i < 4000; ++i) {
+            estimator.add_sample(imu.gyro(), imu.accel());
+        }
+        auto bias = estimator.bias();
+        auto confidence = estimator.confidence();
+
+        // Waving the controller around
+        for (int i = 0; i < 2000; ++i) {
+            float phase = i * 0.02f;
+            std::array<float, 3> rate{80.0f * std::sin(phase), 30.0f * std::cos(phase), 0.0f};
+            std::array<float, 3> accel = imu.accel();
+            accel[0] += 0.3f * std::sin(phase);
+            CHECK(!estimator.add_sample(imu.gyro(rate), accel));
+        }
+        CHECK(!estimator.stationary());
+        // A slow steady turn is quiet but not at rest
+        for (int i = 0; i < 2000; ++i) {
+            CHECK(!estimator.add_sample(imu.gyro({6.0f, 0.0f, 0.0f}), imu.accel()));
+        }
+        CHECK(estimator.bias() == bias);
+        CHECK(estimator.confidence() == confidence);
+    }
+
+    void test_reset() {
+        GyroBiasEstimator estimator;
+        Imu imu;
+        for (int i = 0; i < 4000; ++i) {
+            estimator.add_sample(imu.gyro(), imu.accel());
+        }
+        estimator.reset({1.0f, 2.0f, 3.0f});
+        CHECK(estimator.bias() == (std::array<float, 3>{1.0f, 2.0f, 3.0f}));
+        CHECK(estimator.confidence()[0] == 0.0f);
+        CHECK(!estimator.stationary());
+    }
+
+    void test_joycon_tracking() {
+        fake_hidapi::reset();
+        fake_hidapi::Input input;
+        input.gyro = {28, -14, 7};
+        fake_hidapi::set_input(input);
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        CHECK(wait_until([&] { return joycon.get_report_stats().reports >= 3; }));
+        // Factory calibration of the fake is the identity, no offset yet
+        CHECK(joycon.get_status().gyro.x == 28.0f);
+
+        GyroBiasOptions options;
+        options.stationary_samples = 20;
+        options.bias_alpha = 0.05f;
+        joycon.enable_gyro_bias_tracking(true, options);
+        CHECK(wait_until([&] {
+            auto gyro = joycon.get_status().gyro;
+            return std::fabs(gyro.x) < 0.5f && std::fabs(gyro.y) < 0.5f && std::fabs(gyro.z) < 0.5f;
+        }));
+        CHECK(joycon.is_stationary());
+        CHECK(wait_until([&] { return joycon.get_gyro_bias_confidence()[0] > 0.5f; }));
+
+        // status_offset() restarts the estimator from the current reading,
+        // it stays there while the reading does
+        input.gyro = {-28, 14, 0};
+        fake_hidapi::set_input(input);
+        CHECK(wait_until([&] { return joycon.get_gyro_x(joycon.get_input_report()) == -28.0f; }));
+        joycon.status_offset();
+        CHECK(std::fabs(joycon.get_calibration().status_offset.gyro_x + 28.0f) < 0.01f);
+        CHECK(joycon.get_gyro_bias_confidence()[0] < 0.5f);
+        CHECK(wait_until([&] { return joycon.get_gyro_bias_confidence()[0] > 0.5f; }));
+        auto gyro = joycon.get_status().gyro;
+        CHECK(std::fabs(gyro.x) < 0.5f && std::fabs(gyro.y) < 0.5f && std::fabs(gyro.z) < 0.5f);
+
+        // Disabled, the offset no longer follows the reading
+        joycon.enable_gyro_bias_tracking(false);
+        input.gyro = {0, 0, 0};
+        fake_hidapi::set_input(input);
+        CHECK(wait_until([&] { return std::fabs(joycon.get_status().gyro.x - 28.0f) < 0.5f; }));
+        std::this_thread::sleep_for(300ms);
+        CHECK(std::fabs(joycon.get_status().gyro.x - 28.0f) < 0.5f);
+    }
+}
+
+int main() {
+    test_converges_when_still();
+    test_frozen_during_motion();
+    test_reset();
+    test_joycon_tracking();
+    return 0;
+}
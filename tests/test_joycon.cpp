@@ -0,0 +1,180 @@
+// JoyCon against the simulated controller: connect, calibration, report
+// decoding, hooks, subcommand round trips and the typed variants.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "typed_joycon.h"
+#include <atomic>
+
+using namespace std::chrono_literals;
+
+namespace {
+    bool wrote_subcommand(uint8_t id, uint8_t arg) {
+        for (const auto& output : fake_hidapi::outputs()) {
+            if (output.data.size() > 11 && output.data[0] == 0x01 && output.data[10] == id && output.data[11] == arg) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void test_connect_and_decode() {
+        fake_hidapi::reset();
+        fake_hidapi::Input input;
+        input.buttons = {0x08, 0x00, 0x00};      // A
+        input.sticks = {0x900, 0x700, 0x800, 0x800};
+        input.accel = {0, 0, 4096};
+        input.gyro = {14, 0, 0};
+        fake_hidapi::set_input(input);
+
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        CHECK(joycon.is_left());
+        CHECK(!joycon.is_right());
+        CHECK(wait_until([&] { return joycon.get_report_stats().reports >= 3; }));
+
+        auto report = joycon.get_input_report();
+        CHECK(report[0] == 0x30);
+        CHECK(joycon.get_button_a(report) == 1);
+        CHECK(joycon.get_button_b(report) == 0);
+        CHECK(joycon.get_stick_left_horizontal(report) == 0x900);
+        CHECK(joycon.get_stick_left_vertical(report) == 0x700);
+        // Factory calibration of the fake is the identity
+        CHECK(joycon.get_accel_z(report) == 4096.0f);
+        CHECK(joycon.get_gyro_x(report) == 14.0f);
+        JoyCon::Status status = joycon.get_status();
+        CHECK(status.buttons.right.a == 1);
+        CHECK(status.analog_sticks.left.horizontal == 0x900);
+    }
+
+    void test_hooks() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        std::atomic<int> all{0};
+        std::atomic<int> filtered{0};
+        size_t id = joycon.register_update_hook([&](JoyCon&) { all++; });
+        UpdateFilter filter;
+        filter.button_mask = 0x08;
+        joycon.register_update_hook([&](JoyCon&) { filtered++; }, filter);
+        CHECK(wait_until([&] { return all >= 10; }));
+        // Primed once, then only on changes of A
+        CHECK(filtered == 1);
+        fake_hidapi::Input input;
+        input.buttons = {0x08, 0x00, 0x00};
+        fake_hidapi::set_input(input);
+        CHECK(wait_until([&] { return filtered == 2; }));
+        joycon.unregister_update_hook(id);
+        int calls = all;
+        std::this_thread::sleep_for(50ms);
+        CHECK(all == calls);
+    }
+
+    void test_subcommands() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        JoyCon::ImuConfig config;
+        config.gyro_sensitivity = JoyCon::GyroSensitivity::DPS_1000;
+        joycon.set_imu_config(config);
+        CHECK(joycon.get_imu_config() == config);
+        CHECK(wrote_subcommand(0x41, 0x02));
+        joycon.set_player_lamp(3);
+        CHECK(wrote_subcommand(0x30, 0x07));
+    }
+
+    void test_sides() {
+        fake_hidapi::reset();
+        CHECK(JoyCon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID).is_left());
+        CHECK(JoyCon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID).is_right());
+        JoyCon pro(JOYCON_VENDOR_ID, PRO_CONTROLLER_PRODUCT_ID);
+        CHECK(!pro.is_left() && !pro.is_right());
+
+        // A Joy-Con in the charging grip, side from the device info
+        TransportOptions usb;
+        usb.transport = Transport::USB;
+        fake_hidapi::DeviceOptions options;
+        options.grip_type = 2;
+        fake_hidapi::set_options(options);
+        JoyCon grip(JOYCON_VENDOR_ID, CHARGING_GRIP_PRODUCT_ID, L"", false, usb);
+        CHECK(grip.is_right() && !grip.is_left());
+        CHECK(grip.type == RIGHT);
+        CHECK_THROWS(GripJoyCon<report_layout::Left>(L"", false, usb), std::runtime_error);
+        GripJoyCon<report_layout::Right> typed(L"", false, usb);
+        CHECK(wait_until([&] { return typed.get_report_stats().reports > 0; }));
+        CHECK(typed.get_snapshot().right.stick.horizontal == 0x800);
+
+        // Simple reports of a left grip Joy-Con map to the left buttons
+        options.grip_type = 1;
+        fake_hidapi::set_options(options);
+        JoyCon left(JOYCON_VENDOR_ID, CHARGING_GRIP_PRODUCT_ID, L"", true, usb);
+        CHECK(left.is_left());
+        fake_hidapi::Input input;
+        input.simple = {0x01, 0x00, 0x08};      // Down
+        fake_hidapi::set_input(input);
+        CHECK(wait_until([&] { return left.get_input_report()[5] == 0x01; }));
+    }
+
+    // Snapshot<V> decodes what get_status() does, for the fields V has
+    template <class Typed>
+    void check_snapshot(Typed& joycon) {
+        CHECK(wait_until([&] { return joycon.get_report_stats().reports > 2; }));
+        joycon.status_offset();
+        auto snapshot = joycon.get_snapshot();
+        auto status = joycon.get_status();
+        using V = typename Typed::Variant;
+        if constexpr (V::HAS_LEFT) {
+            CHECK(snapshot.left.l == (status.buttons.left.l != 0));
+            CHECK(snapshot.left.stick.horizontal == status.analog_sticks.left.horizontal);
+            CHECK(snapshot.left.stick.vertical == 0);
+        }
+        if constexpr (V::HAS_RIGHT) {
+            CHECK(snapshot.right.a == (status.buttons.right.a != 0));
+            CHECK(snapshot.right.plus == (status.buttons.right.plus != 0));
+            CHECK(snapshot.right.stick.horizontal == 0);
+        }
+        CHECK(snapshot.accel[2] == status.accel.z && snapshot.accel[2] > 0.0f);
+        CHECK(snapshot.gyro[1] == status.gyro.y);
+    }
+
+    void test_typed_variants() {
+        fake_hidapi::reset();
+        fake_hidapi::Input input;
+        input.buttons = {0x08, 0x02, 0x40};     // A, plus, L
+        input.sticks = {0x900, 0x700, 0x850, 0x780};
+        input.gyro = {0, 143, 0};
+        fake_hidapi::set_input(input);
+
+        LeftJoyCon left;
+        check_snapshot(left);
+        CHECK(left.get_snapshot().left.l);
+        RightJoyCon right;
+        check_snapshot(right);
+        CHECK(right.get_snapshot().right.a && right.get_snapshot().right.plus);
+        ProController pro;
+        check_snapshot(pro);
+        auto snapshot = pro.get_snapshot();
+        CHECK(snapshot.left.l && snapshot.right.a);
+        // Status offset taken at rest, the sticks read 0 from then on
+        CHECK(snapshot.left.stick.horizontal == 0 && snapshot.right.stick.vertical == 0);
+    }
+
+    void test_invalid_ids() {
+        fake_hidapi::reset();
+        CHECK_THROWS(JoyCon(0x1234, JOYCON_L_PRODUCT_ID), std::invalid_argument);
+        CHECK_THROWS(JoyCon(JOYCON_VENDOR_ID, 0x1234), std::invalid_argument);
+        TransportOptions usb;
+        usb.transport = Transport::USB;
+        CHECK_THROWS(JoyCon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID, L"", false, usb), std::invalid_argument);
+        fake_hidapi::fail_opens(1);
+        CHECK_THROWS(JoyCon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID), std::runtime_error);
+    }
+}
+
+int main() {
+    test_connect_and_decode();
+    test_hooks();
+    test_subcommands();
+    test_sides();
+    test_typed_variants();
+    test_invalid_ids();
+    return 0;
+}
@@ -0,0 +1,149 @@
+// JoyCon2Commands against FakeGattWriter: coalescing keeps the last state
+// and the order it was asked for, vibration presets are all written, and
+// paced writes leave room for notifications in every connection event,
+// and a command the link keeps refusing is dropped after its retries.
+#include "check.h"
+#include "fake_gatt.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+    constexpr uint8_t CMD_LIGHTS = 0x09;
+    constexpr uint8_t CMD_VIBRATION = 0x0A;
+    constexpr uint8_t CMD_FEATURES = 0x0C;
+
+    std::vector<FakeGattWriter::Write> writes_of(const FakeGattWriter& link, uint8_t command) {
+        std::vector<FakeGattWriter::Write> result;
+        for (const auto& write : link.get_writes()) {
+            if (write.data[0] == command) result.push_back(write);
+        }
+        return result;
+    }
+
+    void test_toggle_keeps_last_state() {
+        auto link = std::make_shared<FakeGattWriter>();
+        JoyCon2Options options;
+        options.write_interval = 50ms;
+        JoyCon2Commands commands(link, options);
+        // Written at once, everything after it waits for the next slot
+        commands.set_player_lamp(1);
+        commands.enable_imu(true);
+        commands.enable_imu(false);
+        commands.enable_imu(true);
+        commands.flush();
+
+        auto features = writes_of(*link, CMD_FEATURES);
+        CHECK(!features.empty());
+        CHECK(features.back().data[3] == 0x04);     // enable, not disable
+        CHECK(features.back().data[8] == joycon2::FEATURE_IMU);
+        CHECK(commands.get_stats().coalesced >= 2);
+    }
+
+    void test_vibration_not_coalesced() {
+        auto link = std::make_shared<FakeGattWriter>();
+        JoyCon2Options options;
+        options.write_interval = 20ms;
+        JoyCon2Commands commands(link, options);
+        for (uint8_t preset = 1; preset <= 5; ++preset) {
+            commands.rumble_preset(preset);
+        }
+        commands.flush();
+
+        auto vibration = writes_of(*link, CMD_VIBRATION);
+        CHECK(vibration.size() == 5);
+        for (size_t i = 0; i < vibration.size(); ++i) {
+            CHECK(vibration[i].data[8] == i + 1);
+        }
+        CHECK(commands.get_stats().coalesced == 0);
+    }
+
+    // Lamp changes and presets every 2ms, the load of a game driving both
+    void run_load(JoyCon2Commands& commands) {
+        commands.enable_imu();
+        for (int i = 0; i < 40; ++i) {
+            commands.rumble_preset(static_cast<uint8_t>(i));
+            commands.set_player_lamp(1 + i % 4);
+            std::this_thread::sleep_for(2ms);
+        }
+        commands.flush();
+    }
+
+    void test_pacing() {
+        for (auto interval : {0us, 15000us}) {
+            auto link = std::make_shared<FakeGattWriter>();
+            JoyCon2Options options;
+            options.write_interval = interval;
+            options.max_queue = 64;
+            JoyCon2Commands commands(link, options);
+            run_load(commands);
+
+            auto stats = commands.get_stats();
+            auto link_stats = link->get_stats();
+            std::printf("interval %5lld us: commands %llu writes %llu coalesced %llu busy %llu max latency %lld us, starved events %llu\n",
+                static_cast<long long>(interval.count()), static_cast<unsigned long long>(stats.commands),
+                static_cast<unsigned long long>(stats.writes), static_cast<unsigned long long>(stats.coalesced),
+                static_cast<unsigned long long>(stats.busy), static_cast<long long>(stats.max_latency.count()),
+                static_cast<unsigned long long>(link_stats.starved_events));
+            CHECK(stats.failed == 0);
+            CHECK(writes_of(*link, CMD_VIBRATION).size() == 40);
+            if (interval > 0us) {
+                CHECK(link_stats.starved_events == 0);
+                CHECK(link_stats.refused == 0);
+                auto writes = link->get_writes();
+                for (size_t i = 1; i < writes.size(); ++i) {
+                    CHECK(writes[i].time - writes[i - 1].time >= interval);
+                }
+            }
+        }
+    }
+
+    void test_link_lost() {
+        auto link = std::make_shared<FakeGattWriter>();
+        JoyCon2Commands commands(link);
+        link->set_link_lost(true);
+        commands.set_player_lamp(2);
+        commands.flush();
+        CHECK(commands.get_stats().failed == 1);
+        CHECK(commands.get_stats().writes == 0);
+    }
+
+    // Refuses lamp commands as busy for good, accepts everything else
+    class LampRefusingWriter : public GattWriter {
+    public:
+        bool write_without_response(const uint8_t* data, size_t) override {
+            if (data[0] == CMD_LIGHTS) return false;
+            ++accepted;
+            return true;
+        }
+        std::atomic<int> accepted{0};
+    };
+
+    void test_busy_retries_capped() {
+        auto writer = std::make_shared<LampRefusingWriter>();
+        JoyCon2Options options;
+        options.write_interval = 1ms;
+        options.busy_backoff = 1ms;
+        options.max_busy_retries = 3;
+        JoyCon2Commands commands(writer, options);
+        commands.set_player_lamp(1);
+        commands.enable_imu(true);
+        commands.flush();
+        auto stats = commands.get_stats();
+        CHECK(stats.busy == 3);
+        CHECK(stats.failed == 1);
+        // Commands behind the refused one still go out
+        CHECK(stats.writes == 2 && writer->accepted == 2);
+    }
+}
+
+int main() {
+    test_toggle_keeps_last_state();
+    test_vibration_not_coalesced();
+    test_pacing();
+    test_link_lost();
+    test_busy_retries_capped();
+    return 0;
+}
@@ -0,0 +1,213 @@
+// AsyncJoyCon on a QueueExecutor drained by the main thread: coroutines
+// resume there and never on the input thread, button events follow their
+// mask, chunked SPI reads match the flash and fail on lost or mismatched
+// replies, and many tasks share one controller.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "joycon_coro.h"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std::chrono_literals;
+using joycon_coro::QueueExecutor;
+using joycon_coro::Task;
+
+namespace {
+    // Runs the executor on this thread until done() or the timeout
+    bool run_until(QueueExecutor& executor, const std::function<bool()>& done, std::chrono::milliseconds timeout = 2000ms) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!done()) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            executor.wait_for(10ms);
+            executor.run_pending();
+        }
+        return true;
+    }
+
+    struct Resumed {
+        int count = 0;
+        bool off_input_thread = true;
+        bool on_main_thread = true;
+        bool reports_in_order = true;
+    };
+
+    Task<> await_reports(AsyncJoyCon& async, int reports, Resumed& resumed, std::thread::id main_thread) {
+        AsyncJoyCon::clock::time_point last{};
+        for (int i = 0; i < reports; ++i) {
+            AsyncJoyCon::Report report = co_await async.next_report();
+            resumed.off_input_thread &= !async.joycon().is_input_thread();
+            resumed.on_main_thread &= std::this_thread::get_id() == main_thread;
+            resumed.reports_in_order &= report.data[0] == 0x30 && report.time > last;
+            last = report.time;
+        }
+        resumed.count++;
+    }
+
+    Task<> await_button(AsyncJoyCon& async, uint32_t mask, AsyncJoyCon::ButtonEvent& event, bool& done) {
+        event = co_await async.button_event(mask);
+        done = true;
+    }
+
+    struct Read {
+        std::vector<uint8_t> data;
+        std::string error;
+        bool done = false;
+    };
+
+    Task<> read_flash(AsyncJoyCon& async, uint32_t address, size_t size, Read& read) {
+        try {
+            read.data = co_await async.spi_read(address, size, 100ms);
+        } catch (const std::runtime_error& e) {
+            read.error = e.what();
+        }
+        read.done = true;
+    }
+
+    void test_resumes_on_executor() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        QueueExecutor executor;
+        AsyncJoyCon async(joycon, executor);
+
+        Resumed resumed;
+        joycon_coro::spawn(executor, await_reports(async, 5, resumed, std::this_thread::get_id()));
+        // Nothing runs until the executor is drained
+        std::this_thread::sleep_for(50ms);
+        CHECK(resumed.count == 0);
+        CHECK(run_until(executor, [&] { return resumed.count == 1; }));
+        CHECK(resumed.off_input_thread && resumed.on_main_thread && resumed.reports_in_order);
+    }
+
+    void test_button_events() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        QueueExecutor executor;
+        AsyncJoyCon async(joycon, executor);
+        fake_hidapi::Input input;
+
+        // Waiting for A, Y does not wake it
+        AsyncJoyCon::ButtonEvent event;
+        bool done = false;
+        joycon_coro::spawn(executor, await_button(async, 0x08, event, done));
+        executor.run_pending();
+        input.buttons = {0x01, 0x00, 0x00};     // Y
+        fake_hidapi::set_input(input);
+        CHECK(!run_until(executor, [&] { return done; }, 200ms));
+        input.buttons = {0x09, 0x00, 0x00};     // Y and A
+        fake_hidapi::set_input(input);
+        CHECK(run_until(executor, [&] { return done; }));
+        CHECK(event.buttons == 0x09 && event.pressed == 0x08 && event.released == 0);
+
+        // Releasing Y while A stays down is a change of the mask 0x01 only
+        done = false;
+        joycon_coro::spawn(executor, await_button(async, 0x01, event, done));
+        executor.run_pending();
+        input.buttons = {0x08, 0x00, 0x00};
+        fake_hidapi::set_input(input);
+        CHECK(run_until(executor, [&] { return done; }));
+        CHECK(event.buttons == 0x08 && event.pressed == 0 && event.released == 0x01);
+
+        // Byte 5 bit 7 is bit 23 of the mask
+        done = false;
+        joycon_coro::spawn(executor, await_button(async, 0x800000, event, done));
+        executor.run_pending();
+        input.buttons = {0x08, 0x00, 0x80};
+        fake_hidapi::set_input(input);
+        CHECK(run_until(executor, [&] { return done; }));
+        CHECK(event.pressed == 0x800000 && event.buttons == 0x800008);
+    }
+
+    void test_spi_read() {
+        fake_hidapi::reset();
+        std::vector<uint8_t> pattern(200);
+        for (size_t i = 0; i < pattern.size(); ++i) pattern[i] = static_cast<uint8_t>(i * 13 + 5);
+        fake_hidapi::write_flash(0x8000, pattern);
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        QueueExecutor executor;
+        AsyncJoyCon async(joycon, executor);
+
+        // Several 0x1D-byte requests, the last one partial
+        Read read;
+        joycon_coro::spawn(executor, read_flash(async, 0x8003, 150, read));
+        CHECK(run_until(executor, [&] { return read.done; }));
+        CHECK(read.error.empty());
+        CHECK(read.data == fake_hidapi::read_flash(0x8003, 150));
+        CHECK(read.data == std::vector<uint8_t>(pattern.begin() + 3, pattern.begin() + 153));
+    }
+
+    void test_spi_errors() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        QueueExecutor executor;
+        AsyncJoyCon async(joycon, executor);
+
+        // Options apply to devices opened afterwards, drop the link once
+        fake_hidapi::DeviceOptions options;
+        options.drop_every = 1;
+        fake_hidapi::set_options(options);
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_reconnect_stats().reconnects == 1; }));
+        Read lost;
+        joycon_coro::spawn(executor, read_flash(async, 0x6000, 64, lost));
+        CHECK(run_until(executor, [&] { return lost.done; }));
+        CHECK(lost.error == "SPI read timed out" && lost.data.empty());
+
+        options.drop_every = 0;
+        options.mismatch_every = 1;
+        fake_hidapi::set_options(options);
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_reconnect_stats().reconnects == 2; }));
+        Read mismatched;
+        joycon_coro::spawn(executor, read_flash(async, 0x6000, 64, mismatched));
+        CHECK(run_until(executor, [&] { return mismatched.done; }));
+        CHECK(mismatched.error == "SPI read reply did not verify" && mismatched.data.empty());
+
+        // Still usable afterwards
+        Resumed resumed;
+        joycon_coro::spawn(executor, await_reports(async, 2, resumed, std::this_thread::get_id()));
+        CHECK(run_until(executor, [&] { return resumed.count == 1; }));
+    }
+
+    void test_many_tasks() {
+        constexpr int TASKS = 500;
+        constexpr int READS = 8;
+        fake_hidapi::reset();
+        std::vector<uint8_t> pattern(READS * 16);
+        for (size_t i = 0; i < pattern.size(); ++i) pattern[i] = static_cast<uint8_t>(i ^ 0x5A);
+        fake_hidapi::write_flash(0x8000, pattern);
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        QueueExecutor executor;
+        AsyncJoyCon async(joycon, executor);
+
+        Resumed resumed;
+        for (int i = 0; i < TASKS; ++i) {
+            joycon_coro::spawn(executor, await_reports(async, 3, resumed, std::this_thread::get_id()));
+        }
+        std::vector<Read> reads(READS);
+        for (int i = 0; i < READS; ++i) {
+            joycon_coro::spawn(executor, read_flash(async, 0x8000 + i * 16, 16, reads[i]));
+        }
+        CHECK(run_until(executor, [&] {
+            return resumed.count == TASKS && std::all_of(reads.begin(), reads.end(), [](const Read& r) { return r.done; });
+        }, 5000ms));
+        CHECK(resumed.off_input_thread && resumed.on_main_thread && resumed.reports_in_order);
+        for (int i = 0; i < READS; ++i) {
+            CHECK(reads[i].error.empty());
+            CHECK(reads[i].data == std::vector<uint8_t>(pattern.begin() + i * 16, pattern.begin() + (i + 1) * 16));
+        }
+    }
+}
+
+int main() {
+    test_resumes_on_executor();
+    test_button_events();
+    test_spi_read();
+    test_spi_errors();
+    test_many_tasks();
+    return 0;
+}
@@ -0,0 +1,99 @@
+// JoyConMcu against the simulated MCU: IR frames reassembled from
+// fragments (with lost ones requested again), NFC tags coming into range,
+// one JoyConMcu per JoyCon, and mode switches refused from inside a
+// callback.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "joycon_mcu.h"
+#include <algorithm>
+#include <atomic>
+
+using namespace std::chrono_literals;
+
+namespace {
+    void test_ir() {
+        fake_hidapi::reset();
+        fake_hidapi::DeviceOptions options;
+        options.report_interval = 5ms;
+        options.ir_drop_every = 7;
+        fake_hidapi::set_options(options);
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        JoyConMcu mcu(joycon);
+
+        // The simulated camera fills each fragment with its number
+        std::atomic<int> frames{0};
+        std::atomic<bool> intact{true};
+        IrOptions ir;
+        ir.resolution = IrResolution::R80x60;
+        mcu.start_ir([&](const IrFrame& frame) {
+            if (frame.width != 80 || frame.height != 60) intact = false;
+            for (size_t i = 0; i < size_t(frame.width) * frame.height; ++i) {
+                if (frame.pixels[i] != i / JoyConMcu::IR_FRAGMENT_SIZE) intact = false;
+            }
+            ++frames;
+        }, ir);
+        CHECK(wait_until([&] { return frames >= 3; }, 5000ms));
+        CHECK(intact);
+        auto stats = mcu.get_stats();
+        CHECK(stats.missed_requests > 0);
+        CHECK(fake_hidapi::get_stats().mcu_crc_errors == 0);
+        mcu.stop();
+    }
+
+    void test_nfc() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        JoyConMcu mcu(joycon);
+        // One MCU handler per JoyCon
+        CHECK_THROWS(JoyConMcu(joycon), std::logic_error);
+        const std::vector<uint8_t> uid = {0x04, 0xA1, 0xB2, 0xC3, 0xD4, 0xE5, 0xF6};
+        std::atomic<int> tags{0};
+        std::atomic<bool> uid_ok{true};
+        mcu.start_nfc([&](const NfcTag& tag) {
+            if (tag.uid_length != uid.size() || !std::equal(uid.begin(), uid.end(), tag.uid.begin())) uid_ok = false;
+            ++tags;
+        });
+        CHECK(wait_until([&] { return tags == 0 && mcu.get_stats().mcu_reports > 5; }));
+        fake_hidapi::set_nfc_tag(uid);
+        CHECK(wait_until([&] { return tags == 1; }));
+        // Reported again only after leaving range
+        auto reports = mcu.get_stats().mcu_reports;
+        CHECK(wait_until([&] { return mcu.get_stats().mcu_reports > reports + 5; }));
+        CHECK(tags == 1);
+        fake_hidapi::set_nfc_tag({});
+        reports = mcu.get_stats().mcu_reports;
+        CHECK(wait_until([&] { return mcu.get_stats().mcu_reports > reports + 5; }));
+        fake_hidapi::set_nfc_tag(uid);
+        CHECK(wait_until([&] { return tags == 2; }));
+        CHECK(uid_ok);
+        mcu.stop();
+    }
+
+    void test_callback_reentry() {
+        fake_hidapi::reset();
+        fake_hidapi::set_nfc_tag({0x01, 0x02, 0x03, 0x04});
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        JoyConMcu mcu(joycon);
+        std::atomic<int> result{0};
+        mcu.start_nfc([&](const NfcTag&) {
+            try {
+                mcu.stop();
+                result = 1;
+            } catch (const std::logic_error&) {
+                result = 2;
+            }
+        });
+        CHECK(wait_until([&] { return result != 0; }));
+        CHECK(result == 2);
+        mcu.stop();
+    }
+}
+
+int main() {
+    test_ir();
+    test_nfc();
+    test_callback_reentry();
+    return 0;
+}
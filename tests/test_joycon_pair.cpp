@@ -0,0 +1,174 @@
+// JoyConPair over two simulated Joy-Cons: every merged tick reaches the
+// hooks once and in order, a slow hook does not hold up the other side's
+// input thread, halves are merged by aligned device time within the merge
+// window, and a half missing past the timeout goes out alone.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "joycon_pair.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+    // Every tick the hooks saw and when
+    struct Ticks {
+        struct Tick {
+            JoyConPair::Status status;
+            JoyConPair::clock::time_point delivered;
+        };
+        JoyConPair& pair;
+        size_t hook_id;
+        std::mutex mutex;
+        std::vector<Tick> ticks;
+
+        explicit Ticks(JoyConPair& p) : pair(p) {
+            hook_id = pair.register_update_hook([this](JoyConPair& jp) {
+                std::lock_guard<std::mutex> lock(mutex);
+                ticks.push_back({jp.get_status(), JoyConPair::clock::now()});
+            });
+        }
+        ~Ticks() { pair.unregister_update_hook(hook_id); }
+        size_t size() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return ticks.size();
+        }
+        std::vector<Tick> get() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return ticks;
+        }
+    };
+
+    JoyConPair::clock::duration gap(const JoyConPair::Status& s) {
+        auto d = s.left.timestamp - s.right.timestamp;
+        return d < d.zero() ? -d : d;
+    }
+
+    void test_merge_by_device_time() {
+        fake_hidapi::reset();
+        fake_hidapi::Input input;
+        input.buttons = {0x08, 0x00, 0x01};     // A on the right, Down on the left
+        input.sticks = {0x900, 0x700, 0x600, 0xA00};
+        fake_hidapi::set_input(input);
+        JoyCon left(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        JoyCon right(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        JoyConPair pair(left, right);
+        Ticks ticks(pair);
+        CHECK(wait_until([&] { return ticks.size() > 100; }));
+
+        // Same 15 ms cadence on both sides, the halves of a tick are at
+        // most half a period apart
+        size_t merged = 0;
+        for (const auto& tick : ticks.get()) {
+            const auto& s = tick.status;
+            if (s.left.stale || s.right.stale) continue;
+            ++merged;
+            CHECK(gap(s) <= JoyConPair::DEFAULT_MERGE_WINDOW);
+            CHECK(s.timestamp == std::max(s.left.timestamp, s.right.timestamp));
+            CHECK(s.buttons.right.a == 1 && s.buttons.left.down == 1);
+            CHECK(s.analog_sticks.left.horizontal == 0x900 && s.analog_sticks.right.vertical == 0xA00);
+        }
+        CHECK(merged > ticks.size() * 9 / 10);
+    }
+
+    void test_merge_window() {
+        fake_hidapi::reset();
+        JoyCon left(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        JoyCon right(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        // Halves further apart than 100 us are separate ticks
+        JoyConPair pair(left, right, 100us);
+        Ticks ticks(pair);
+        CHECK(wait_until([&] { return ticks.size() > 100; }));
+
+        size_t left_only = 0, right_only = 0;
+        for (const auto& tick : ticks.get()) {
+            const auto& s = tick.status;
+            CHECK(!(s.left.stale && s.right.stale));
+            if (!s.left.stale && !s.right.stale) {
+                CHECK(gap(s) <= 100us);
+            } else if (s.right.stale) {
+                ++left_only;
+                CHECK(s.timestamp == s.left.timestamp);
+            } else {
+                ++right_only;
+                CHECK(s.timestamp == s.right.timestamp);
+            }
+        }
+        CHECK(left_only > 30 && right_only > 30);
+    }
+
+    void test_timeout() {
+        fake_hidapi::reset();
+        // Options apply to devices opened afterwards: the left reports
+        // slowly, the right hardly at all, so left halves wait in vain
+        fake_hidapi::DeviceOptions options;
+        options.report_interval = 200ms;
+        fake_hidapi::set_options(options);
+        JoyCon left(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        options.report_interval = 10s;
+        fake_hidapi::set_options(options);
+        JoyCon right(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        // The right's first report is in, the next one is 10 s away
+        CHECK(wait_until([&] { return right.get_report_stats().reports >= 1; }, 15000ms));
+        constexpr auto TIMEOUT = 30ms;
+        JoyConPair pair(left, right, JoyConPair::DEFAULT_MERGE_WINDOW, TIMEOUT);
+        Ticks ticks(pair);
+        CHECK(wait_until([&] { return ticks.size() >= 5; }, 5000ms));
+
+        for (const auto& tick : ticks.get()) {
+            // Published alone once the timeout passed, the right half flagged
+            const auto& s = tick.status;
+            CHECK(!s.left.stale && s.right.stale);
+            CHECK(s.timestamp == s.left.timestamp);
+            CHECK(tick.delivered - s.left.timestamp >= TIMEOUT);
+            CHECK(tick.delivered - s.left.timestamp < TIMEOUT + 150ms);
+        }
+    }
+
+    void test_ordered_delivery() {
+        fake_hidapi::reset();
+        JoyCon left(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        JoyCon right(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        JoyConPair pair(left, right);
+
+        std::atomic<uint64_t> calls{0};
+        std::atomic<bool> in_order{true};
+        std::atomic<bool> slow{false};
+        std::atomic<uint64_t> other_reports{0};
+        size_t id = pair.register_update_hook([&](JoyConPair& p) {
+            uint64_t n = ++calls;
+            // get_status() is the tick being delivered, none skipped
+            if (p.get_status().sequence != n) in_order = false;
+            if (slow.exchange(false)) {
+                uint64_t before = left.get_report_stats().reports + right.get_report_stats().reports;
+                std::this_thread::sleep_for(150ms);
+                other_reports = left.get_report_stats().reports + right.get_report_stats().reports - before;
+            }
+        });
+
+        CHECK(wait_until([&] { return calls > 50; }));
+        CHECK(in_order);
+
+        // The side not running the hook keeps reading, about 10 reports
+        slow = true;
+        CHECK(wait_until([&] { return other_reports > 0; }));
+        CHECK(other_reports >= 5);
+
+        uint64_t seen = calls;
+        CHECK(wait_until([&] { return calls > seen + 20; }));
+        CHECK(in_order);
+        pair.unregister_update_hook(id);
+    }
+}
+
+int main() {
+    test_ordered_delivery();
+    test_merge_by_device_time();
+    test_merge_window();
+    test_timeout();
+    return 0;
+}
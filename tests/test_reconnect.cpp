@@ -0,0 +1,139 @@
+// Losing the link: what still works while the JoyCon reconnects and what
+// is refused once it gave up, and the controller state sent again and the
+// hooks notified after a reopen.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "joycon_mcu.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+    bool wrote_subcommand(uint8_t id, const std::vector<uint8_t>& args) {
+        for (const auto& output : fake_hidapi::outputs()) {
+            if (output.data.size() >= 11 + args.size() && output.data[0] == 0x01 && output.data[10] == id
+                && std::equal(args.begin(), args.end(), output.data.begin() + 11)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void test_reader_options_while_reconnecting() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        fake_hidapi::fail_opens(1000);
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_link_state() == JoyCon::LinkState::RECONNECTING; }));
+
+        // Applied between reopen attempts, not after the next report
+        ReaderThreadOptions options;
+        options.spin_budget = 100us;
+        auto start = std::chrono::steady_clock::now();
+        joycon.set_reader_options(options);
+        CHECK(std::chrono::steady_clock::now() - start < 500ms);
+        CHECK(joycon.get_reader_options().spin_budget == 100us);
+        fake_hidapi::fail_opens(0);
+    }
+
+    void test_reader_options_after_failure() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        ReconnectOptions reconnect;
+        reconnect.enabled = false;
+        joycon.set_reconnect_options(reconnect);
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_link_state() == JoyCon::LinkState::FAILED; }));
+
+        auto start = std::chrono::steady_clock::now();
+        CHECK_THROWS(joycon.set_reader_options({}), std::runtime_error);
+        CHECK(std::chrono::steady_clock::now() - start < 500ms);
+    }
+
+    void test_state_replay() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        joycon.set_player_lamp(3);
+        joycon.enable_vibration(true);
+        JoyCon::ImuConfig config;
+        config.gyro_sensitivity = JoyCon::GyroSensitivity::DPS_500;
+        config.accel_sensitivity = JoyCon::AccelSensitivity::G_4;
+        config.gyro_performance = JoyCon::GyroPerformance::HZ_833;
+        config.accel_filter = JoyCon::AccelFilter::HZ_200;
+        joycon.set_imu_config(config);
+
+        std::mutex mutex;
+        std::vector<JoyCon::LinkEvent> events;
+        joycon.register_link_hook([&](JoyCon&, const JoyCon::LinkEvent& event) {
+            std::lock_guard<std::mutex> lock(mutex);
+            events.push_back(event);
+        });
+        std::atomic<uint64_t> updates{0};
+        joycon.register_update_hook([&](JoyCon&) { ++updates; });
+        CHECK(wait_until([&] { return updates > 0; }));
+
+        fake_hidapi::clear_outputs();
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_reconnect_stats().reconnects == 1; }));
+        // Sent again to the reopened device, before CONNECTED is announced
+        CHECK(wrote_subcommand(0x30, {output_report::player_lamp_pattern(3)}));
+        CHECK(wrote_subcommand(0x48, {0x01}));
+        CHECK(wrote_subcommand(0x41, {0x01, 0x01, 0x00, 0x00}));
+        CHECK(joycon.get_imu_config() == config);
+
+        // The gap, then the new generation
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            CHECK(events.size() == 2);
+            CHECK(events[0].state == JoyCon::LinkState::RECONNECTING && events[0].generation == 0);
+            CHECK(events[1].state == JoyCon::LinkState::CONNECTED && events[1].generation == 1);
+            CHECK(events[1].time >= events[0].time);
+        }
+        CHECK(joycon.get_link_generation() == 1);
+        uint64_t before = updates;
+        CHECK(wait_until([&] { return updates > before + 5; }));
+    }
+
+    void test_nothing_to_replay() {
+        // Lamp, vibration and IMU config never set
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        fake_hidapi::clear_outputs();
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_reconnect_stats().reconnects == 1; }));
+        CHECK(!wrote_subcommand(0x30, {}) && !wrote_subcommand(0x48, {}) && !wrote_subcommand(0x41, {}));
+    }
+
+    void test_mcu_mode_after_reconnect() {
+        fake_hidapi::reset();
+        fake_hidapi::set_nfc_tag({0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66});
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        JoyConMcu mcu(joycon);
+        std::atomic<int> tags{0};
+        mcu.start_nfc([&](const NfcTag&) { ++tags; });
+        CHECK(wait_until([&] { return tags == 1; }));
+
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_reconnect_stats().reconnects == 1; }));
+        CHECK(mcu.get_stats().link_resets == 1);
+
+        // Back to OFF, so starting again goes through the whole mode switch
+        mcu.start_nfc([&](const NfcTag&) { ++tags; });
+        CHECK(wait_until([&] { return tags == 2; }));
+        mcu.stop();
+    }
+}
+
+int main() {
+    test_reader_options_while_reconnecting();
+    test_reader_options_after_failure();
+    test_state_replay();
+    test_nothing_to_replay();
+    test_mcu_mode_after_reconnect();
+    return 0;
+}
@@ -0,0 +1,187 @@
+// JoyConResampler against the simulated controller, every report with new
+// stick, gyro and button values: interpolation between reports, buttons
+// of the latest report not after the query, bounded extrapolation, the
+// sample_tick() grid and sample_at() racing the input thread.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "resampler.h"
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using clock_type = JoyConResampler::clock;
+
+namespace {
+    // What the resampler was given for one report
+    struct Recorded {
+        clock_type::time_point time;
+        std::array<clock_type::time_point, DeviceClock::SAMPLES_PER_REPORT> sample_times;
+        int stick;
+        float gyro;
+        int a;
+    };
+
+    // Every report changes the input for the next one: sticks and gyro
+    // count up, A toggles
+    class Ramp {
+    public:
+        explicit Ramp(JoyCon& joycon) : joycon_(joycon) {
+            hook_id_ = joycon_.register_update_hook([this](JoyCon& jc) {
+                JoyCon::Status status = jc.get_status();
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    recorded_.push_back({jc.get_device_time(), jc.get_sample_times(), status.analog_sticks.left.horizontal,
+                                         status.gyro.x, status.buttons.right.a});
+                }
+                ++step_;
+                fake_hidapi::Input input;
+                uint16_t stick = static_cast<uint16_t>(0x400 + (step_ % 64) * 16);
+                input.sticks = {stick, stick, stick, stick};
+                input.gyro = {static_cast<int16_t>(step_ % 64 * 10), static_cast<int16_t>(step_ % 64 * 10), 0};
+                input.buttons = {static_cast<uint8_t>(step_ % 2 ? 0x08 : 0x00), 0x00, 0x00};
+                fake_hidapi::set_input(input);
+            });
+        }
+        ~Ramp() { joycon_.unregister_update_hook(hook_id_); }
+
+        std::vector<Recorded> recorded() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return recorded_;
+        }
+
+    private:
+        JoyCon& joycon_;
+        size_t hook_id_;
+        std::mutex mutex_;
+        std::vector<Recorded> recorded_;
+        int step_ = 0;
+    };
+
+    float lerp(float a, float b, double w) { return static_cast<float>(a + (b - a) * w); }
+
+    void test_interpolation() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        ReconnectOptions reconnect;
+        reconnect.enabled = false;
+        joycon.set_reconnect_options(reconnect);
+        ResamplerOptions options;
+        options.max_lookahead = 8ms;
+        JoyConResampler resampler(joycon, options);
+        CHECK(!resampler.sample_at(clock_type::now()).valid);
+
+        Ramp ramp(joycon);
+        CHECK(wait_until([&] { return ramp.recorded().size() >= 30; }));
+        // Freeze the history: no reports after the link is gone
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_link_state() == JoyCon::LinkState::FAILED; }));
+        auto recorded = ramp.recorded();
+        const Recorded& newest = recorded.back();
+        const Recorded& previous = recorded[recorded.size() - 2];
+        CHECK(previous.stick != newest.stick && previous.a != newest.a);
+
+        // Halfway between two reports: sticks blended, buttons of the older one
+        for (size_t k = recorded.size() - 6; k + 1 < recorded.size(); ++k) {
+            const Recorded& r0 = recorded[k];
+            const Recorded& r1 = recorded[k + 1];
+            auto mid = r0.time + (r1.time - r0.time) / 2;
+            auto sample = resampler.sample_at(mid);
+            CHECK(sample.valid && !sample.extrapolated);
+            CHECK(std::abs(sample.status.analog_sticks.left.horizontal - (r0.stick + r1.stick) / 2) <= 1);
+            CHECK(sample.status.buttons.right.a == r0.a);
+            // On a report's time exactly, that report
+            auto exact = resampler.sample_at(r1.time);
+            CHECK(exact.status.analog_sticks.left.horizontal == r1.stick);
+            CHECK(exact.status.buttons.right.a == r1.a);
+
+            // The IMU between the last sample of one report and the first of the next
+            auto imu_mid = r0.sample_times[2] + (r1.sample_times[0] - r0.sample_times[2]) / 2;
+            CHECK(std::fabs(resampler.sample_at(imu_mid).status.gyro.x - lerp(r0.gyro, r1.gyro, 0.5)) < 0.1f);
+            CHECK(std::fabs(resampler.sample_at(r0.sample_times[2]).status.gyro.x - r0.gyro) < 0.01f);
+        }
+
+        // Past the newest report: extrapolated along the last two, no
+        // further than max_lookahead
+        auto ahead = resampler.sample_at(newest.time + 50ms);
+        auto limit = resampler.sample_at(newest.time + 8ms);
+        CHECK(ahead.extrapolated && limit.extrapolated);
+        double w = std::chrono::duration<double>(newest.time + 8ms - previous.time) / (newest.time - previous.time);
+        CHECK(std::abs(ahead.status.analog_sticks.left.horizontal - std::lround(lerp(previous.stick, newest.stick, w))) <= 1);
+        CHECK(ahead.status.analog_sticks.left.horizontal == limit.status.analog_sticks.left.horizontal);
+        CHECK(ahead.status.gyro.x == limit.status.gyro.x);
+        CHECK(ahead.status.buttons.right.a == newest.a);
+    }
+
+    void test_tick_grid() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        ResamplerOptions options;
+        options.rate_hz = 100.0;
+        options.delay = 15ms;
+        JoyConResampler resampler(joycon, options);
+        CHECK_THROWS(JoyConResampler(joycon, ResamplerOptions{0.0}), std::invalid_argument);
+
+        auto now = clock_type::time_point(123456789us);
+        auto tick = resampler.tick_time(now);
+        CHECK(tick == clock_type::time_point(123450000us) - 15ms);
+        CHECK((tick + options.delay).time_since_epoch() % 10ms == clock_type::duration::zero());
+        // Every time within one period maps to the same tick
+        CHECK(resampler.tick_time(clock_type::time_point(123450000us)) == tick);
+        CHECK(resampler.tick_time(clock_type::time_point(123459999us)) == tick);
+        CHECK(resampler.tick_time(clock_type::time_point(123460000us)) == tick + 10ms);
+
+        CHECK(wait_until([&] { return resampler.sample_tick().valid; }));
+        auto later = clock_type::now();
+        auto sample = resampler.sample_tick(later);
+        CHECK(sample.time == resampler.tick_time(later));
+        CHECK(sample.time <= later - options.delay && sample.time > later - options.delay - 10ms);
+    }
+
+    void test_concurrent_reads() {
+        fake_hidapi::reset();
+        fake_hidapi::DeviceOptions device;
+        device.report_interval = 2ms;
+        fake_hidapi::set_options(device);
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+        JoyConResampler resampler(joycon);
+        Ramp ramp(joycon);
+        CHECK(wait_until([&] { return resampler.sample_tick().valid; }));
+
+        // Sticks and both gyro axes are written with the same value, a torn
+        // read would blend them with different weights
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> samples{0}, torn{0};
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 3; ++i) {
+            readers.emplace_back([&, i] {
+                while (!stop) {
+                    auto sample = resampler.sample_at(clock_type::now() - std::chrono::milliseconds(i * 3));
+                    const auto& s = sample.status;
+                    bool consistent = s.analog_sticks.left.horizontal == s.analog_sticks.left.vertical
+                                   && s.analog_sticks.left.horizontal == s.analog_sticks.right.horizontal
+                                   && s.gyro.x == s.gyro.y && s.gyro.z == 0.0f;
+                    if (!consistent) torn++;
+                    samples++;
+                }
+            });
+        }
+        uint64_t reports = joycon.get_report_stats().reports;
+        CHECK(wait_until([&] { return joycon.get_report_stats().reports > reports + 200; }, 5000ms));
+        stop = true;
+        for (auto& t : readers) t.join();
+        CHECK(samples > 1000);
+        CHECK(torn == 0);
+    }
+}
+
+int main() {
+    test_interpolation();
+    test_tick_grid();
+    test_concurrent_reads();
+    return 0;
+}
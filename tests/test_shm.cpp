@@ -0,0 +1,58 @@
+// SharedMemoryPublisher and SharedMemoryReader: snapshots and history of
+// a simulated Joy-Con, one publisher per name, slot bounds and a publisher
+// that died in the middle of a write.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "shm_publisher.h"
+#include "shm_reader.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string>
+
+using namespace std::chrono_literals;
+
+int main() {
+    const std::string name = "/joycon++test-" + std::to_string(getpid());
+    fake_hidapi::reset();
+    fake_hidapi::Input input;
+    input.buttons = {0x08, 0x00, 0x00};     // A
+    fake_hidapi::set_input(input);
+    JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_R_PRODUCT_ID);
+
+    SharedMemoryPublisher publisher(name);
+    CHECK_THROWS(SharedMemoryPublisher(name), std::runtime_error);
+    CHECK(publisher.add_controller(joycon) == 0);
+
+    SharedMemoryReader reader(name);
+    joycon_shm::ControllerState state{};
+    CHECK(wait_until([&] { return reader.read_state(0, state) && state.report_count > 3; }));
+    CHECK(state.buttons == 0x08);
+    joycon_shm::HistoryEntry history[4];
+    CHECK(reader.read_history(0, history, 4) == 4);
+    CHECK(history[3].report[0] == 0x30);
+    CHECK(!reader.read_state(1, state));
+
+    CHECK_THROWS(reader.read_state(reader.slot_count(), state), std::out_of_range);
+    CHECK_THROWS(reader.read_history(reader.slot_count(), history, 4), std::out_of_range);
+
+    // Sequence left odd, as by a publisher killed mid-write: readers give
+    // up instead of spinning forever
+    publisher.remove_controller(0);
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    CHECK(fd >= 0);
+    void* map = mmap(nullptr, sizeof(joycon_shm::Region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    CHECK(map != MAP_FAILED);
+    auto* region = static_cast<joycon_shm::Region*>(map);
+    region->slots[0].sequence.fetch_add(1);
+    auto start = std::chrono::steady_clock::now();
+    CHECK(!reader.read_state(0, state));
+    CHECK(reader.read_history(0, history, 4) == 0);
+    CHECK(std::chrono::steady_clock::now() - start < 2s);
+    region->slots[0].sequence.fetch_add(1);
+    munmap(map, sizeof(joycon_shm::Region));
+    return 0;
+}
@@ -0,0 +1,161 @@
+// Subcommand replies handed over by the input thread: parallel requests,
+// requests after the input thread stopped, lost replies and blocking
+// calls from the input thread itself. SPI flash writes limited to the user
+// calibration area, reads retried on lost or mismatched replies.
+#include "check.h"
+#include "constants.h"
+#include "fake_device.h"
+#include "joycon.h"
+#include "spi_flash.h"
+#include <atomic>
+
+using namespace std::chrono_literals;
+
+namespace {
+    void test_parallel_reads() {
+        fake_hidapi::reset();
+        std::vector<uint8_t> pattern(300);
+        for (size_t i = 0; i < pattern.size(); ++i) pattern[i] = static_cast<uint8_t>(i * 7);
+        fake_hidapi::write_flash(0x8000, pattern);
+        fake_hidapi::DeviceOptions options;
+        options.reply_delay = 2ms;
+        fake_hidapi::set_options(options);
+
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        SpiFlash flash(joycon);
+        CHECK(flash.read(0x8000, pattern.size()) == pattern);
+        CHECK(flash.read_serial(0x8000, 64) == std::vector<uint8_t>(pattern.begin(), pattern.begin() + 64));
+    }
+
+    void test_reader_stopped() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        ReconnectOptions reconnect;
+        reconnect.enabled = false;
+        joycon.set_reconnect_options(reconnect);
+        fake_hidapi::fail_read_after(5);
+        CHECK(wait_until([&] { return joycon.get_link_state() == JoyCon::LinkState::FAILED; }));
+
+        // Refused up front instead of waiting for a reply nobody hands over
+        auto start = std::chrono::steady_clock::now();
+        CHECK_THROWS(joycon.set_imu_config({}), std::runtime_error);
+        SpiFlash flash(joycon);
+        CHECK_THROWS(flash.read(0x6000, 64), std::runtime_error);
+        CHECK(std::chrono::steady_clock::now() - start < 500ms);
+    }
+
+    void test_lost_reply() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        fake_hidapi::DeviceOptions options;
+        options.drop_every = 1;
+        fake_hidapi::set_options(options);
+        // Options apply to devices opened afterwards, drop the link once
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_reconnect_stats().reconnects == 1; }));
+
+        auto start = std::chrono::steady_clock::now();
+        CHECK_THROWS(joycon.set_imu_config({}), std::runtime_error);
+        auto waited = std::chrono::steady_clock::now() - start;
+        CHECK(waited >= 900ms && waited < 2s);
+        // The JoyCon keeps working afterwards
+        uint64_t reports = joycon.get_report_stats().reports;
+        CHECK(wait_until([&] { return joycon.get_report_stats().reports > reports; }));
+    }
+
+    void test_flash_write() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        SpiFlash flash(joycon);
+        auto before = fake_hidapi::read_flash(0x8000, 0x50);
+
+        // Only 0x8010-0x803F, nothing is sent otherwise
+        fake_hidapi::clear_outputs();
+        CHECK_THROWS(flash.write(0x800F, {0x01}), std::out_of_range);
+        CHECK_THROWS(flash.write(0x8030, std::vector<uint8_t>(0x11, 0x02)), std::out_of_range);
+        CHECK_THROWS(flash.write(0x8040, {0x03}), std::out_of_range);
+        CHECK_THROWS(flash.write(0x6000, {0x04}), std::out_of_range);
+        CHECK(fake_hidapi::outputs().empty());
+        CHECK(fake_hidapi::read_flash(0x8000, 0x50) == before);
+
+        // The whole area in two chunks, read back to verify
+        std::vector<uint8_t> data(0x30);
+        for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<uint8_t>(0xA0 + i);
+        flash.write(0x8010, data);
+        CHECK(fake_hidapi::read_flash(0x8010, data.size()) == data);
+        flash.write(0x803F, {0x5A});
+        CHECK(fake_hidapi::read_flash(0x803F, 1) == std::vector<uint8_t>{0x5A});
+        // Neighbours untouched
+        CHECK(fake_hidapi::read_flash(0x8000, 0x10) == std::vector<uint8_t>(before.begin(), before.begin() + 0x10));
+        CHECK(fake_hidapi::read_flash(0x8040, 0x10) == std::vector<uint8_t>(before.begin() + 0x40, before.end()));
+        CHECK(flash.get_stats().bytes_written == data.size() + 1);
+    }
+
+    void test_read_retries() {
+        fake_hidapi::reset();
+        std::vector<uint8_t> pattern(400);
+        for (size_t i = 0; i < pattern.size(); ++i) pattern[i] = static_cast<uint8_t>(i * 11);
+        fake_hidapi::write_flash(0x10000, pattern);
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        // Options apply to devices opened afterwards, drop the link once
+        fake_hidapi::DeviceOptions options;
+        options.drop_every = 5;
+        options.mismatch_every = 3;
+        fake_hidapi::set_options(options);
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_reconnect_stats().reconnects == 1; }));
+
+        SpiFlashOptions flash_options;
+        flash_options.timeout = 50ms;
+        flash_options.retries = 8;
+        SpiFlash flash(joycon, flash_options);
+        uint64_t dropped = fake_hidapi::get_stats().dropped_replies;
+        CHECK(flash.read(0x10000, pattern.size()) == pattern);
+        auto stats = flash.get_stats();
+        // 14 chunks, every lost or mismatched reply asked again
+        CHECK(stats.retries > 0 && fake_hidapi::get_stats().dropped_replies > dropped);
+        CHECK(stats.requests == 14 + stats.retries);
+        CHECK(stats.bytes_read == pattern.size());
+
+        // Out of retries
+        options.drop_every = 1;
+        options.mismatch_every = 0;
+        fake_hidapi::set_options(options);
+        fake_hidapi::fail_read_after(0);
+        CHECK(wait_until([&] { return joycon.get_reconnect_stats().reconnects == 2; }));
+        flash_options.retries = 2;
+        SpiFlash lossy(joycon, flash_options);
+        CHECK_THROWS(lossy.read(0x10000, 16), std::runtime_error);
+        CHECK(lossy.get_stats().retries == 2 && lossy.get_stats().requests == 3);
+    }
+
+    void test_blocking_call_from_hook() {
+        fake_hidapi::reset();
+        JoyCon joycon(JOYCON_VENDOR_ID, JOYCON_L_PRODUCT_ID);
+        std::atomic<int> result{0};
+        size_t id = joycon.register_update_hook([&](JoyCon& jc) {
+            if (result != 0) return;
+            try {
+                jc.set_imu_config({});
+                result = 1;
+            } catch (const std::logic_error&) {
+                result = 2;
+            }
+        });
+        CHECK(wait_until([&] { return result != 0; }));
+        CHECK(result == 2);
+        joycon.unregister_update_hook(id);
+        // Fine from any other thread
+        joycon.set_imu_config({});
+    }
+}
+
+int main() {
+    test_parallel_reads();
+    test_reader_stopped();
+    test_lost_reply();
+    test_flash_write();
+    test_read_retries();
+    test_blocking_call_from_hook();
+    return 0;
+}